@@ -0,0 +1,296 @@
+// APU cost: wall time per emulated second of the APU alone, and of the whole
+// system playing the same music with and without making samples.
+//
+//   bench_apu [-f frames] [-r repeats] [--json]
+//
+// The program plays a looping tune on every channel from its NMI handler (a
+// melody with decaying envelopes, a sweeping second pulse, a triangle bass,
+// noise hats and a DMC sample every half second) while its main loop churns
+// RAM, like a game. The same register writes are then replayed against a
+// standalone APU at the same times. Each mode runs `frames` frames `repeats`
+// times and keeps the fastest run; the system must end in the same state
+// with and without samples, otherwise the exit status is 1.
+
+#include "apu.hpp"
+#include "bus.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using Writes = std::vector<std::pair<byte, byte>>;     // register ($4000 + n), value
+
+    const uint64_t CYCLES_PER_FRAME = 29781;    // NTSC, 341 * 262 / 3
+    const size_t SONG_FRAMES = 240;
+    const h_word SONG = 0x9000;
+    const h_word SAMPLE = 0xF000;               // DMC sample, $4012 = $C0
+    const byte SONG_END = 0xFF;                 // of a frame's writes
+    const byte SONG_LOOP = 0xFE;
+
+    const std::vector<byte> RESET = {
+        0x78, 0xD8,             //        SEI / CLD
+        0xA2, 0xFF, 0x9A,       //        LDX #$FF / TXS
+        0xA9, 0x00,             //        LDA #<song
+        0x85, 0x00,             //        STA $00
+        0xA9, 0x90,             //        LDA #>song
+        0x85, 0x01,             //        STA $01
+        0xA9, 0x40,             //        LDA #$40
+        0x8D, 0x17, 0x40,       //        STA $4017     no frame IRQ
+        0xA9, 0x0F,             //        LDA #$0F
+        0x8D, 0x15, 0x40,       //        STA $4015
+        0xA9, 0x80,             //        LDA #$80
+        0x8D, 0x00, 0x20,       //        STA $2000     NMI on
+        0xE8,                   // main:  INX
+        0xBD, 0x00, 0x03,       //        LDA $0300,X
+        0x69, 0x03,             //        ADC #3
+        0x9D, 0x00, 0x03,       //        STA $0300,X
+        0x4C, 0x1C, 0x80,       //        JMP main
+    };
+
+    // plays the writes of one frame, ($00) points at them
+    const std::vector<byte> NMI = {
+        0x48, 0x8A, 0x48,       //        PHA / TXA / PHA
+        0x98, 0x48,             //        TYA / PHA
+        0xA0, 0x00,             //        LDY #0
+        0xB1, 0x00,             // next:  LDA ($00),Y
+        0xC9, SONG_END,         //        CMP #end
+        0xF0, 0x0F,             //        BEQ done
+        0xC9, SONG_LOOP,        //        CMP #loop
+        0xF0, 0x1C,             //        BEQ loop
+        0xAA,                   //        TAX
+        0xC8,                   //        INY
+        0xB1, 0x00,             //        LDA ($00),Y
+        0x9D, 0x00, 0x40,       //        STA $4000,X
+        0xC8,                   //        INY
+        0x4C, 0x07, 0x81,       //        JMP next
+        0xC8,                   // done:  INY
+        0x98,                   //        TYA
+        0x18,                   //        CLC
+        0x65, 0x00,             //        ADC $00
+        0x85, 0x00,             //        STA $00
+        0x90, 0x02,             //        BCC out
+        0xE6, 0x01,             //        INC $01
+        0x68, 0xA8,             // out:   PLA / TAY
+        0x68, 0xAA,             //        PLA / TAX
+        0x68,                   //        PLA
+        0x40,                   //        RTI
+        0xA9, 0x00,             // loop:  LDA #<song
+        0x85, 0x00,             //        STA $00
+        0xA9, 0x90,             //        LDA #>song
+        0x85, 0x01,             //        STA $01
+        0xA0, 0x00,             //        LDY #0
+        0x4C, 0x07, 0x81,       //        JMP next
+    };
+
+    // pulse and triangle timer period of a MIDI note
+    h_word notePeriod(int note, int divider) {
+        double frequency = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+        return static_cast<h_word>(APU::CLOCK_RATE / (divider * frequency) - 1.0 + 0.5);
+    }
+
+    // register writes of each frame of the tune
+    std::vector<Writes> buildSong() {
+        const int melody[16] = { 72, 76, 79, 84, 83, 79, 76, 74, 72, 74, 76, 79, 77, 74, 71, 67 };
+        const int bass[4] = { 48, 45, 41, 43 };
+        std::vector<Writes> song(SONG_FRAMES);
+        for (size_t f = 0; f < SONG_FRAMES; f++) {
+            Writes& w = song[f];
+            if (f % 8 == 0) {
+                h_word p = notePeriod(melody[(f / 8) % 16], 16);
+                w.push_back({ 0x00, 0x86 });                    // duty 50%, decaying
+                w.push_back({ 0x02, static_cast<byte>(p) });
+                w.push_back({ 0x03, static_cast<byte>(0x08 | (p >> 8)) });
+            }
+            if (f % 16 == 4) {
+                h_word p = notePeriod(melody[(f / 16 + 2) % 16] - 12, 16);
+                w.push_back({ 0x04, 0x4A });                    // duty 25%, decaying
+                w.push_back({ 0x05, 0x9B });                    // sweeping down
+                w.push_back({ 0x06, static_cast<byte>(p) });
+                w.push_back({ 0x07, static_cast<byte>(0x08 | (p >> 8)) });
+            }
+            if (f % 60 == 0) {
+                h_word p = notePeriod(bass[(f / 60) % 4], 32);
+                w.push_back({ 0x08, 0xFF });
+                w.push_back({ 0x0A, static_cast<byte>(p) });
+                w.push_back({ 0x0B, static_cast<byte>(0x08 | (p >> 8)) });
+            }
+            if (f % 4 == 2) {
+                w.push_back({ 0x0C, 0x01 });                    // short decay
+                w.push_back({ 0x0E, static_cast<byte>(f % 16 == 2 ? 0x04 : 0x01) });
+                w.push_back({ 0x0F, 0x08 });
+            }
+            if (f % 30 == 0) {
+                w.push_back({ 0x10, 0x0E });
+                w.push_back({ 0x12, static_cast<byte>((SAMPLE - 0xC000) >> 6) });
+                w.push_back({ 0x13, 0x20 });                    // 513 bytes
+                w.push_back({ 0x15, 0x1F });
+            }
+        }
+        return song;
+    }
+
+    // NROM-256 iNES file
+    std::vector<byte> buildRom(const std::vector<Writes>& song) {
+        SyntheticRom rom(2);
+        rom.load(0x8000, RESET);
+        rom.load(0x8100, NMI);
+
+        byte* table = rom.prg(SONG);
+        for (const Writes& frame : song) {
+            for (const auto& w : frame) {
+                *table++ = w.first;
+                *table++ = w.second;
+            }
+            *table++ = SONG_END;
+        }
+        *table = SONG_LOOP;
+
+        byte* sample = rom.prg(SAMPLE);
+        uint32_t seed = 0x4011;
+        for (size_t i = 0; i < 0x0400; i++) {
+            seed = seed * 1103515245u + 12345u;
+            sample[i] = static_cast<byte>(seed >> 16);
+        }
+
+        rom.setVectors(0x8100, 0x8000, 0x8000);
+        return rom.file();
+    }
+
+    struct Result {
+        const char* mode;
+        double seconds;             // wall time
+        double emulated;            // seconds of NES time
+        uint64_t samples;
+        uint64_t state_hash;        // systems only
+    };
+
+    Result runSystem(std::shared_ptr<const CartridgeImage> rom, bool samples, uint64_t frames) {
+        Bus bus;
+        bus.insertCartridge(rom);
+        bus.reset();
+        APU& apu = bus.getApu();
+        apu.setOutputEnabled(samples);
+
+        static int16_t block[8192];
+        uint64_t made = 0, cycles = 0;
+        auto start = Clock::now();
+        for (uint64_t f = 0; f < frames; f++) {
+            cycles += bus.runFrame();
+            made += apu.readSamples(block, sizeof(block) / sizeof(block[0]));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return { samples ? "system" : "system_silent", seconds, cycles / APU::CLOCK_RATE, made, bus.stateHash() };
+    }
+
+    struct Replay {
+        const byte* prg;
+    };
+
+    byte replayRead(void* device, h_word address) {
+        return static_cast<Replay*>(device)->prg[address - 0x8000];
+    }
+
+    Result runApu(const std::vector<byte>& file, const std::vector<Writes>& song, uint64_t frames) {
+        Replay replay = { &file[SyntheticRom::HEADER] };
+        APU apu;
+        apu.setDmcReader(&replayRead, &replay);
+
+        static int16_t block[8192];
+        uint64_t made = 0;
+        auto start = Clock::now();
+        apu.writeRegister(0x4017, 0x40);
+        apu.writeRegister(0x4015, 0x0F);
+        for (uint64_t f = 0; f < frames; f++) {
+            // about where the NMI handler makes them
+            uint64_t time = f * CYCLES_PER_FRAME;
+            for (const auto& w : song[f % SONG_FRAMES]) {
+                time += 20;
+                apu.runTo(time);
+                apu.writeRegister(static_cast<h_word>(0x4000 + w.first), w.second);
+            }
+            apu.runTo((f + 1) * CYCLES_PER_FRAME);
+            made += apu.readSamples(block, sizeof(block) / sizeof(block[0]));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return { "apu", seconds, frames * CYCLES_PER_FRAME / APU::CLOCK_RATE, made, 0 };
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_apu [-f frames] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    std::vector<Writes> song = buildSong();
+    std::vector<byte> file = buildRom(song);
+    auto rom = CartridgeImage::fromMemory(file, "apu");
+
+    std::vector<Result> results;
+    for (int mode = 0; mode < 3; mode++) {
+        Result best = { nullptr, 0.0, 0.0, 0, 0 };
+        for (unsigned r = 0; r < repeats; r++) {
+            Result again = mode == 0 ? runApu(file, song, frames) : runSystem(rom, mode == 2, frames);
+            if (!best.mode || again.seconds < best.seconds)
+                best = again;
+        }
+        results.push_back(best);
+    }
+
+    // samples or not, the channels do the same
+    bool same = results[1].state_hash == results[2].state_hash;
+    if (!same)
+        std::fprintf(stderr, "system: state differs with and without samples\n");
+    const Result& apu = results[0];
+    const Result& system = results[2];
+    double share = (apu.seconds / apu.emulated) / (system.seconds / system.emulated);
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"apu\",\n  \"frames\": %llu,\n  \"repeats\": %u,\n  \"identical\": %s,\n"
+            "  \"apu_share\": %.5f,\n  \"results\": [\n", (unsigned long long)frames, repeats, same ? "true" : "false", share);
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"mode\": \"%s\", \"seconds\": %.6f, \"emulated_seconds\": %.3f, "
+                "\"ms_per_emulated_second\": %.4f, \"samples\": %llu }%s\n",
+                r.mode, r.seconds, r.emulated, 1000.0 * r.seconds / r.emulated, (unsigned long long)r.samples,
+                i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%-14s %10s %16s %10s %10s\n", "mode", "emulated", "ms per emulated", "realtime", "samples");
+    for (const Result& r : results)
+        std::printf("%-14s %9.2fs %15.3f %9.0fx %10llu\n", r.mode, r.emulated, 1000.0 * r.seconds / r.emulated,
+            r.emulated / r.seconds, (unsigned long long)r.samples);
+    std::printf("APU alone costs %.1f%% of the whole system's time\n", 100.0 * share);
+    std::printf("%s\n", same ? "same state with and without samples" : "MISMATCH");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+// Batched CPU: aggregate throughput (lanes x instructions per second) of K
+// systems run together by BatchCpu against the same K systems run one after
+// the other, and a check that every lane ends up in the same state.
+//
+//   bench_batch_cpu [-l lanes] [-f frames] [-r repeats] [--json]
+//
+// Every lane runs the same program, the kind of loop a fuzzer or a training
+// environment drives: it reads the joypad each frame, churns a table in RAM
+// with the buttons (a data dependent branch, indexed and indirect accesses, a
+// subroutine with stack traffic) and waits for the NMI. Each lane gets its own
+// pseudo-random buttons every frame, so the lanes diverge inside the frame and
+// meet again on the NMI. Without -l the lane counts 1, 4, 16, 64 and 256 are
+// measured; any lane whose final state differs from its one-by-one twin makes
+// the exit status 1.
+
+#include "batch_cpu.hpp"
+#include "bus.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const uint64_t CYCLES_PER_FRAME = 29781;    // NTSC, 341 * 262 / 3
+
+    const std::vector<byte> RESET = {
+        0x78, 0xD8,             //        SEI / CLD
+        0xA2, 0xFF, 0x9A,       //        LDX #$FF / TXS
+        0xA9, 0x80,             //        LDA #$80
+        0x8D, 0x00, 0x20,       //        STA $2000     NMI on
+        0xA9, 0x01,             // main:  LDA #1
+        0x8D, 0x16, 0x40,       //        STA $4016     strobe the joypad
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x16, 0x40,       //        STA $4016
+        0xA2, 0x08,             //        LDX #8
+        0xAD, 0x16, 0x40,       // read:  LDA $4016
+        0x4A,                   //        LSR A
+        0x26, 0x10,             //        ROL $10       buttons
+        0xCA,                   //        DEX
+        0xD0, 0xF7,             //        BNE read
+        0xA9, 0x0C,             //        LDA #12
+        0x85, 0x18,             //        STA $18
+        0xA0, 0x00,             // outer: LDY #0
+        0xB9, 0x00, 0x02,       // work:  LDA $0200,Y
+        0x65, 0x10,             //        ADC $10
+        0x45, 0x11,             //        EOR $11
+        0x2A,                   //        ROL A
+        0x99, 0x00, 0x02,       //        STA $0200,Y
+        0xC9, 0x80,             //        CMP #$80
+        0x90, 0x02,             //        BCC skip      taken or not lane by lane
+        0xE6, 0x12,             //        INC $12
+        0xC8,                   // skip:  INY
+        0xC0, 0x40,             //        CPY #64
+        0xD0, 0xEA,             //        BNE work
+        0x20, 0x80, 0x80,       //        JSR mix
+        0xC6, 0x18,             //        DEC $18
+        0xD0, 0xE1,             //        BNE outer
+        0xA5, 0x13,             //        LDA $13
+        0xC5, 0x13,             // wait:  CMP $13       until the NMI counts the frame
+        0xF0, 0xFC,             //        BEQ wait
+        0x4C, 0x0A, 0x80,       //        JMP main
+    };
+
+    const std::vector<byte> MIX = {
+        0x08,                   // PHP
+        0x48,                   // PHA
+        0xA5, 0x12,             // LDA $12
+        0x0A,                   // ASL A
+        0x85, 0x11,             // STA $11
+        0xA5, 0x10,             // LDA $10
+        0x29, 0x3F,             // AND #$3F
+        0xAA,                   // TAX
+        0xB5, 0x20,             // LDA $20,X
+        0x18,                   // CLC
+        0x69, 0x07,             // ADC #7
+        0x95, 0x20,             // STA $20,X
+        0x38,                   // SEC
+        0xE5, 0x11,             // SBC $11
+        0x4E, 0x14, 0x00,       // LSR $0014
+        0x66, 0x15,             // ROR $15
+        0x24, 0x15,             // BIT $15
+        0xA0, 0x03,             // LDY #3
+        0xB1, 0x16,             // LDA ($16),Y
+        0x68,                   // PLA
+        0x28,                   // PLP
+        0x60,                   // RTS
+    };
+
+    const std::vector<byte> NMI = {
+        0xE6, 0x13,             // INC $13
+        0x40,                   // RTI
+    };
+
+    // NROM-128 iNES file
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, RESET);
+        rom.load(0x8080, MIX);
+        rom.load(0x8100, NMI);
+        rom.setVectors(0x8100, 0x8000, 0x8000);
+        return rom.file();
+    }
+
+    // buttons of a lane on a frame, the same for both runs
+    byte buttons(size_t lane, uint64_t frame) {
+        uint64_t h = (lane * 0x9E3779B97F4A7C15ull) ^ (frame * 0xBF58476D1CE4E5B9ull);
+        h ^= h >> 31;
+        h *= 0x94D049BB133111EBull;
+        return static_cast<byte>(h >> 40);
+    }
+
+    struct Result {
+        size_t lanes;
+        double separate;            // seconds
+        double batched;
+        uint64_t instructions;      // over every lane
+        BatchStats stats;
+        bool same;
+    };
+
+    std::vector<std::unique_ptr<Bus>> boot(std::shared_ptr<const CartridgeImage> rom, size_t lanes) {
+        std::vector<std::unique_ptr<Bus>> systems;
+        for (size_t l = 0; l < lanes; l++) {
+            systems.push_back(std::make_unique<Bus>());
+            systems.back()->insertCartridge(rom);
+            systems.back()->reset();
+            // nobody looks at the frames, the CPUs are what is measured
+            systems.back()->getPpu().setRenderSkip(true);
+        }
+        return systems;
+    }
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, size_t lanes, uint64_t frames) {
+        Result result = { lanes, 0.0, 0.0, 0, {}, true };
+
+        auto separate = boot(rom, lanes);
+        auto start = Clock::now();
+        for (uint64_t f = 0; f < frames; f++) {
+            for (size_t l = 0; l < lanes; l++) {
+                separate[l]->setController(0, buttons(l, f));
+                separate[l]->run(CYCLES_PER_FRAME);
+            }
+        }
+        result.separate = std::chrono::duration<double>(Clock::now() - start).count();
+
+        auto batched = boot(rom, lanes);
+        BatchCpu batch;
+        for (auto& bus : batched)
+            batch.addLane(*bus);
+        start = Clock::now();
+        for (uint64_t f = 0; f < frames; f++) {
+            for (size_t l = 0; l < lanes; l++)
+                batched[l]->setController(0, buttons(l, f));
+            batch.run(CYCLES_PER_FRAME);
+        }
+        result.batched = std::chrono::duration<double>(Clock::now() - start).count();
+
+        // both ran the very same instructions, if the states agree
+        result.stats = batch.stats();
+        result.instructions = result.stats.instructions();
+        for (size_t l = 0; l < lanes; l++) {
+            if (separate[l]->stateHash() != batched[l]->stateHash()) {
+                std::fprintf(stderr, "%zu lanes: lane %zu differs from its one-by-one run\n", lanes, l);
+                result.same = false;
+                break;
+            }
+        }
+        return result;
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_batch_cpu [-l lanes] [-f frames] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts = { 1, 4, 16, 64, 256 };
+    uint64_t frames = 120;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-l") && i + 1 < argc)
+            counts = { static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10)) };
+        else if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || repeats == 0 || counts[0] == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "batch_cpu");
+    std::vector<Result> results;
+    bool same = true;
+    for (size_t lanes : counts) {
+        Result best = measure(rom, lanes, frames);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(rom, lanes, frames);
+            best.separate = std::min(best.separate, again.separate);
+            best.batched = std::min(best.batched, again.batched);
+            best.same &= again.same;
+        }
+        same &= best.same;
+        results.push_back(best);
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"batch_cpu\",\n  \"frames\": %llu,\n  \"repeats\": %u,\n"
+            "  \"identical\": %s,\n  \"results\": [\n", (unsigned long long)frames, repeats, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"lanes\": %zu, \"instructions\": %llu, \"separate_seconds\": %.6f, "
+                "\"batched_seconds\": %.6f, \"separate_ips\": %.0f, \"batched_ips\": %.0f, "
+                "\"average_group\": %.2f, \"scalar_fraction\": %.5f }%s\n",
+                r.lanes, (unsigned long long)r.instructions, r.separate, r.batched,
+                r.instructions / r.separate, r.instructions / r.batched,
+                r.stats.groups ? double(r.stats.batched) / r.stats.groups : 0.0,
+                double(r.stats.scalar) / r.instructions, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%6s %14s %16s %16s %9s %9s %8s\n", "lanes", "instructions", "separate inst/s",
+        "batched inst/s", "speedup", "avg group", "scalar");
+    for (const Result& r : results)
+        std::printf("%6zu %14llu %16.3e %16.3e %8.2fx %9.2f %7.3f%%\n", r.lanes,
+            (unsigned long long)r.instructions, r.instructions / r.separate, r.instructions / r.batched,
+            r.separate / r.batched, r.stats.groups ? double(r.stats.batched) / r.stats.groups : 0.0,
+            100.0 * r.stats.scalar / r.instructions);
+    std::printf("%s\n", same ? "every lane identical to its one-by-one run" : "MISMATCH");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Synthetic cartridges and frame hashes shared by the benches (and the
+// built-in program of nes_batch), so that they all run the same kind of ROM
+// and compare frames the same way.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "nes_common.hpp"
+#include "ppu.hpp"
+
+/**
+ * @class SyntheticRom
+ * @brief NROM iNES file for a bench program: vertical mirroring, PRG filled
+ * with NOP, CHR-ROM zeroed. PRG is addressed by CPU address from $8000.
+ */
+class SyntheticRom {
+public:
+    static constexpr size_t HEADER = 16;
+    static constexpr size_t PRG_BANK = 0x4000;
+    static constexpr size_t CHR_BANK = 0x2000;
+
+    /** @param prg_banks 1 for NROM-128, 2 for NROM-256. */
+    explicit SyntheticRom(byte prg_banks = 1)
+        : prg_size(prg_banks * PRG_BANK), data(HEADER + prg_size + CHR_BANK, 0x00) {
+        const byte header[8] = { 'N', 'E', 'S', 0x1A, prg_banks, 1, 0x01, 0x00 };
+        std::memcpy(data.data(), header, sizeof(header));
+        std::memset(&data[HEADER], 0xEA, prg_size);
+    }
+
+    /** @brief PRG byte the CPU sees at `address`. */
+    byte* prg(h_word address) { return &data[HEADER + ((address - 0x8000) & (prg_size - 1))]; }
+    byte* chr() { return &data[HEADER + prg_size]; }
+    size_t chrSize() const { return CHR_BANK; }
+
+    void load(h_word address, const std::vector<byte>& code) {
+        std::memcpy(prg(address), code.data(), code.size());
+    }
+
+    void setVectors(h_word nmi, h_word reset, h_word irq) {
+        const h_word vectors[3] = { nmi, reset, irq };
+        for (size_t i = 0; i < 3; i++) {
+            prg(0xFFFA + i * 2)[0] = vectors[i] & 0xFF;
+            prg(0xFFFA + i * 2)[1] = vectors[i] >> 8;
+        }
+    }
+
+    /** @brief Fills CHR with xorshift noise, tiles of every pattern. */
+    void noisyChr(uint32_t seed = 0x2C02) {
+        byte* tiles = chr();
+        for (size_t i = 0; i < CHR_BANK; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            tiles[i] = static_cast<byte>(seed);
+        }
+    }
+
+    const std::vector<byte>& file() const { return data; }
+
+private:
+    size_t prg_size;
+    std::vector<byte> data;
+};
+
+/** @brief Hash of a frame of PPU palette indices. */
+inline uint64_t frameHash(const byte* pixels) {
+    return fnv1a(pixels, PPU::WIDTH * PPU::HEIGHT);
+}
@@ -0,0 +1,220 @@
+// CPU hot path throughput: instructions and cycles per second for synthetic
+// instruction mixes, through each execution path.
+//
+//   bench_cpu [-c cycles] [-r repeats] [--json]
+//
+// Every mix is an endless loop in ROM at $8000. Each (mix, engine) pair runs
+// `cycles` CPU cycles `repeats` times and keeps the fastest run. With --json
+// the results are printed as one JSON document with a fixed key order, so the
+// outputs of two commits can be compared with diff or any JSON tool.
+
+#include "bus.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Mix {
+        const char* name;
+        const char* description;
+        std::vector<byte> program;  // loaded at $8000
+        std::vector<byte> routine;  // loaded at $8010, if any
+    };
+
+    const std::vector<Mix>& mixes() {
+        static const std::vector<Mix> MIXES = {
+            { "alu", "immediate and accumulator arithmetic, logic and shifts",
+              {
+                  0x18, 0x69, 0x11,   // CLC / ADC #$11
+                  0x49, 0x5A,         // EOR #$5A
+                  0x29, 0xF3,         // AND #$F3
+                  0x09, 0x04,         // ORA #$04
+                  0x0A, 0x2A,         // ASL A / ROL A
+                  0x4A, 0x6A,         // LSR A / ROR A
+                  0xAA, 0xE8, 0x8A,   // TAX / INX / TXA
+                  0x38, 0xE9, 0x07,   // SEC / SBC #$07
+                  0xC9, 0x40,         // CMP #$40
+                  0x88,               // DEY
+                  0x4C, 0x00, 0x80,   // JMP $8000
+              }, {} },
+            { "branch", "taken and not taken conditional branches",
+              {
+                  0xA2, 0x00,         //       LDX #0
+                  0xE8,               // loop: INX
+                  0xE0, 0x80,         //       CPX #$80
+                  0x90, 0x02,         //       BCC skip
+                  0x30, 0x00,         //       BMI skip
+                  0x8A,               // skip: TXA
+                  0x29, 0x03,         //       AND #3
+                  0xF0, 0x02,         //       BEQ next
+                  0x10, 0x00,         //       BPL next
+                  0xD0, 0xF0,         // next: BNE loop
+                  0x4C, 0x02, 0x80,   //       JMP loop
+              }, {} },
+            { "memory", "indexed loads and stores, mostly across a page boundary (ABX/ABY/IZY)",
+              {
+                  0xA9, 0xF0, 0x85, 0x20,     //       LDA #$F0 / STA $20
+                  0xA9, 0x02, 0x85, 0x21,     //       LDA #$02 / STA $21
+                  0xA0, 0x00,                 //       LDY #0
+                  0xBD, 0xF0, 0x02,           // loop: LDA $02F0,X
+                  0x79, 0xF0, 0x03,           //       ADC $03F0,Y
+                  0x91, 0x20,                 //       STA ($20),Y
+                  0x51, 0x20,                 //       EOR ($20),Y
+                  0x9D, 0x00, 0x04,           //       STA $0400,X
+                  0xE8, 0xC8, 0xC8,           //       INX / INY / INY
+                  0xD0, 0xEE,                 //       BNE loop
+                  0x4C, 0x0A, 0x80,           //       JMP loop
+              }, {} },
+            { "stack", "nested subroutine calls and stack pushes",
+              {
+                  0x20, 0x10, 0x80,   // loop: JSR sub
+                  0x20, 0x10, 0x80,   //       JSR sub
+                  0x08, 0x28,         //       PHP / PLP
+                  0x4C, 0x00, 0x80,   //       JMP loop
+              },
+              {
+                  0x48,               // sub:  PHA
+                  0x20, 0x18, 0x80,   //       JSR leaf
+                  0x68,               //       PLA
+                  0x60,               //       RTS
+                  0xEA, 0xEA,
+                  0x60,               // leaf: RTS
+              } },
+        };
+        return MIXES;
+    }
+
+    enum class Engine { Clock, Step, BlockCache };
+
+    const char* engineName(Engine engine) {
+        switch (engine) {
+        case Engine::Clock: return "clock";
+        case Engine::Step: return "step";
+        default: return "block_cache";
+        }
+    }
+
+    struct Result {
+        const char* mix;
+        const char* engine;
+        uint64_t instructions;
+        uint64_t cycles;
+        double seconds;
+    };
+
+    std::vector<byte> buildRom(const Mix& mix) {
+        std::vector<byte> rom(0x4000, 0xEA);
+        std::copy(mix.program.begin(), mix.program.end(), rom.begin());
+        std::copy(mix.routine.begin(), mix.routine.end(), rom.begin() + 0x10);
+        // reset vector to $8000
+        rom[0x3FFC] = 0x00;
+        rom[0x3FFD] = 0x80;
+        return rom;
+    }
+
+    // one timed run of the CPU alone: Bus::clock() and Bus::run() would add
+    // the PPU, scheduler and interrupt polling to the measure. Each engine
+    // counts the instructions it starts.
+    Result measure(const Mix& mix, Engine engine, uint64_t budget) {
+        std::vector<byte> rom = buildRom(mix);
+        Bus bus;
+        bus.memoryMap().mapRom(0x8000, 0xFFFF, rom.data(), rom.size());
+        bus.reset();
+        CPU& cpu = bus.getCpu();
+        cpu.enableBlockCache(engine == Engine::BlockCache);
+        // leave the reset sequence out of the measure
+        cpu.step();
+
+        uint64_t cycles = 0, instructions = 0;
+        auto start = Clock::now();
+        switch (engine) {
+        case Engine::Clock:
+            for (; cycles < budget; cycles++) {
+                instructions += cpu.complete();
+                cpu.clock();
+            }
+            break;
+        case Engine::Step:
+            for (; cycles < budget; instructions++)
+                cycles += cpu.step();
+            break;
+        case Engine::BlockCache:
+            cycles = cpu.run(budget);
+            instructions = cpu.blockCache()->executedInstructions();
+            break;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return { mix.name, engineName(engine), instructions, cycles, seconds };
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_cpu [-c cycles] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t budget = 1789773 * 20; // twenty seconds of NTSC time
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-c") && i + 1 < argc)
+            budget = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (budget == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    std::vector<Result> results;
+    for (const Mix& mix : mixes()) {
+        for (Engine engine : { Engine::Step, Engine::Clock, Engine::BlockCache }) {
+            Result best = measure(mix, engine, budget);
+            for (unsigned r = 1; r < repeats; r++) {
+                Result again = measure(mix, engine, budget);
+                if (again.seconds < best.seconds)
+                    best = again;
+            }
+            results.push_back(best);
+        }
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"cpu\",\n  \"cycles\": %llu,\n  \"repeats\": %u,\n  \"results\": [\n",
+            (unsigned long long)budget, repeats);
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"mix\": \"%s\", \"engine\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+                "\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f }%s\n",
+                r.mix, r.engine, (unsigned long long)r.instructions, (unsigned long long)r.cycles,
+                r.seconds, r.instructions / r.seconds, r.cycles / r.seconds,
+                i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return 0;
+    }
+
+    for (const Mix& mix : mixes())
+        std::printf("%-7s %s\n", mix.name, mix.description);
+    std::printf("\n%-7s %-12s %14s %14s %10s %12s\n", "mix", "engine", "instructions", "cycles",
+        "Minstr/s", "Mcycles/s");
+    for (const Result& r : results)
+        std::printf("%-7s %-12s %14llu %14llu %10.2f %12.2f\n", r.mix, r.engine,
+            (unsigned long long)r.instructions, (unsigned long long)r.cycles,
+            r.instructions / r.seconds / 1e6, r.cycles / r.seconds / 1e6);
+    return 0;
+}
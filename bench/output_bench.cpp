@@ -0,0 +1,211 @@
+// Output rings: frames per second of a Console publishing its frames to a
+// consumer thread, with each backpressure policy, and a check that the
+// consumer sees in place exactly the frames a single threaded run renders.
+//
+//   bench_output [-f frames] [-w microseconds] [-n slots] [--json]
+//
+// The program scrolls a full screen of tiles by one pixel per frame. The
+// consumer hashes every frame it gets and then busy-waits `-w` microseconds,
+// standing in for an encoder. With "block" it must see every frame; with
+// "drop" the frames it sees must be the right ones, in order. Any mismatch
+// makes the exit status 1.
+
+#include "console.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const std::vector<byte> PROGRAM = {
+        0x78,                   //        SEI
+        0xA9, 0x3F,             //        LDA #$3F
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA2, 0x00,             //        LDX #0
+        0x8A,                   // pal:   TXA
+        0x8D, 0x07, 0x20,       //        STA $2007
+        0xE8,                   //        INX
+        0xE0, 0x20,             //        CPX #32
+        0xD0, 0xF7,             //        BNE pal
+        0xA9, 0x20,             //        LDA #$20
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA0, 0x04,             //        LDY #4
+        0xA2, 0x00,             //        LDX #0
+        0x8E, 0x07, 0x20,       // nt:    STX $2007
+        0xE8,                   //        INX
+        0xD0, 0xFA,             //        BNE nt
+        0x88,                   //        DEY
+        0xD0, 0xF7,             //        BNE nt
+        0xA9, 0x1E,             //        LDA #$1E
+        0x8D, 0x01, 0x20,       //        STA $2001     background and sprites
+        0x2C, 0x02, 0x20,       // wait:  BIT $2002
+        0x10, 0xFB,             //        BPL wait
+        0xE6, 0x00,             //        INC $00
+        0xA5, 0x00,             //        LDA $00
+        0x8D, 0x05, 0x20,       //        STA $2005
+        0x8D, 0x05, 0x20,       //        STA $2005
+        0x4C, 0x32, 0x80,       //        JMP wait
+    };
+
+    // NROM-128 iNES file with noisy CHR
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, PROGRAM);
+        rom.setVectors(0x8000, 0x8000, 0x8000);
+        rom.noisyChr();
+        return rom.file();
+    }
+
+    void work(unsigned microseconds) {
+        auto until = Clock::now() + std::chrono::microseconds(microseconds);
+        while (Clock::now() < until) {}
+    }
+
+    std::unique_ptr<Console> boot(std::shared_ptr<const CartridgeImage> rom, const OutputConfig& config) {
+        auto console = std::make_unique<Console>(config);
+        console->getBus().insertCartridge(rom);
+        console->getBus().reset();
+        return console;
+    }
+
+    // frame hashes of a run with the consumer on the emulation thread
+    std::vector<uint64_t> reference(std::shared_ptr<const CartridgeImage> rom, uint64_t frames) {
+        auto console = boot(rom, OutputConfig());
+        std::vector<uint64_t> hashes;
+        hashes.reserve(frames);
+        while (hashes.size() < frames) {
+            console->runFrames(1);
+            while (const VideoFrame* frame = console->video().front()) {
+                hashes.push_back(frameHash(frame->pixels.data()));
+                console->video().release();
+            }
+        }
+        hashes.resize(frames);
+        return hashes;
+    }
+
+    struct Result {
+        const char* mode;
+        double seconds;
+        uint64_t delivered;
+        uint64_t dropped;
+        bool correct;
+    };
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, Backpressure mode, uint64_t frames, size_t slots,
+        unsigned microseconds, const std::vector<uint64_t>& expected) {
+        OutputConfig config;
+        config.video_frames = slots;
+        config.backpressure = mode;
+        auto console = boot(rom, config);
+
+        Result result = { mode == Backpressure::Block ? "block" : "drop", 0.0, 0, 0, true };
+        uint64_t last = 0;
+        auto start = Clock::now();
+        std::thread consumer([&] {
+            while (const VideoFrame* frame = console->video().wait()) {
+                uint64_t hash = frameHash(frame->pixels.data());
+                bool in_order = frame->number > last && frame->number <= expected.size();
+                if (!in_order || hash != expected[frame->number - 1])
+                    result.correct = false;
+                last = frame->number;
+                result.delivered++;
+                console->video().release();
+                work(microseconds);
+            }
+        });
+        // blocking on a full audio ring would stall the frames as well
+        std::thread listener([&] {
+            while (console->audio().wait())
+                console->audio().release();
+        });
+        console->runFrames(frames);
+        console->closeOutputs();
+        consumer.join();
+        listener.join();
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.dropped = console->droppedFrames();
+        if (mode == Backpressure::Block && result.delivered != frames)
+            result.correct = false;
+        return result;
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_output [-f frames] [-w microseconds] [-n slots] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 1200;
+    unsigned microseconds = 200;
+    size_t slots = 4;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-w") && i + 1 < argc)
+            microseconds = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            slots = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || slots == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "output");
+    auto start = Clock::now();
+    std::vector<uint64_t> expected = reference(rom, frames);
+    double inline_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<Result> results;
+    for (Backpressure mode : { Backpressure::Block, Backpressure::Drop })
+        results.push_back(measure(rom, mode, frames, slots, microseconds, expected));
+
+    bool same = true;
+    for (const Result& r : results) {
+        if (!r.correct) {
+            std::fprintf(stderr, "%s: the consumer saw wrong or missing frames\n", r.mode);
+            same = false;
+        }
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"output\",\n  \"frames\": %llu,\n  \"slots\": %zu,\n"
+            "  \"consumer_us\": %u,\n  \"correct\": %s,\n  \"inline_frames_per_second\": %.1f,\n  \"results\": [\n",
+            (unsigned long long)frames, slots, microseconds, same ? "true" : "false", frames / inline_seconds);
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"mode\": \"%s\", \"seconds\": %.6f, \"frames_per_second\": %.1f, "
+                "\"delivered\": %llu, \"dropped\": %llu }%s\n", r.mode, r.seconds, frames / r.seconds,
+                (unsigned long long)r.delivered, (unsigned long long)r.dropped, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("emulation with an inline consumer (no extra work): %.1f frames/s\n", frames / inline_seconds);
+    std::printf("%-6s %10s %10s %10s\n", "mode", "frames/s", "delivered", "dropped");
+    for (const Result& r : results)
+        std::printf("%-6s %10.1f %10llu %10llu\n", r.mode, frames / r.seconds, (unsigned long long)r.delivered,
+            (unsigned long long)r.dropped);
+    std::printf("%s\n", same ? "consumer saw the right frames in place" : "MISMATCH");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+// PPU pixel kernels: frames per second of the scanline renderer through each
+// supported path (scalar, SSE2, AVX2), and a golden-image check that every
+// path renders bit-identical frames.
+//
+//   bench_ppu_render [-f frames] [-r repeats] [--json]
+//
+// The PPU runs on its own, without a CPU, over a pseudo-random CHR ROM,
+// nametables and palette. Every frame moves 64 sprites and changes the
+// scroll, and the scenes cycle through 8x8/8x16 sprites, both pattern table
+// layouts, left column clipping, greyscale and background/sprite only
+// rendering. The frames of each path, and their sprite 0 hit and overflow
+// flags, are compared to the scalar ones frame by frame, and for the default
+// 1200 frames the hash of the scalar frames must be the recorded golden one;
+// any difference makes the exit status 1. A change meant to alter the frames
+// must record the new golden hash.
+
+#include "mapper.hpp"
+#include "ppu.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const uint64_t DOTS_PER_FRAME = PPU::DOTS_PER_LINE * PPU::LINES;
+
+    struct Random {
+        uint32_t state;
+        byte next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return static_cast<byte>(state >> 7);
+        }
+    };
+
+    // NROM-128 iNES file with noisy CHR
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        byte* chr = rom.chr();
+        Random random = { 0x2C02 };
+        // a third of the pixels transparent, like real tiles
+        for (size_t i = 0; i < rom.chrSize(); i++)
+            chr[i] = random.next() & random.next() ? random.next() | 0x81 : random.next();
+        return rom.file();
+    }
+
+    void setAddress(PPU& ppu, h_word address) {
+        ppu.readRegister(0x2002);
+        ppu.writeRegister(0x2006, address >> 8);
+        ppu.writeRegister(0x2006, address & 0xFF);
+    }
+
+    void fillMemory(PPU& ppu) {
+        Random random = { 0x4014 };
+        setAddress(ppu, 0x2000);
+        for (size_t i = 0; i < 0x1000; i++)
+            ppu.writeRegister(0x2007, random.next());
+        setAddress(ppu, 0x3F00);
+        for (size_t i = 0; i < 32; i++)
+            ppu.writeRegister(0x2007, random.next() & 0x3F);
+    }
+
+    // per frame registers, OAM and scroll
+    void setScene(PPU& ppu, uint64_t frame) {
+        static const byte MASKS[] = { 0x1E, 0x18, 0x1E, 0x08, 0x1F, 0x1A, 0x10, 0x1C };
+        byte scene = static_cast<byte>(frame / 8);
+        ppu.writeRegister(0x2000, ((scene & 0x01) ? 0x20 : 0x00) | ((scene & 0x02) ? 0x08 : 0x10) | (frame & 0x03));
+        ppu.writeRegister(0x2001, MASKS[scene % 8]);
+
+        byte oam[256];
+        Random random = { static_cast<uint32_t>(0x1000 + scene) };
+        for (size_t i = 0; i < 64; i++) {
+            oam[i * 4 + 0] = static_cast<byte>(random.next() % 232 + frame);
+            oam[i * 4 + 1] = random.next();
+            oam[i * 4 + 2] = random.next() & 0xE3;
+            oam[i * 4 + 3] = static_cast<byte>(random.next() + frame * 3);
+        }
+        ppu.writeRegister(0x2003, 0);
+        ppu.writeOam(oam);
+
+        ppu.readRegister(0x2002);
+        ppu.writeRegister(0x2005, static_cast<byte>(frame * 5));
+        ppu.writeRegister(0x2005, static_cast<byte>(frame * 3 % 240));
+    }
+
+    struct Result {
+        RenderPath path;
+        uint64_t frames;
+        double seconds;
+        std::vector<uint64_t> hashes;   // of every frame
+    };
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, RenderPath path, uint64_t frames) {
+        auto mapper = Mapper::create(rom);
+        PPU ppu;
+        ppu.setCartridge(mapper.get());
+        ppu.setRenderPath(path);
+        fillMemory(ppu);
+
+        Result result = { path, frames, 0.0, {} };
+        result.hashes.reserve(frames);
+        for (uint64_t f = 0; f < frames; f++) {
+            setScene(ppu, f);
+            // the scene takes effect with the pre-render line
+            uint64_t next = (ppu.dots() / DOTS_PER_FRAME + 1) * DOTS_PER_FRAME;
+            auto start = Clock::now();
+            ppu.runTo(next + DOTS_PER_FRAME - PPU::DOTS_PER_LINE);
+            result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            // with the sprite 0 hit and overflow flags of the frame
+            uint64_t hash = frameHash(ppu.frame());
+            result.hashes.push_back((hash ^ (ppu.readRegister(0x2002, true) & 0x60)) * 0x100000001B3ull);
+        }
+        return result;
+    }
+
+    // hash of the scalar frames of the default run
+    const uint64_t GOLDEN_FRAMES = 1200;
+    const uint64_t GOLDEN = 0xE87BFC911BB9FE25ull;
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_ppu_render [-f frames] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 1200;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "ppu_render");
+    std::vector<Result> results;
+    for (RenderPath path : { RenderPath::Scalar, RenderPath::Sse2, RenderPath::Avx2 }) {
+        if (!renderPathSupported(path))
+            continue;
+        Result best = measure(rom, path, frames);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(rom, path, frames);
+            if (again.seconds < best.seconds)
+                best = std::move(again);
+        }
+        results.push_back(std::move(best));
+    }
+
+    // the scalar frames are the golden images
+    bool same = true;
+    for (const Result& r : results) {
+        for (uint64_t f = 0; f < frames; f++) {
+            if (r.hashes[f] != results[0].hashes[f]) {
+                std::fprintf(stderr, "%s: frame %llu differs from scalar\n", renderPathName(r.path), (unsigned long long)f);
+                same = false;
+                break;
+            }
+        }
+    }
+    uint64_t golden = fnv1a(results[0].hashes.data(), frames * sizeof(uint64_t));
+    if (frames == GOLDEN_FRAMES && golden != GOLDEN) {
+        std::fprintf(stderr, "scalar: golden %016llx, expected %016llx\n", (unsigned long long)golden,
+            (unsigned long long)GOLDEN);
+        same = false;
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"ppu_render\",\n  \"frames\": %llu,\n  \"repeats\": %u,\n"
+            "  \"golden\": \"%016llx\",\n  \"identical\": %s,\n  \"results\": [\n",
+            (unsigned long long)frames, repeats, (unsigned long long)golden, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"path\": \"%s\", \"seconds\": %.6f, \"frames_per_second\": %.1f }%s\n",
+                renderPathName(r.path), r.seconds, r.frames / r.seconds, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%-8s %10s %9s\n", "path", "frames/s", "speedup");
+    for (const Result& r : results)
+        std::printf("%-8s %10.1f %8.2fx\n", renderPathName(r.path), r.frames / r.seconds, results[0].seconds / r.seconds);
+    std::printf("golden %016llx over %llu frames: %s\n", (unsigned long long)golden, (unsigned long long)frames,
+        same ? "every path identical" : "MISMATCH");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+// PPU scheduling: frames per second of the lazy (catch-up) PPU against the
+// lockstep reference, and a check that both end up in the same state.
+//
+//   bench_ppu_sync [-f frames] [-r repeats] [--json]
+//
+// The program draws a scrolled background with 64 sprites, moves sprite 0 and
+// the scroll in its NMI handler (with an OAM DMA) and polls the sprite 0 hit
+// to split the screen, so vblank NMIs, sprite 0 and mid-frame register writes
+// are all exercised. Every mode runs `frames` frames `repeats` times and
+// keeps the fastest run; the final frame and the serialized state of each mode
+// must be identical to the lockstep ones, otherwise the exit status is 1.
+
+#include "bus.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const uint64_t CYCLES_PER_FRAME = 29781;    // NTSC, 341 * 262 / 3
+
+    const std::vector<byte> RESET = {
+        0x78, 0xD8,             //        SEI / CLD
+        0xA2, 0xFF, 0x9A,       //        LDX #$FF / TXS
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x00, 0x20,       //        STA $2000
+        0x8D, 0x01, 0x20,       //        STA $2001
+        0x2C, 0x02, 0x20,       // wait1: BIT $2002
+        0x10, 0xFB,             //        BPL wait1
+        0x2C, 0x02, 0x20,       // wait2: BIT $2002
+        0x10, 0xFB,             //        BPL wait2
+        0xA9, 0x3F,             //        LDA #$3F
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA2, 0x00,             //        LDX #0
+        0xBD, 0x00, 0x82,       // pal:   LDA palette,X
+        0x8D, 0x07, 0x20,       //        STA $2007
+        0xE8,                   //        INX
+        0xE0, 0x20,             //        CPX #32
+        0xD0, 0xF5,             //        BNE pal
+        0xA9, 0x20,             //        LDA #$20
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA0, 0x08,             //        LDY #8
+        0xA2, 0x00,             //        LDX #0
+        0x8A,                   // nt:    TXA
+        0x84, 0x00,             //        STY $00
+        0x45, 0x00,             //        EOR $00
+        0x8D, 0x07, 0x20,       //        STA $2007
+        0xE8,                   //        INX
+        0xD0, 0xF5,             //        BNE nt
+        0x88,                   //        DEY
+        0xD0, 0xF2,             //        BNE nt
+        0xA2, 0x00,             //        LDX #0
+        0xBD, 0x00, 0x83,       // oam:   LDA sprites,X
+        0x9D, 0x00, 0x02,       //        STA $0200,X
+        0xE8,                   //        INX
+        0xD0, 0xF7,             //        BNE oam
+        0xA9, 0x88,             //        LDA #$88
+        0x8D, 0x00, 0x20,       //        STA $2000     NMI on, sprites at $1000
+        0xA9, 0x1E,             //        LDA #$1E
+        0x8D, 0x01, 0x20,       //        STA $2001     background and sprites
+        0x2C, 0x02, 0x20,       // main:  BIT $2002
+        0x70, 0xFB,             //        BVS main      wait for the hit flag to clear
+        0x2C, 0x02, 0x20,       // hit:   BIT $2002
+        0x50, 0xFB,             //        BVC hit       then for the next hit
+        0xA5, 0x01,             //        LDA $01
+        0x8D, 0x05, 0x20,       //        STA $2005     split
+        0x8D, 0x05, 0x20,       //        STA $2005
+        0xA2, 0x40,             //        LDX #$40
+        0x69, 0x03,             // busy:  ADC #3
+        0xCA,                   //        DEX
+        0xD0, 0xFB,             //        BNE busy
+        0x4C, 0x5F, 0x80,       //        JMP main
+    };
+
+    const std::vector<byte> NMI = {
+        0x48,                   // PHA
+        0xA9, 0x02,             // LDA #2
+        0x8D, 0x14, 0x40,       // STA $4014    OAM DMA from $0200
+        0xE6, 0x01,             // INC $01      frame counter
+        0xEE, 0x03, 0x02,       // INC $0203    sprite 0 X
+        0xA5, 0x01,             // LDA $01
+        0x8D, 0x05, 0x20,       // STA $2005
+        0xA9, 0x00,             // LDA #0
+        0x8D, 0x05, 0x20,       // STA $2005
+        0xA9, 0x88,             // LDA #$88
+        0x8D, 0x00, 0x20,       // STA $2000
+        0x68,                   // PLA
+        0x40,                   // RTI
+    };
+
+    // NROM-128 iNES file
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, RESET);
+        rom.load(0x8100, NMI);
+        byte* palette = rom.prg(0x8200);
+        for (size_t i = 0; i < 32; i++)
+            palette[i] = static_cast<byte>((i & 0x03) ? (i * 0x15) & 0x3F : 0x0F);
+        for (size_t i = 0; i < 64; i++) {
+            byte* sprite = rom.prg(0x8300) + i * 4;
+            sprite[0] = static_cast<byte>(i ? 20 + i * 3 : 30);
+            sprite[1] = static_cast<byte>(i ? i & 0x07 : 1);
+            sprite[2] = static_cast<byte>(i ? (i & 0x03) | ((i & 0x04) << 4) | ((i & 0x08) << 2) : 0);
+            sprite[3] = static_cast<byte>(i ? i * 4 : 40);
+        }
+        rom.setVectors(0x8100, 0x8000, 0x8000);
+
+        // noisy tiles, except a solid sprite 0 so that it hits
+        rom.noisyChr();
+        std::memset(rom.chr() + 0x1010, 0xFF, 16);
+        return rom.file();
+    }
+
+    enum class Mode { Lockstep, Lazy, LazyBlockCache };
+
+    const char* modeName(Mode mode) {
+        switch (mode) {
+        case Mode::Lockstep: return "lockstep";
+        case Mode::Lazy: return "lazy";
+        default: return "lazy_block_cache";
+        }
+    }
+
+    struct Result {
+        const char* mode;
+        uint64_t frames;
+        uint64_t cycles;
+        double seconds;
+        uint64_t frame_hash;
+        std::vector<byte> state;
+    };
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, Mode mode, uint64_t frames) {
+        Bus bus;
+        bus.insertCartridge(rom);
+        bus.reset();
+        bus.setLockstep(mode == Mode::Lockstep);
+        bus.getCpu().enableBlockCache(mode == Mode::LazyBlockCache);
+
+        uint64_t cycles = 0;
+        auto start = Clock::now();
+        for (uint64_t f = 0; f < frames; f++)
+            cycles += bus.run(CYCLES_PER_FRAME);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        Result result = { modeName(mode), bus.getPpu().frameCount(), cycles, seconds, 0, {} };
+        result.frame_hash = frameHash(bus.getPpu().frame());
+        result.state.resize(sizeof(SaveState));
+        bus.serialize(result.state.data(), result.state.size());
+        return result;
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_ppu_sync [-f frames] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "ppu_sync");
+    std::vector<Result> results;
+    for (Mode mode : { Mode::Lockstep, Mode::Lazy, Mode::LazyBlockCache }) {
+        Result best = measure(rom, mode, frames);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(rom, mode, frames);
+            if (again.seconds < best.seconds)
+                best = std::move(again);
+        }
+        results.push_back(std::move(best));
+    }
+
+    // lockstep is the reference
+    bool same = true;
+    for (const Result& r : results) {
+        if (r.frame_hash != results[0].frame_hash || r.state != results[0].state) {
+            std::fprintf(stderr, "%s: state differs from lockstep\n", r.mode);
+            same = false;
+        }
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"ppu_sync\",\n  \"frames\": %llu,\n  \"repeats\": %u,\n  \"identical\": %s,\n"
+            "  \"results\": [\n", (unsigned long long)frames, repeats, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"mode\": \"%s\", \"frames\": %llu, \"cycles\": %llu, \"seconds\": %.6f, "
+                "\"frames_per_second\": %.1f, \"frame_hash\": \"%016llx\" }%s\n",
+                r.mode, (unsigned long long)r.frames, (unsigned long long)r.cycles, r.seconds,
+                r.frames / r.seconds, (unsigned long long)r.frame_hash, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%-17s %8s %12s %10s %9s  %s\n", "mode", "frames", "cycles", "frames/s", "speedup", "frame hash");
+    for (const Result& r : results)
+        std::printf("%-17s %8llu %12llu %10.1f %8.2fx  %016llx\n", r.mode, (unsigned long long)r.frames,
+            (unsigned long long)r.cycles, r.frames / r.seconds, results[0].seconds / r.seconds,
+            (unsigned long long)r.frame_hash);
+    std::printf("%s\n", same ? "identical to lockstep" : "MISMATCH");
+    return same ? 0 : 1;
+}
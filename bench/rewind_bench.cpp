@@ -0,0 +1,245 @@
+// Rewind: cost of a checkpoint every frame under a fixed history budget, and
+// a check that rewinding restores exactly the state a straight run had.
+//
+//   bench_rewind [-f frames] [-n steps] [-b bytes] [-r repeats] [--json]
+//
+// The program reads the first controller in a loop and fills one of four RAM
+// pages with what it read, 32 bytes after each button, so every frame dirties
+// a few pages and frames of a fixed cycle count almost always stop it half way
+// through the buttons, with the controller shift register mid-read.
+// Each run checkpoints after every frame into a RewindBuffer of `-b` bytes,
+// which wraps and drops the oldest checkpoints long before the end, then
+// rewinds 1 and `-n` frames. The state must hash like the straight run's at
+// that frame, and again at the last frame after running the same input
+// forward. Any mismatch, or a history using more than its budget, makes the
+// exit status 1.
+
+#include "bus.hpp"
+#include "rewind_buffer.hpp"
+#include "bench_rom.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const uint64_t CYCLES_PER_FRAME = 29781;    // NTSC, 341 * 262 / 3
+
+    const std::vector<byte> PROGRAM = {
+        0x78,                   //        SEI
+        0xD8,                   //        CLD
+        0xA2, 0xFF,             //        LDX #$FF
+        0x9A,                   //        TXS
+        0xA9, 0x01,             // loop:  LDA #1
+        0x8D, 0x16, 0x40,       //        STA $4016     strobe
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x16, 0x40,       //        STA $4016
+        0xE6, 0x00,             //        INC $00
+        0xA5, 0x00,             //        LDA $00
+        0x29, 0x03,             //        AND #3
+        0x09, 0x04,             //        ORA #4
+        0x85, 0x03,             //        STA $03       one of $0400-$07FF
+        0xA9, 0x00,             //        LDA #0
+        0x85, 0x02,             //        STA $02
+        0xA8,                   //        TAY
+        0xA2, 0x08,             //        LDX #8
+        0xAD, 0x16, 0x40,       // read:  LDA $4016
+        0x4A,                   //        LSR A
+        0x26, 0x01,             //        ROL $01       buttons, A in bit 7
+        0xA5, 0x01,             // fill:  LDA $01
+        0x65, 0x00,             //        ADC $00
+        0x91, 0x02,             //        STA ($02),Y
+        0xC8,                   //        INY
+        0x98,                   //        TYA
+        0x29, 0x1F,             //        AND #$1F
+        0xD0, 0xF4,             //        BNE fill      32 bytes per button
+        0xCA,                   //        DEX
+        0xD0, 0xEB,             //        BNE read
+        0x4C, 0x05, 0x80,       //        JMP loop
+    };
+
+    // NROM-128 iNES file
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, PROGRAM);
+        rom.setVectors(0x8000, 0x8000, 0x8000);
+        return rom.file();
+    }
+
+    // buttons held on each frame, a new combination every 1 to 8 frames
+    std::vector<byte> buildInput(uint64_t frames) {
+        std::vector<byte> input(frames);
+        uint32_t seed = 0x4016;
+        byte buttons = 0;
+        for (uint64_t f = 0; f < frames; f++) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % 5 == 0)
+                buttons = static_cast<byte>(seed >> 24);
+            input[f] = buttons;
+        }
+        return input;
+    }
+
+    void boot(Bus& bus, std::shared_ptr<const CartridgeImage> rom) {
+        bus.insertCartridge(rom);
+        bus.reset();
+    }
+
+    void runFrame(Bus& bus, byte buttons) {
+        bus.setController(0, buttons);
+        bus.run(CYCLES_PER_FRAME);
+    }
+
+    // state hash after each frame of the run without rewind
+    std::vector<uint64_t> reference(std::shared_ptr<const CartridgeImage> rom, const std::vector<byte>& input) {
+        Bus bus;
+        boot(bus, rom);
+        std::vector<uint64_t> hashes;
+        hashes.reserve(input.size());
+        for (byte buttons : input) {
+            runFrame(bus, buttons);
+            hashes.push_back(bus.stateHash());
+        }
+        return hashes;
+    }
+
+    struct Result {
+        size_t steps;
+        double checkpoint_seconds;  // every checkpoint of the run
+        double checkpoint_max;      // the slowest one
+        double rewind_seconds;
+        uint64_t undo_bytes;        // undo entries written, evicted ones included
+        size_t depth;               // checkpoints left when rewinding
+        size_t peak_used;
+        bool restored;              // state hash of the frame rewound to
+        bool replayed;              // state hash of the last frame, run again
+    };
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, const std::vector<byte>& input,
+        const std::vector<uint64_t>& expected, size_t budget, size_t steps) {
+        Bus bus;
+        boot(bus, rom);
+        RewindBuffer history(bus, budget);
+
+        Result result = { steps, 0.0, 0.0, 0.0, 0, 0, 0, false, false };
+        for (byte buttons : input) {
+            runFrame(bus, buttons);
+            auto start = Clock::now();
+            history.checkpoint();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            result.checkpoint_seconds += seconds;
+            result.checkpoint_max = std::max(result.checkpoint_max, seconds);
+            result.undo_bytes += history.newestBytes();
+            result.peak_used = std::max(result.peak_used, history.usedBytes());
+        }
+        result.depth = history.depth();
+
+        auto start = Clock::now();
+        bool ok = history.rewind(steps);
+        result.rewind_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (!ok)
+            return result;
+
+        size_t frame = input.size() - 1 - steps;
+        result.restored = bus.stateHash() == expected[frame];
+        for (size_t f = frame + 1; f < input.size(); f++)
+            runFrame(bus, input[f]);
+        result.replayed = bus.stateHash() == expected.back();
+        return result;
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_rewind [-f frames] [-n steps] [-b bytes] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    size_t steps = 60;
+    size_t budget = 256 * 1024;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            steps = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-b") && i + 1 < argc)
+            budget = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || steps == 0 || steps >= frames || budget == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "rewind");
+    std::vector<byte> input = buildInput(frames);
+    std::vector<uint64_t> expected = reference(rom, input);
+
+    std::vector<Result> results;
+    for (size_t n : { size_t(1), steps }) {
+        Result best = measure(rom, input, expected, budget, n);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(rom, input, expected, budget, n);
+            if (again.checkpoint_seconds < best.checkpoint_seconds)
+                best = again;
+        }
+        results.push_back(best);
+    }
+
+    bool same = true;
+    for (const Result& r : results) {
+        if (r.depth <= r.steps) {
+            std::fprintf(stderr, "rewind %zu: only %zu checkpoints fit in %zu bytes\n", r.steps, r.depth, budget);
+            same = false;
+        } else if (!r.restored || !r.replayed) {
+            std::fprintf(stderr, "rewind %zu: state differs from the straight run %s\n", r.steps,
+                r.restored ? "after running forward again" : "at the frame rewound to");
+            same = false;
+        }
+        if (r.peak_used > budget) {
+            std::fprintf(stderr, "rewind %zu: %zu bytes of history over a budget of %zu\n", r.steps, r.peak_used, budget);
+            same = false;
+        }
+    }
+
+    auto perCheckpoint = [&](const Result& r) { return r.checkpoint_seconds * 1e6 / frames; };
+    auto bytesPerCheckpoint = [&](const Result& r) { return static_cast<double>(r.undo_bytes) / frames; };
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"rewind\",\n  \"frames\": %llu,\n  \"budget\": %zu,\n  \"repeats\": %u,\n"
+            "  \"identical\": %s,\n  \"results\": [\n",
+            (unsigned long long)frames, budget, repeats, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"steps\": %zu, \"checkpoint_us\": %.3f, \"checkpoint_max_us\": %.3f, "
+                "\"bytes_per_checkpoint\": %.1f, \"depth\": %zu, \"peak_bytes\": %zu, \"rewind_us\": %.3f }%s\n",
+                r.steps, perCheckpoint(r), r.checkpoint_max * 1e6, bytesPerCheckpoint(r), r.depth, r.peak_used,
+                r.rewind_seconds * 1e6, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%-6s %14s %10s %12s %7s %12s %11s\n", "steps", "checkpoint us", "max us", "bytes/ckpt",
+        "depth", "peak bytes", "rewind us");
+    for (const Result& r : results)
+        std::printf("%-6zu %14.3f %10.3f %12.1f %7zu %12zu %11.3f\n", r.steps, perCheckpoint(r),
+            r.checkpoint_max * 1e6, bytesPerCheckpoint(r), r.depth, r.peak_used, r.rewind_seconds * 1e6);
+    std::printf("%s\n", same ? "rewound states identical to the straight run" : "MISMATCH");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// Run-ahead: time per shown frame with run-ahead off, at 1 and at 2 frames
+// (or up to -a), and a check that run-ahead changes what is shown only.
+//
+//   bench_runahead [-f frames] [-a frames] [-r repeats] [--json]
+//
+// The program reads the first controller every frame and scrolls the screen
+// by the value of the buttons held, which change every few frames. With
+// run-ahead N the state after the run must be the one of a run without it,
+// and a frame shown at step t must be frame t + N of that run whenever the
+// input stays the same over those N frames. Any mismatch makes the exit
+// status 1.
+
+#include "console.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const std::vector<byte> PROGRAM = {
+        0x78,                   //        SEI
+        0xA9, 0x3F,             //        LDA #$3F
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA2, 0x00,             //        LDX #0
+        0x8A,                   // pal:   TXA
+        0x8D, 0x07, 0x20,       //        STA $2007
+        0xE8,                   //        INX
+        0xE0, 0x20,             //        CPX #32
+        0xD0, 0xF7,             //        BNE pal
+        0xA9, 0x20,             //        LDA #$20
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x06, 0x20,       //        STA $2006
+        0xA0, 0x04,             //        LDY #4
+        0xA2, 0x00,             //        LDX #0
+        0x8E, 0x07, 0x20,       // nt:    STX $2007
+        0xE8,                   //        INX
+        0xD0, 0xFA,             //        BNE nt
+        0x88,                   //        DEY
+        0xD0, 0xF7,             //        BNE nt
+        0xA9, 0x1E,             //        LDA #$1E
+        0x8D, 0x01, 0x20,       //        STA $2001     background and sprites
+        0x2C, 0x02, 0x20,       // wait:  BIT $2002
+        0x10, 0xFB,             //        BPL wait
+        0xA9, 0x01,             //        LDA #1
+        0x8D, 0x16, 0x40,       //        STA $4016     strobe
+        0xA9, 0x00,             //        LDA #0
+        0x8D, 0x16, 0x40,       //        STA $4016
+        0xA2, 0x08,             //        LDX #8
+        0xAD, 0x16, 0x40,       // read:  LDA $4016
+        0x4A,                   //        LSR A
+        0x26, 0x01,             //        ROL $01       buttons, A in bit 7
+        0xCA,                   //        DEX
+        0xD0, 0xF7,             //        BNE read
+        0xA5, 0x00,             //        LDA $00
+        0x18,                   //        CLC
+        0x65, 0x01,             //        ADC $01
+        0x85, 0x00,             //        STA $00
+        0x8D, 0x05, 0x20,       //        STA $2005
+        0x8D, 0x05, 0x20,       //        STA $2005
+        0x4C, 0x32, 0x80,       //        JMP wait
+    };
+
+    // NROM-128 iNES file with noisy CHR
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, PROGRAM);
+        rom.setVectors(0x8000, 0x8000, 0x8000);
+        rom.noisyChr();
+        return rom.file();
+    }
+
+    // buttons held on each frame, a new combination every 1 to 8 frames
+    std::vector<byte> buildInput(uint64_t frames) {
+        std::vector<byte> input(frames);
+        uint32_t seed = 0x4016;
+        byte buttons = 0;
+        for (uint64_t f = 0; f < frames; f++) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % 5 == 0)
+                buttons = static_cast<byte>(seed >> 24);
+            input[f] = buttons;
+        }
+        return input;
+    }
+
+    struct Result {
+        unsigned ahead;
+        double seconds;
+        std::vector<uint64_t> shown;    // hash of the frame shown at each step
+        std::vector<byte> state;
+    };
+
+    Result measure(std::shared_ptr<const CartridgeImage> rom, unsigned ahead, const std::vector<byte>& input) {
+        auto console = std::make_unique<Console>();
+        Bus& bus = console->getBus();
+        bus.insertCartridge(rom);
+        bus.reset();
+        console->setRunAhead(ahead);
+
+        Result result = { ahead, 0.0, {}, {} };
+        result.shown.reserve(input.size());
+        for (byte buttons : input) {
+            bus.setController(0, buttons);
+            auto start = Clock::now();
+            console->runFrames(1);
+            result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            // the consumer, inline
+            while (const VideoFrame* frame = console->video().front()) {
+                result.shown.push_back(frameHash(frame->pixels.data()));
+                console->video().release();
+            }
+        }
+        result.state.resize(sizeof(SaveState));
+        bus.serialize(result.state.data(), result.state.size());
+        return result;
+    }
+
+    // frames shown ahead must be the ones the run without run-ahead got to
+    bool check(const Result& r, const Result& plain, const std::vector<byte>& input) {
+        if (r.state != plain.state || r.shown.size() != input.size())
+            return false;
+        for (uint64_t t = 0; t + r.ahead < input.size(); t++) {
+            bool steady = true;
+            for (uint64_t f = t + 1; f <= t + r.ahead; f++)
+                steady = steady && input[f] == input[t];
+            if (steady && r.shown[t] != plain.shown[t + r.ahead])
+                return false;
+        }
+        return true;
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_runahead [-f frames] [-a frames] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    unsigned max_ahead = 2;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-a") && i + 1 < argc)
+            max_ahead = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (frames == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    auto rom = CartridgeImage::fromMemory(buildRom(), "runahead");
+    std::vector<byte> input = buildInput(frames);
+    std::vector<Result> results;
+    for (unsigned ahead = 0; ahead <= max_ahead; ahead++) {
+        Result best = measure(rom, ahead, input);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(rom, ahead, input);
+            if (again.seconds < best.seconds)
+                best = std::move(again);
+        }
+        results.push_back(std::move(best));
+    }
+
+    bool same = true;
+    for (const Result& r : results) {
+        if (!check(r, results[0], input)) {
+            std::fprintf(stderr, "run-ahead %u: frames or state differ from the run without it\n", r.ahead);
+            same = false;
+        }
+    }
+
+    // time per shown frame, and what run-ahead adds to it
+    auto perFrame = [&](const Result& r) { return r.seconds * 1e6 / frames; };
+    double base = perFrame(results[0]);
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"runahead\",\n  \"frames\": %llu,\n  \"repeats\": %u,\n"
+            "  \"identical\": %s,\n  \"results\": [\n", (unsigned long long)frames, repeats, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"run_ahead\": %u, \"us_per_frame\": %.2f, \"overhead_us\": %.2f, \"ratio\": %.3f }%s\n",
+                r.ahead, perFrame(r), perFrame(r) - base, perFrame(r) / base, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("%-9s %12s %12s %8s\n", "run-ahead", "us/frame", "overhead us", "ratio");
+    for (const Result& r : results)
+        std::printf("%-9u %12.2f %12.2f %7.2fx\n", r.ahead, perFrame(r), perFrame(r) - base, perFrame(r) / base);
+    std::printf("%s\n", same ? "same state and frames as without run-ahead" : "MISMATCH");
+    return same ? 0 : 1;
+}
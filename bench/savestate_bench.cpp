@@ -0,0 +1,165 @@
+// Save-state latency: snapshot and restore of the whole system into a
+// preallocated ring of buffers, as rewind and search-based testing do.
+//
+//   bench_savestate [-n iterations] [-r repeats] [--json]
+//
+// The system runs a looping program from a cartridge, so the snapshots in the
+// ring differ from each other. Each operation runs `iterations` times
+// `repeats` times and keeps the fastest run. The state restored last must
+// hash like the system did when it was saved, or the exit status is 1.
+
+#include "bus.hpp"
+#include "bench_rom.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const size_t RING = 1024;
+
+    const std::vector<byte> PROGRAM = {
+        0x78,                   //        SEI
+        0xE6, 0x10,             // loop:  INC $10
+        0x4C, 0x01, 0x80,       //        JMP loop
+    };
+
+    // NROM-128 iNES file
+    std::vector<byte> buildRom() {
+        SyntheticRom rom;
+        rom.load(0x8000, PROGRAM);
+        rom.setVectors(0x8000, 0x8000, 0x8000);
+        return rom.file();
+    }
+
+    enum class Operation { Snapshot, Restore, Serialize, Deserialize };
+
+    const char* operationName(Operation operation) {
+        switch (operation) {
+        case Operation::Snapshot: return "snapshot";
+        case Operation::Restore: return "restore";
+        case Operation::Serialize: return "serialize";
+        default: return "deserialize";
+        }
+    }
+
+    struct Result {
+        const char* operation;
+        double nanoseconds;     // per call
+        bool ok;                // every restore accepted
+    };
+
+    // restores read the prepared states, saves go to their own slots
+    struct Ring {
+        std::vector<SaveState> states = std::vector<SaveState>(RING);
+        std::vector<byte> buffer = std::vector<byte>(RING * sizeof(SaveState));
+        std::vector<uint64_t> hashes = std::vector<uint64_t>(RING);
+        std::vector<SaveState> saved = std::vector<SaveState>(RING);
+        std::vector<byte> written = std::vector<byte>(RING * sizeof(SaveState));
+    };
+
+    // one timed run over the ring; the system keeps the state restored last
+    Result measure(Bus& bus, Ring& ring, Operation operation, size_t iterations) {
+        bool ok = true;
+        auto start = Clock::now();
+        switch (operation) {
+        case Operation::Snapshot:
+            for (size_t i = 0; i < iterations; i++)
+                bus.saveState(ring.saved[i % RING]);
+            break;
+        case Operation::Restore:
+            for (size_t i = 0; i < iterations; i++)
+                ok &= bus.loadState(ring.states[i % RING]);
+            break;
+        case Operation::Serialize:
+            for (size_t i = 0; i < iterations; i++)
+                bus.serialize(&ring.written[(i % RING) * sizeof(SaveState)], sizeof(SaveState));
+            break;
+        case Operation::Deserialize:
+            for (size_t i = 0; i < iterations; i++)
+                ok &= bus.deserialize(&ring.buffer[(i % RING) * sizeof(SaveState)], sizeof(SaveState));
+            break;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return { operationName(operation), seconds * 1e9 / iterations, ok };
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: bench_savestate [-n iterations] [-r repeats] [--json]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = 1000000;
+    unsigned repeats = 3;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            iterations = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--json"))
+            json = true;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (iterations == 0 || repeats == 0) {
+        usage();
+        return 2;
+    }
+
+    Bus bus;
+    bus.insertCartridge(CartridgeImage::fromMemory(buildRom(), "savestate"));
+    bus.reset();
+
+    // warm up, and make every slot a different valid state
+    Ring ring;
+    for (size_t i = 0; i < RING; i++) {
+        bus.run(100);
+        bus.saveState(ring.states[i]);
+        bus.serialize(&ring.buffer[i * sizeof(SaveState)], sizeof(SaveState));
+        ring.hashes[i] = bus.stateHash();
+    }
+
+    std::vector<Result> results;
+    bool same = true;
+    for (Operation operation : { Operation::Snapshot, Operation::Restore, Operation::Serialize, Operation::Deserialize }) {
+        Result best = measure(bus, ring, operation, iterations);
+        for (unsigned r = 1; r < repeats; r++) {
+            Result again = measure(bus, ring, operation, iterations);
+            if (again.nanoseconds < best.nanoseconds)
+                best = again;
+            best.ok &= again.ok;
+        }
+        if (operation == Operation::Restore || operation == Operation::Deserialize)
+            best.ok &= bus.stateHash() == ring.hashes[(iterations - 1) % RING];
+        same &= best.ok;
+        results.push_back(best);
+    }
+
+    if (json) {
+        std::printf("{\n  \"benchmark\": \"savestate\",\n  \"state_bytes\": %zu,\n  \"iterations\": %llu,\n"
+            "  \"repeats\": %u,\n  \"identical\": %s,\n  \"results\": [\n",
+            sizeof(SaveState), (unsigned long long)iterations, repeats, same ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::printf("    { \"operation\": \"%s\", \"nanoseconds\": %.1f, \"per_second\": %.0f }%s\n",
+                r.operation, r.nanoseconds, 1e9 / r.nanoseconds, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+        return same ? 0 : 1;
+    }
+
+    std::printf("state size   %zu bytes\n", sizeof(SaveState));
+    for (const Result& r : results)
+        std::printf("%-12s %8.1f ns  %10.0f /s\n", r.operation, r.nanoseconds, 1e9 / r.nanoseconds);
+    std::printf("%s\n", same ? "restored states identical to the saved ones" : "MISMATCH");
+    return same ? 0 : 1;
+}
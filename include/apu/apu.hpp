@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "blip_buffer.hpp"
+#include "nes_common.hpp"
+#include "save_state.hpp"
+
+/**
+ * @class APU
+ * @brief 2A03 sound: two pulse channels, triangle, noise and delta
+ * modulation (DMC), run lazily by the bus.
+ *
+ * Like the PPU, the APU is not ticked along with the CPU. It keeps its own
+ * time (CPU cycles since power on) and runTo() catches it up when the CPU
+ * touches $4000-$4017, when one of its deadlines comes due (frame IRQ, DMC
+ * sample fetch) and at the end of each Bus::run(). Catching up splits the
+ * time at the frame counter steps and moves each channel from one timer
+ * clock to the next: a channel whose output cannot change (silent, halted,
+ * ultrasonic) jumps ahead in one go, the others tell the BlipBuffer about
+ * each change of their output level. Either way the channel state is the
+ * same, whatever the steps runTo() is called with and whether samples are
+ * made or not.
+ *
+ * Samples come out of the BlipBuffer at sampleRate(), 48kHz by default, as
+ * the linear approximation of the console's mixer. Nobody reading them only
+ * costs the oldest ones: the buffer keeps what came last.
+ */
+class APU {
+public:
+    static constexpr double CLOCK_RATE = 1789773.0;     // NTSC CPU cycles per second
+    static constexpr uint32_t SAMPLE_RATE = 48000;
+    static constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+    /**
+     * @brief Fetches a DMC sample byte from the CPU address space, halting
+     * the CPU for it.
+     */
+    using DmcReader = byte (*)(void* device, h_word address);
+
+    APU();
+
+    APU(const APU&) = delete;
+    APU& operator=(const APU&) = delete;
+
+    void setDmcReader(DmcReader reader, void* device);
+
+    /**
+     * @brief Output rate, drops the samples not read yet. Use
+     * setOutputEnabled() for no samples at all.
+     */
+    void setSampleRate(uint32_t rate);
+    uint32_t sampleRate() const { return blip.sampleRate(); }
+
+    /**
+     * @brief Stops making samples, for runs nobody listens to (run-ahead,
+     * replays). The channels go on exactly as if they were heard.
+     */
+    void setOutputEnabled(bool enabled);
+    bool outputEnabled() const { return output; }
+
+    /** @brief Reset line: silences every channel, the frame counter restarts. */
+    void reset();
+
+    /** @brief Catches up to `cycle` CPU cycles since power on. */
+    void runTo(uint64_t cycle);
+
+    /** @brief CPU cycles run since power on. */
+    uint64_t time() const { return clock; }
+
+    /** @brief CPU access to $4015, caught up already. Reading acknowledges the frame IRQ. */
+    byte readStatus(bool bReadOnly = false);
+
+    /** @brief CPU write to $4000-$4013, $4015 or $4017, caught up already. */
+    void writeRegister(h_word address, byte data);
+
+    /** @brief Frame counter or DMC IRQ raised and not acknowledged. */
+    bool irqPending() const { return frame_irq || dmc.irq; }
+
+    /**
+     * @brief First cycle the CPU could see something the APU does on its
+     * own: the frame IRQ, or a DMC fetch (which halts the CPU, and may
+     * raise the DMC IRQ).
+     *
+     * @return NO_EVENT if there is none coming.
+     */
+    uint64_t nextEvent() const;
+
+    /** @brief Samples made and not read yet. */
+    size_t samplesAvailable() const { return blip.available(); }
+
+    /**
+     * @brief Reads up to `max` samples, oldest first, nullptr to drop them.
+     *
+     * @return The number of samples read.
+     */
+    size_t readSamples(int16_t* out, size_t max) { return blip.read(out, max); }
+
+    void saveState(ApuState& state) const;
+    void loadState(const ApuState& state);
+
+private:
+    // a channel's register file as snapshots have it, plus the cycle of its
+    // next timer clock and the output level the BlipBuffer last heard of
+    struct Pulse : PulseState {
+        uint64_t next = 0;
+        int heard = 0;
+        bool second = false;    // pulse 2 sweeps down by one less
+    };
+    struct Triangle : TriangleState {
+        uint64_t next = 0;
+        int heard = 0;
+    };
+    struct Noise : NoiseState {
+        uint64_t next = 0;
+        int heard = 0;
+    };
+    struct Dmc : DmcState {
+        uint64_t next = 0;
+        int heard = 0;
+    };
+
+    Pulse pulse[2]{};
+    Triangle triangle{};
+    Noise noise{};
+    Dmc dmc{};
+
+    uint64_t clock = 0;
+    uint64_t frame_start = 0;   // cycle the frame counter sequence started on
+    byte frame_control = 0;
+    byte frame_step = 0;
+    bool frame_irq = false;
+    byte enabled = 0;
+
+    DmcReader dmc_reader = nullptr;
+    void* dmc_device = nullptr;
+
+    BlipBuffer blip;
+    bool output = true;
+    uint64_t block_start = 0;   // cycle the current BlipBuffer block started on
+
+    /** @brief Cycle of the next frame counter step. */
+    uint64_t nextFrameStep() const;
+    void clockFrameCounter();
+    void quarterFrame();
+    void halfFrame();
+
+    /** @brief Runs every channel's timer up to (not including) `end`. */
+    void runChannels(uint64_t end);
+    void runPulse(Pulse& p, uint64_t end);
+    void runTriangle(uint64_t end);
+    void runNoise(uint64_t end);
+    void runDmc(uint64_t end);
+
+    /** @brief DMC memory reader: refills the sample buffer if it is empty. */
+    void fetchSample();
+    void restartSample();
+
+    // output level of each channel, from its current state
+    int pulseLevel(const Pulse& p) const;
+    int triangleLevel() const;
+    int noiseLevel() const;
+
+    /** @brief Tells the BlipBuffer the output levels changed at `at`. */
+    void emit(int& heard, int level, int gain, uint64_t at);
+    void updateLevels(uint64_t at);
+
+    /** @brief Ends the BlipBuffer block at the current time. */
+    void endBlock();
+};
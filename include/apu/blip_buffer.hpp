@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "nes_common.hpp"
+
+/**
+ * @class BlipBuffer
+ * @brief Band-limited step synthesis: turns amplitude changes at clock times
+ * into samples at the output rate.
+ *
+ * A sound source does not produce samples, it tells the buffer how much its
+ * output steps by and when (addDelta(), in source clocks since the start of
+ * the current block). Each step is added as a windowed sinc impulse, picked
+ * among PHASES sub-sample positions, so the output is already band-limited
+ * to the sample rate: there is no per-clock sampling to filter afterwards
+ * and the cost follows the number of steps, not the clock rate. Reading
+ * integrates the impulses back into a waveform through a slightly leaky
+ * integrator, which also removes DC like the console's output stage does.
+ *
+ * endBlock() makes the samples of a block available; the impulses of its
+ * last steps spill over into the next block, which the buffer keeps.
+ */
+class BlipBuffer {
+public:
+    static constexpr unsigned KERNEL_WIDTH = 16;    // samples an impulse covers
+    static constexpr unsigned PHASE_BITS = 6;
+    static constexpr unsigned PHASES = 1u << PHASE_BITS;
+    static constexpr unsigned KERNEL_BITS = 14;     // impulses sum to 1 << KERNEL_BITS
+
+    /** @param capacity Samples the buffer can hold before they are read. */
+    explicit BlipBuffer(size_t capacity = 4096);
+
+    /** @brief Source clocks and output samples per second, clears the buffer. */
+    void setRates(double clock_rate, uint32_t sample_rate);
+    uint32_t sampleRate() const { return rate; }
+
+    /** @brief Samples the buffer can hold. */
+    size_t capacity() const { return size; }
+
+    /**
+     * @brief Adds an output step of `delta` at `time` source clocks after
+     * the start of the current block.
+     */
+    void addDelta(uint32_t time, int32_t delta) {
+        uint64_t fixed = time * factor + offset;
+        int32_t* out = &buffer[fixed >> FRAC_BITS];
+        const int32_t* taps = kernel()[(fixed >> (FRAC_BITS - PHASE_BITS)) & (PHASES - 1)];
+        for (unsigned i = 0; i < KERNEL_WIDTH; i++)
+            out[i] += taps[i] * delta;
+    }
+
+    /**
+     * @brief addDelta() for sources that step faster than the output rate,
+     * like high-pitched noise: the step is spread over the two samples
+     * around it by linear interpolation instead of a windowed sinc. Cheaper
+     * but not band-limited, and centered at the same time as addDelta().
+     */
+    void addDeltaFast(uint32_t time, int32_t delta) {
+        uint64_t fixed = time * factor + offset;
+        int32_t* out = &buffer[(fixed >> FRAC_BITS) + KERNEL_WIDTH / 2 - 1];
+        int32_t late = static_cast<int32_t>((fixed >> (FRAC_BITS - KERNEL_BITS)) & ((1u << KERNEL_BITS) - 1));
+        out[0] += ((1 << KERNEL_BITS) - late) * delta;
+        out[1] += late * delta;
+    }
+
+    /**
+     * @brief Ends the current block `time` clocks after its start, making
+     * its samples available. The next block starts there.
+     */
+    void endBlock(uint32_t time) { offset += time * factor; }
+
+    /** @brief Source clocks a block can last without overflowing the buffer. */
+    uint32_t maxBlock() const;
+
+    /** @brief Samples available for reading. */
+    size_t available() const { return static_cast<size_t>(offset >> FRAC_BITS); }
+
+    /**
+     * @brief Reads up to `max` samples, oldest first, into `out`; nullptr
+     * drops them.
+     *
+     * @return The number of samples read.
+     */
+    size_t read(int16_t* out, size_t max);
+
+    /** @brief Drops every sample and step, the output goes back to silence. */
+    void clear();
+
+private:
+    static constexpr unsigned FRAC_BITS = 32;       // of `factor` and `offset`
+    static constexpr unsigned BASS_SHIFT = 7;       // integrator leak, 1 / 128 per sample
+
+    using Kernel = int32_t[PHASES][KERNEL_WIDTH];
+
+    std::vector<int32_t> buffer;    // impulses, one entry per output sample
+    size_t size;
+    uint32_t rate = 0;
+    uint64_t factor = 0;            // samples per clock
+    uint64_t offset = 0;            // start of the current block, in samples
+    int32_t integrator = 0;
+
+    /** @brief Impulse of each sub-sample phase, built on first use. */
+    static const Kernel& kernel();
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nes_common.hpp"
+
+/** @brief Nametable layout of the PPU address space. */
+enum class Mirroring : byte {
+    Horizontal,
+    Vertical,
+    SingleLow,      // every nametable is the first 1KB of VRAM
+    SingleHigh,     // every nametable is the second 1KB of VRAM
+    FourScreen,     // extra VRAM on the cartridge
+};
+
+/**
+ * @class CartridgeImage
+ * @brief Immutable contents of a ROM file, shared by every system running it.
+ *
+ * The file is memory mapped read-only and the PRG/CHR banks point straight
+ * into the mapping, so loading copies nothing and every instance of the same
+ * ROM (in this process or another) shares the page cache. Mutable state, bank
+ * registers and cartridge RAM, belongs to the Mapper of each system.
+ */
+class CartridgeImage {
+public:
+    /**
+     * @brief Maps a ROM file, either iNES/NES 2.0 or a raw PRG dump (NROM, up
+     * to 32KB in whole pages).
+     *
+     * @throws std::runtime_error if the file cannot be read or is malformed.
+     */
+    static std::shared_ptr<const CartridgeImage> load(const std::string& path);
+
+    /**
+     * @brief Same as load() on a file already in memory, kept by the image.
+     */
+    static std::shared_ptr<const CartridgeImage> fromMemory(std::vector<byte> file, const std::string& name);
+
+    ~CartridgeImage();
+
+    /**
+     * @brief FNV-1a of what the header says about the board (mapper,
+     * mirroring, battery, RAM sizes), the PRG and CHR ROM and the trainer:
+     * two images with the same hash run the same.
+     */
+    uint64_t hash() const;
+
+    CartridgeImage(const CartridgeImage&) = delete;
+    CartridgeImage& operator=(const CartridgeImage&) = delete;
+
+    std::string name;
+    uint16_t mapper = 0;        // iNES mapper number
+    byte submapper = 0;         // NES 2.0 only
+    bool nes2 = false;          // NES 2.0 header
+    bool battery = false;       // battery backed PRG-RAM
+    Mirroring mirroring = Mirroring::Horizontal;   // as soldered, mappers may change it
+
+    const byte* prg = nullptr;  // PRG ROM, inside the mapping
+    size_t prg_size = 0;
+    const byte* chr = nullptr;  // CHR ROM, nullptr when the board has CHR-RAM
+    size_t chr_size = 0;
+    const byte* trainer = nullptr;  // 512 bytes for $7000, if any
+
+    size_t prg_ram_size = 0;    // PRG-RAM and NVRAM, as declared by the header
+    size_t chr_ram_size = 0;
+
+private:
+    CartridgeImage() = default;
+
+    void parse(const byte* data, size_t size);
+
+    void* mapping = nullptr;    // mmap'ed file
+    size_t mapping_size = 0;
+    std::vector<byte> owned;    // file content when it is not mapped
+};
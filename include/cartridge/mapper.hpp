@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cartridge.hpp"
+#include "nes_common.hpp"
+#include "save_state.hpp"
+
+class MemoryMap;
+
+/**
+ * @class Mapper
+ * @brief Cartridge board of one system: bank registers and cartridge RAM.
+ *
+ * PRG banks are mapped as read-only windows of the CPU memory map pointing
+ * into the CartridgeImage, and register writes come back through a write
+ * handler over $8000-$FFFF; a bank switch only swaps page pointers. CHR is
+ * seen by the PPU as eight 1KB windows, switched the same way. CHR-RAM is
+ * dirty tracked by the memory map like any other RAM.
+ */
+class Mapper {
+public:
+    static constexpr size_t PRG_RAM_WINDOW = CART_RAM_SIZE;    // $6000-$7FFF
+    static constexpr size_t CHR_WINDOW = 0x400;
+
+    /**
+     * @brief Builds the board a ROM needs.
+     *
+     * @throws std::runtime_error if its mapper is not supported.
+     */
+    static std::unique_ptr<Mapper> create(std::shared_ptr<const CartridgeImage> image);
+
+    /** @brief True if create() knows the board with this iNES number. */
+    static bool supports(uint16_t mapper);
+
+    virtual ~Mapper();
+
+    Mapper(const Mapper&) = delete;
+    Mapper& operator=(const Mapper&) = delete;
+
+    /**
+     * @brief Maps PRG-RAM, the PRG banks and the registers into `memory`,
+     * which must outlive the mapper.
+     */
+    void connect(MemoryMap& memory);
+
+    /**
+     * @brief Register write on $8000-$FFFF, for whoever takes the writes
+     * over from the handler connect() installs.
+     */
+    void write(h_word address, byte data) { writeRegister(address, data); }
+
+    /** @brief Power-on bank layout and registers. */
+    void powerOn();
+
+    const CartridgeImage& image() const { return *rom; }
+
+    /** @brief Current nametable layout, some boards switch it. */
+    Mirroring mirroring() const { return mirror; }
+
+    /** @brief PPU read of the pattern tables, $0000-$1FFF. */
+    byte readChr(h_word address) const { return chr_read[(address >> 10) & 0x07][address & 0x03FF]; }
+
+    /** @brief PPU write of the pattern tables, lost on CHR ROM. */
+    void writeChr(h_word address, byte data);
+
+    /**
+     * @brief Called once per rendered scanline (PPU A12 rising edge), for
+     * boards counting them.
+     */
+    virtual void scanline() {}
+
+    /** @brief True while the board holds its IRQ line low. */
+    bool irqPending() const { return irq; }
+
+    /**
+     * @brief True if scanline() may raise the IRQ, the bus then has to stop
+     * the CPU on every scanline.
+     */
+    virtual bool irqEnabled() const { return false; }
+
+    /** @brief Cartridge RAM at $6000, nullptr if the board has none. */
+    byte* prgRam() { return prg_ram.empty() ? nullptr : prg_ram.data(); }
+    size_t prgRamSize() const { return prg_ram.size(); }
+
+    /** @brief CHR-RAM, nullptr on CHR ROM boards. */
+    byte* chrRam() { return chr_ram.empty() ? nullptr : chr_ram.data(); }
+    size_t chrRamSize() const { return chr_ram.size(); }
+
+    void saveState(MapperState& state) const;
+
+    /**
+     * @brief Restores the registers and remaps the banks.
+     *
+     * @return False if the snapshot comes from another mapper.
+     */
+    bool loadState(const MapperState& state);
+
+protected:
+    explicit Mapper(std::shared_ptr<const CartridgeImage> image);
+
+    std::shared_ptr<const CartridgeImage> rom;
+    MemoryMap* memory = nullptr;
+    Mirroring mirror;
+    bool irq = false;
+
+    /** @brief Register write on $8000-$FFFF. */
+    virtual void writeRegister(h_word address, byte data) = 0;
+
+    /** @brief Puts the registers in their power-on state. */
+    virtual void resetRegisters() = 0;
+
+    /** @brief Applies the registers to the PRG/CHR windows and mirroring. */
+    virtual void updateBanks() = 0;
+
+    /** @brief Raw copy of the registers, at most MapperState::REGISTERS bytes. */
+    virtual size_t saveRegisters(byte* out) const = 0;
+    virtual void loadRegisters(const byte* in) = 0;
+
+    /**
+     * @brief Shows PRG bank `bank` of `size` bytes at `address`, negative
+     * banks counting from the end of the ROM. Unchanged windows are left
+     * alone so that code caches survive register rewrites.
+     */
+    void mapPrg(h_word address, size_t size, int bank);
+
+    /** @brief Same for CHR: bank of `size` bytes in the window at PPU `address`. */
+    void mapChr(h_word address, size_t size, int bank);
+
+    size_t prgBanks(size_t size) const { return rom->prg_size / size; }
+    size_t chrBanks(size_t size) const { return chrSize() / size; }
+
+private:
+    std::vector<byte> prg_ram;
+    std::vector<byte> chr_ram;
+    std::array<const byte*, 8> chr_read{};
+    std::array<byte*, 8> chr_write{};
+    std::array<size_t, 8> chr_offset{};  // of each window in CHR-RAM
+    std::vector<uint16_t> chr_slots;     // tracking slot of each CHR-RAM page
+
+    size_t chrSize() const { return chr_ram.empty() ? rom->chr_size : chr_ram.size(); }
+
+    static void onWrite(void* device, h_word address, byte data);
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mapper.hpp"
+
+/**
+ * @file mappers.hpp
+ * @brief The supported boards, by iNES mapper number.
+ */
+
+/** @brief Mapper 0: fixed 16/32KB PRG and 8KB CHR. */
+class Nrom : public Mapper {
+public:
+    explicit Nrom(std::shared_ptr<const CartridgeImage> image) : Mapper(std::move(image)) {}
+
+protected:
+    void writeRegister(h_word, byte) override {}
+    void resetRegisters() override {}
+    void updateBanks() override;
+    size_t saveRegisters(byte*) const override { return 0; }
+    void loadRegisters(const byte*) override {}
+};
+
+/**
+ * @brief Mapper 1 (MMC1, SxROM): serial 5 bit registers, 16/32KB PRG and
+ * 4/8KB CHR banks, switchable mirroring.
+ */
+class Mmc1 : public Mapper {
+public:
+    explicit Mmc1(std::shared_ptr<const CartridgeImage> image) : Mapper(std::move(image)) {}
+
+protected:
+    void writeRegister(h_word address, byte data) override;
+    void resetRegisters() override;
+    void updateBanks() override;
+    size_t saveRegisters(byte* out) const override;
+    void loadRegisters(const byte* in) override;
+
+private:
+    struct Registers {
+        byte shift;     // serial port, a 1 marks how far it is filled
+        byte control;
+        byte chr0;
+        byte chr1;
+        byte prg;
+    } regs = {};
+    static_assert(sizeof(Registers) <= MapperState::REGISTERS, "MMC1 registers must fit a MapperState");
+};
+
+/** @brief Mapper 2 (UxROM): 16KB switchable PRG at $8000, last bank fixed. */
+class Uxrom : public Mapper {
+public:
+    explicit Uxrom(std::shared_ptr<const CartridgeImage> image) : Mapper(std::move(image)) {}
+
+protected:
+    void writeRegister(h_word address, byte data) override;
+    void resetRegisters() override { bank = 0; }
+    void updateBanks() override;
+    size_t saveRegisters(byte* out) const override;
+    void loadRegisters(const byte* in) override;
+
+private:
+    byte bank = 0;
+};
+
+/**
+ * @brief Mapper 4 (MMC3, TxROM): 8KB PRG and 1/2KB CHR banks, switchable
+ * mirroring and a scanline counter IRQ.
+ */
+class Mmc3 : public Mapper {
+public:
+    explicit Mmc3(std::shared_ptr<const CartridgeImage> image) : Mapper(std::move(image)) {}
+
+    void scanline() override;
+    bool irqEnabled() const override { return regs.irq_enabled != 0; }
+
+protected:
+    void writeRegister(h_word address, byte data) override;
+    void resetRegisters() override;
+    void updateBanks() override;
+    size_t saveRegisters(byte* out) const override;
+    void loadRegisters(const byte* in) override;
+
+private:
+    struct Registers {
+        byte select;        // $8000: target register, PRG and CHR modes
+        byte banks[8];      // R0-R7
+        byte mirroring;     // $A000
+        byte irq_latch;     // $C000
+        byte irq_counter;
+        byte irq_reload;
+        byte irq_enabled;
+    } regs = {};
+    static_assert(sizeof(Registers) <= MapperState::REGISTERS, "MMC3 registers must fit a MapperState");
+};
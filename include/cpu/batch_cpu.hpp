@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "nes_common.hpp"
+#include "op_table.hpp"
+
+class Bus;
+class CPU;
+class MemoryMap;
+
+/** @brief What BatchCpu did, in instructions of one lane each. */
+struct BatchStats {
+    uint64_t batched = 0;   // executed through the lane groups
+    uint64_t scalar = 0;    // handed to CPU::step() (I/O, code outside RAM/ROM)
+    uint64_t groups = 0;    // group executions, batched / groups is the average width
+
+    uint64_t instructions() const { return batched + scalar; }
+};
+
+/**
+ * @class BatchCpu
+ * @brief Runs the CPUs of many independent systems (lanes) together.
+ *
+ * The registers of every lane, and the in-flight helpers a snapshot records
+ * (fetched, addr_abs, addr_rel, opcode), are kept in structure of arrays
+ * layout for the duration of a run. Each step picks the lanes that stand on
+ * the lowest program counter with the same instruction bytes and executes
+ * that instruction for all of them at once: the opcode is decoded once, the
+ * addresses and memory accesses go lane by lane straight to each lane's RAM
+ * and ROM (pages every lane maps alike are read through one pointer), and
+ * the ALU and flag work runs over the whole group with the
+ * SIMD kernels (their scalar tails for narrow groups and non-x86 builds).
+ * Lanes whose paths diverge simply end up in different groups, and join again
+ * once their program counters meet, at the latest on their next interrupt.
+ *
+ * An instruction touching mapped I/O (PPU registers, controllers, mapper
+ * registers) or running from it goes through the lane's own CPU::step()
+ * instead, with every side effect, and the lane then honors shortenRun()
+ * like CPU::run() does. The bus side of run() is mirrored lane by lane, so
+ * every lane ends up exactly where Bus::run() would have taken it.
+ *
+ * Tracers and profilers set on the lane CPUs only see the scalar steps.
+ */
+class BatchCpu {
+public:
+    BatchCpu() = default;
+
+    BatchCpu(const BatchCpu&) = delete;
+    BatchCpu& operator=(const BatchCpu&) = delete;
+
+    /**
+     * @brief Adds a system as the next lane. It must outlive the BatchCpu
+     * and have its cartridge inserted; swapping cartridges later is fine.
+     */
+    void addLane(Bus& bus);
+
+    size_t lanes() const { return buses.size(); }
+
+    /**
+     * @brief Bus::run(cycles) on every lane.
+     *
+     * @return The cycles run, summed over the lanes.
+     */
+    uint64_t run(uint64_t cycles);
+
+    const BatchStats& stats() const { return counters; }
+    void resetStats() { counters = {}; }
+
+private:
+    std::vector<Bus*> buses;
+    std::vector<CPU*> cpus;
+    std::vector<MemoryMap*> maps;
+    std::vector<const byte*> zero_pages;    // internal RAM ($0000-$1FFF mirrored), read directly
+    std::vector<const byte*> stack_pages;
+    std::vector<byte*> rams;                // the same for writes, nullptr while watched
+    std::vector<byte> written;              // internal RAM pages stored to through `rams`
+
+    // register file, one entry per lane
+    std::vector<byte> a, x, y, sp, status;
+    std::vector<byte> fetched, opcode;
+    std::vector<h_word> pc, addr_abs, addr_rel;
+    std::vector<uint64_t> clock, limit;     // a lane runs while clock < limit
+    std::vector<uint64_t> ends;             // where run() stops each lane
+    std::vector<byte> busy;                 // lane not done with run() yet
+
+    // the group being executed, and per group member scratch
+    std::vector<uint32_t> group;
+    std::vector<uint32_t> diverted;         // group members handed to CPU::step()
+    std::vector<h_word> address;
+    std::vector<byte> crossed;              // indexed access crossed a page
+    std::vector<byte> operand, result;
+    std::vector<byte> ga, gx, gy, gs;       // registers gathered for partial groups
+
+    // read pointer every lane has on a page, nullptr if they differ (code
+    // in RAM, other banks); remaps only happen in stepScalar()
+    std::array<const byte*, 256> shared{};
+    size_t count = 0;                       // group members
+    bool whole = false;                     // the group is every lane, in order
+    bool uniform = false;                   // every lane active and on pc[0]
+
+    BatchStats counters;
+
+    /** @brief CPU::run(limit - clock) on every lane with clock < limit. */
+    void runLanes();
+
+    /**
+     * @brief Gathers the next group and its instruction bytes into `code`.
+     * A lead lane whose code is not directly readable is stepped on its
+     * own, leaving an empty group.
+     *
+     * @return False when no lane is left to run.
+     */
+    bool pickGroup(byte* code);
+
+    /** @brief Instruction bytes at `address` in a lane, false if not directly readable. */
+    bool codeAt(size_t lane, h_word address, size_t length, byte* code) const;
+
+    /** @brief Dispatches the group's opcode to its execute() instantiation. */
+    void dispatch(const byte* code);
+
+    /** @brief Runs one instruction for the whole group. */
+    template <AddrMode Mode, Mnemonic Op, byte Cycles>
+    void execute(const byte* code);
+
+    /** @brief Reads plain memory (RAM/ROM) of a lane. */
+    byte readLane(size_t lane, h_word address) const;
+
+    /** @brief Writes plain memory of a lane, RAM or not. */
+    void writeLane(size_t lane, h_word address, byte data);
+
+    /** @brief Runs one instruction of a lane through its own CPU. */
+    void stepScalar(size_t lane);
+
+    /** @brief Moves the members that cannot be batched to `diverted`. */
+    template <typename Keep>
+    void divert(Keep keep);
+
+    void load(size_t lane);
+    void spill(size_t lane);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "nes_common.hpp"
+
+class CPU;
+class MemoryMap;
+struct DecodedOp;
+
+/** @brief Executes one pre-decoded instruction, returns its cycles. */
+using DecodedHandler = byte (CPU::*)(const DecodedOp&);
+
+/**
+ * @brief One instruction with its operand already read from memory.
+ */
+struct DecodedOp {
+    DecodedHandler handler; // addressing mode and operation bound at compile time
+    h_word operand;         // absolute/zero page/pointer address, IMM byte address or sign extended REL offset
+    h_word next_pc;         // address of the following instruction
+    byte opcode;
+};
+
+/**
+ * @brief Straight-line run of instructions, ending on a jump or a branch.
+ */
+struct Block {
+    std::vector<DecodedOp> ops;
+    uint32_t cycles = 0;    // base cycles of the whole run
+};
+
+/**
+ * @class BlockCache
+ * @brief Pre-decoding engine for CPU::run().
+ *
+ * Blocks are decoded from directly readable memory (ROM or RAM, never mapped
+ * I/O), keyed by their start address and limited to their start page and the
+ * next one. Those pages are watched in the memory map: a write to them, a
+ * remap (bank switch) or a state load drops every block that may cover them.
+ * Execution goes through the same operations and cycle accounting as the
+ * interpreter, so results are identical.
+ */
+class BlockCache {
+public:
+    static constexpr size_t MAX_BLOCK = 32;
+
+    BlockCache(CPU& cpu, MemoryMap& memory);
+    ~BlockCache();
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    /** @brief Runs until the end of the CPU::run() calling it. */
+    void run();
+
+    /** @brief Drops every block. */
+    void flush();
+
+    /** @brief Number of blocks decoded since construction. */
+    uint64_t decodedBlocks() const { return decoded; }
+
+    /** @brief Number of instructions started by run() since construction. */
+    uint64_t executedInstructions() const { return executed; }
+
+private:
+    using PageBlocks = std::array<std::unique_ptr<Block>, 256>;
+
+    CPU& cpu;
+    MemoryMap& memory;
+
+    std::array<std::unique_ptr<PageBlocks>, 256> blocks;   // by start page, then offset
+    std::vector<std::unique_ptr<PageBlocks>> retired;       // dropped while possibly running
+    bool invalidated = false;
+    uint64_t decoded = 0;
+    uint64_t executed = 0;
+
+    const Block* build(h_word start);
+    void invalidatePage(byte page);
+    static void onWatch(void* context, byte page);
+};
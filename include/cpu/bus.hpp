@@ -1,23 +1,266 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <memory>
+#include "apu.hpp"
+#include "cartridge.hpp"
 #include "cpu.hpp"
+#include "mapper.hpp"
+#include "memory_map.hpp"
 #include "nes_common.hpp"
+#include "ppu.hpp"
+#include "save_state.hpp"
+#include "scheduler.hpp"
+
+// standard controller buttons, in the order they are shifted out
+const byte BUTTON_A = 0x01;
+const byte BUTTON_B = 0x02;
+const byte BUTTON_SELECT = 0x04;
+const byte BUTTON_START = 0x08;
+const byte BUTTON_UP = 0x10;
+const byte BUTTON_DOWN = 0x20;
+const byte BUTTON_LEFT = 0x40;
+const byte BUTTON_RIGHT = 0x80;
 
 /** @brief Bus class
  * 
- * This class represents the cpu bus of the NES.
+ * This class represents the cpu bus of the NES. Addresses are decoded by a
+ * 256 entry page table, devices register their pages in it.
+ *
+ * Time is the CPU cycle count since power on. Devices register their
+ * deadlines (vblank NMI, mapper scanline IRQ...) with the bus scheduler, and
+ * run() lets the CPU go uninterrupted until the earliest one instead of
+ * polling every device each cycle. The PPU is caught up lazily: only when the
+ * CPU touches its registers, or when one of its deadlines comes due. clock()
+ * and the lockstep mode keep the cycle by cycle schedule as a reference, both
+ * give the same results.
  */
 class Bus {
     public: // Bus interface
         Bus();
         ~Bus();
-        void write(h_word address, byte data);
-        byte read(h_word address, bool bReadOnly = false);
+
+        // the page table points into this very object
+        Bus(const Bus&) = delete;
+        Bus& operator=(const Bus&) = delete;
+
+        void write(h_word address, byte data) { memory.write(address, data); }
+        byte read(h_word address, bool bReadOnly = false) { return memory.read(address, bReadOnly); }
+
+        /**
+         * @brief Plugs a cartridge in, replacing the current one, and powers
+         * its board on. Reset the system afterwards to boot it.
+         *
+         * @throws std::runtime_error if its mapper is not supported.
+         */
+        void insertCartridge(std::shared_ptr<const CartridgeImage> image);
+
+        /** @brief Unplugs the cartridge, $6000-$FFFF reads as open bus. */
+        void removeCartridge();
+
+        /** @brief The board of the inserted cartridge, nullptr if none. */
+        Mapper* cartridge() { return mapper.get(); }
+
+        /**
+         * @brief Buttons held on the standard controller in `port` (0 or
+         * 1), an or of BUTTON_*. Games see them on their next strobe.
+         */
+        void setController(size_t port, byte buttons) { controllers[port & 1] = buttons; }
+        byte controller(size_t port) const { return controllers[port & 1]; }
+
+        /** @brief Copies the controller shift registers and strobe into a snapshot. */
+        void saveInputState(InputState& state) const;
+
+        /** @brief Restores the controller shift registers and strobe from a snapshot. */
+        void loadInputState(const InputState& state);
+
+        /** @brief Resets every device. */
+        void reset();
+
+        /**
+         * @brief Advances the system by one CPU clock cycle, and the PPU by
+         * three dots.
+         */
+        void clock();
+
+        /**
+         * @brief Runs whole instructions until at least `cycles` CPU cycles
+         * have elapsed.
+         *
+         * @return The number of cycles actually run.
+         */
+        uint64_t run(uint64_t cycles);
+
+        /**
+         * @brief Runs whole instructions until the PPU completes a frame
+         * (starts vblank).
+         *
+         * @return The number of cycles run.
+         */
+        uint64_t runFrame();
+
+        /**
+         * @brief Makes run() go through clock(), keeping the PPU in step
+         * with the CPU on every cycle. Slow, meant to check the lazy
+         * schedule against.
+         */
+        void setLockstep(bool enabled) { lockstep = enabled; }
+        bool lockstepEnabled() const { return lockstep; }
+
+        /**
+         * @brief Pieces of run(), for engines that run the CPU themselves
+         * (BatchCpu). run() is
+         *
+         *     while (cycleCount < end || !complete)
+         *         cpu.run(cpuDeadline(end) - cycleCount), serviceDevices()
+         *     syncDevices()
+         *
+         * and any engine stopping the CPU at the first instruction boundary
+         * at or after cpuDeadline() (or sooner) gets the same results.
+         */
+        uint64_t cpuDeadline(uint64_t end) const { return deadline(end); }
+
+        /** @brief Fires the due device events and starts a pending interrupt. */
+        void serviceDevices();
+
+        /** @brief Catches every device up with the CPU. */
+        void syncDevices() {
+            syncPpu();
+            syncApu();
+        }
+
+        /** @brief IRQ line: the mapper or the APU holds it. */
+        bool irqPending() const { return (mapper && mapper->irqPending()) || apu.irqPending(); }
+
+        /** @brief Master timestamp, CPU cycles since power on. */
+        uint64_t timestamp() const { return cpu.cycleCount(); }
+
+        /**
+         * @brief Registers a kind of device event with the scheduler.
+         *
+         * @return Its id, for schedule() and cancel().
+         */
+        size_t addEvent(EventHandler handler, void* device) { return scheduler.add(handler, device); }
+
+        /**
+         * @brief Makes an event due at `time` (a timestamp()), replacing its
+         * pending deadline. The instructions running now finish first.
+         */
+        void schedule(size_t event, uint64_t time);
+        void cancel(size_t event) { scheduler.cancel(event); }
+
+        /**
+         * @brief Recomputes the deadlines of every device, for whoever
+         * restores their state behind the bus' back (rewind).
+         */
+        void refreshDeadlines();
+
+        /**
+         * @brief Takes a snapshot of the whole system, no allocation.
+         */
+        void saveState(SaveState& state) const;
+
+        /**
+         * @brief Restores a snapshot.
+         *
+         * @return False, leaving the system untouched, if the snapshot comes
+         * from another format version or build, or from another board.
+         */
+        bool loadState(const SaveState& state);
+
+        /**
+         * @brief FNV-1a hash of a snapshot of the whole system, to check
+         * that two runs ended up in the same state.
+         */
+        uint64_t stateHash() const;
+
+        /**
+         * @brief Writes a snapshot into a caller provided buffer.
+         *
+         * @return The number of bytes written, 0 if `size` is too small.
+         */
+        size_t serialize(byte* buffer, size_t size) const;
+
+        /**
+         * @brief Restores a snapshot written by serialize().
+         */
+        bool deserialize(const byte* buffer, size_t size);
+
+        /** @brief Page table of the CPU address space, for devices to map into. */
+        MemoryMap& memoryMap() { return memory; }
+
+        CPU& getCpu() { return cpu; }
+
+        /** @brief The PPU, as of its last catch up. */
+        PPU& getPpu() { return ppu; }
+
+        /** @brief The APU, as of its last catch up (the end of each run()). */
+        APU& getApu() { return apu; }
 
     private: // Devices interface
+        // before the CPU, whose block cache unwatches the memory map when it
+        // goes, and is destroyed first
+        MemoryMap memory;
+
+        // 2KB of internal RAM, mirrored four times on $0000-$1FFF
+        std::array<byte, CPU_RAM_SIZE> ram;
+
         CPU cpu;
 
-        // for now, we only have a CPU and some RAM
-        std::array<byte, 64*oxFFFf> ram;
-};
\ No newline at end of file
+        PPU ppu;
+
+        APU apu;
+
+        // standard controllers on $4016/$4017
+        std::array<byte, 2> controllers{};
+        std::array<byte, 2> shifts{};
+        bool strobe = false;
+
+        Scheduler scheduler;
+        size_t vblank_event;
+        size_t scanline_event;
+        size_t apu_event;
+
+        bool lockstep = false;
+
+        // last so that it unmaps itself before anything else goes
+        std::unique_ptr<Mapper> mapper;
+
+        /** @brief Brings the PPU up to the CPU time. */
+        void syncPpu() { ppu.runTo(cpu.cycleCount() * 3); }
+
+        /** @brief Brings the APU up to the CPU time. */
+        void syncApu() { apu.runTo(cpu.cycleCount()); }
+
+        // deadlines of the PPU (and of the mapper IRQ it clocks)
+        void scheduleVblank();
+        void scheduleScanline();
+        void scheduleDot(size_t event, uint64_t dot);
+
+        // frame IRQ and DMC fetches
+        void scheduleApu();
+
+        /** @brief Starts a pending NMI or IRQ, between two instructions. */
+        void serviceInterrupts();
+
+        /** @brief CPU cycle run() has to stop at to look at the devices. */
+        uint64_t deadline(uint64_t end) const;
+
+        bool acceptsState(const SaveState& state) const;
+        void saveDevices(SaveState& state) const;
+        void loadDevices(const SaveState& state);
+
+        // memory of a snapshot, from SaveState::ram on
+        void saveMemory(byte* out) const;
+        void loadMemory(const byte* in);
+
+        static byte ppuRead(void* device, h_word address, bool bReadOnly);
+        static void ppuWrite(void* device, h_word address, byte data);
+        static byte ioRead(void* device, h_word address, bool bReadOnly);
+        static void ioWrite(void* device, h_word address, byte data);
+        static void cartridgeWrite(void* device, h_word address, byte data);
+        static void onPpuEvent(void* device, uint64_t time);
+        static void onApuEvent(void* device, uint64_t time);
+        static byte dmcRead(void* device, h_word address);
+};
@@ -1,8 +1,16 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include "block_cache.hpp"
+#include "memory_map.hpp"
 #include "nes_common.hpp"
-#include "bus.hpp"
+#include "op_table.hpp"
+#include "profile.hpp"
+#include "save_state.hpp"
+#include "trace.hpp"
+
+class Bus;
 
 /**
  * @class CPU
@@ -12,6 +20,9 @@
  * registers, instruction set, and interaction with the system bus.
  */
 class CPU {
+    friend class BatchCpu;
+    friend class BlockCache;
+
 public:
     /** 
      * @brief Default constructor for CPU class.
@@ -26,15 +37,93 @@ public:
     /** 
      * @brief Connects the CPU to the system bus.
      * 
+     * The bus memory map must already be set up, the direct pointers to the
+     * zero page and the stack page are taken here.
+     *
      * @param n Pointer to the Bus instance to connect.
      */
-    void connectBus(Bus* n) { bus = n; };
+    void connectBus(Bus* n);
 
     /**
      * @brief Executes a single clock cycle.
+     *
+     * Cycle-accurate reference path: the whole instruction is executed on its
+     * first cycle and the remaining cycles are idled one call at a time.
      */
     void clock();
 
+    /**
+     * @brief Executes a whole instruction at once.
+     *
+     * Decoding goes through a switch expanded at compile time from the opcode
+     * table, so both the addressing mode and the operation are direct calls.
+     * If an instruction started by clock() (or an interrupt) is still in
+     * flight, its remaining cycles are consumed instead.
+     *
+     * @return The number of cycles spent, identical to what clock() would need.
+     */
+    byte step();
+
+    /**
+     * @brief Executes whole instructions until at least `cycles` have elapsed.
+     *
+     * @param cycles Cycle budget to spend.
+     * Goes through the block cache when it is enabled, the results being the
+     * same either way.
+     *
+     * @return The number of cycles actually spent (may overshoot the budget by
+     * less than one instruction, or fall short of it after shortenRun()).
+     */
+    uint64_t run(uint64_t cycles);
+
+    /**
+     * @brief Makes the run() in progress return at the first instruction
+     * boundary at or after `cycle`, for devices that need the bus to look at
+     * them sooner than planned (an interrupt raised by a register write).
+     */
+    void shortenRun(uint64_t cycle);
+
+    /** @brief Cycles elapsed since power on, the system time base. */
+    uint64_t cycleCount() const { return clock_count; }
+
+    /** @brief True between two instructions, when interrupts can be taken. */
+    bool complete() const { return cycles == 0 && stall == 0; }
+
+    /** @brief The I flag is set, an IRQ would be ignored. */
+    bool interruptsMasked() const { return status & I; }
+
+    /**
+     * @brief Halts the CPU for `count` cycles once the current instruction
+     * is done (DMA).
+     */
+    void addStall(h_word count) { stall += count; }
+
+    /**
+     * @brief Turns the pre-decoding block cache used by run() on or off.
+     *
+     * The CPU must be connected to its bus first.
+     */
+    void enableBlockCache(bool enable);
+
+    /** @brief The block cache, nullptr when disabled. */
+    BlockCache* blockCache() { return block_cache.get(); }
+
+    /**
+     * @brief Sends one TraceRecord per instruction to `writer`, nullptr to stop.
+     *
+     * Only builds with NES_ENABLE_TRACE record anything, this is a no-op in
+     * the others.
+     */
+    void setTracer(TraceWriter* writer);
+
+    /**
+     * @brief Accumulates execution counters into `profile`, nullptr to stop.
+     *
+     * Only builds with NES_ENABLE_PROFILE count anything, this is a no-op in
+     * the others.
+     */
+    void setProfiler(CpuProfile* profile);
+
     /** 
      * @brief Resets the CPU to its initial state.
      */
@@ -50,6 +139,16 @@ public:
      */
     void nmi();
 
+    /**
+     * @brief Copies the registers and in-flight helpers into a snapshot.
+     */
+    void saveState(CpuState& state) const;
+
+    /**
+     * @brief Restores the registers and in-flight helpers from a snapshot.
+     */
+    void loadState(const CpuState& state);
+
     /** 
      * @brief Fetches the next byte from memory.
      * 
@@ -67,7 +166,10 @@ private:
     byte status = 0x00; /**< Status register. */
 
     // Bus connection
-    Bus* bus = nullptr; /**< Pointer to the system bus. */
+    Bus* bus = nullptr;             /**< Pointer to the system bus. */
+    MemoryMap* memory = nullptr;    /**< Page table of the bus, for direct accesses. */
+    const byte* zero_page = nullptr;    /**< Host memory of page $00. */
+    const byte* stack_page = nullptr;   /**< Host memory of page $01. */
 
     /** 
      * @brief Reads a byte from the specified memory address.
@@ -75,7 +177,7 @@ private:
      * @param address Memory address to read from.
      * @return The byte read from memory.
      */
-    byte read(h_word address);
+    byte read(h_word address) { return memory->read(address); }
 
     /** 
      * @brief Writes a byte to the specified memory address.
@@ -83,7 +185,7 @@ private:
      * @param address Memory address to write to.
      * @param data The byte to write.
      */
-    void write(h_word address, byte data);
+    void write(h_word address, byte data) { memory->write(address, data); }
 
     // Addressing modes
     /** @brief Implied addressing mode. */
@@ -210,6 +312,18 @@ private:
      */
     void SetFlag(FLAGS6502 flag, bool setFlag);
 
+    /**
+     * @brief Takes the relative branch held in addr_rel, adding the extra
+     * cycles it costs.
+     */
+    void branch();
+
+    /**
+     * @brief Called when an instruction clears the I flag: run() stops after
+     * it if the IRQ line is held, for the bus to start the interrupt.
+     */
+    void unmaskIrq();
+
     private:
         // Helper variables
         byte fetched    = 0x00;     // Data fetched from memory
@@ -217,22 +331,96 @@ private:
         h_word addr_rel = 0x00;     // Relative address
         byte opcode     = 0x00;     // Current opcode
         byte cycles     = 0;        // Remaining cycles
+        h_word stall    = 0;        // Cycles halted by DMA after this instruction
+        uint64_t clock_count = 0;   // Total cycles elapsed since power on
+        uint64_t run_end = UINT64_MAX;  // clock_count at which run() returns
 
     private:
-        // Instruction lookup table and setup
+        // Instruction lookup table
         /**
-        * @brief Function pointer to the instruction's operation.
-        * 
-        * Points to a member function of the CPU class that implements the 
-        * specific behavior of the instruction.
+        * @brief Opcode metadata shared by every CPU instance.
+        *
+        * A reference to the constexpr OP_TABLE, so nothing is built per
+        * instance; the operations themselves are bound in dispatch().
         */
-        struct INSTRUCTION {
-            std::string name;                   // Name of the instruction
-            byte (CPU::*operate)() = nullptr;   // Function pointer to the operation
-            byte (CPU::*addrmode)() = nullptr;  // Function pointer to the addressing mode
-            byte cycles = 0;                    // Number of cycles required for the instruction
-        };
+        static constexpr const std::array<OpInfo, 256>& lookup = OP_TABLE;
 
-        std::vector<INSTRUCTION> lookup;
+        /**
+        * @brief Executes one instruction, with its addressing mode and
+        * operation bound at compile time.
+        *
+        * @return The number of cycles taken by the instruction.
+        */
+        template <byte (CPU::*Addrmode)(), byte (CPU::*Operate)(), byte Cycles>
+        byte execute();
+
+        /**
+        * @brief Dispatches the current opcode to its execute() instantiation.
+        */
+        byte dispatch();
+
+        // Pre-decoded execution, see BlockCache
+        std::unique_ptr<BlockCache> block_cache;
 
-}
\ No newline at end of file
+        /**
+        * @brief Addressing mode working on an operand decoded ahead of time.
+        */
+        template <AddrMode Mode>
+        byte resolve(h_word operand);
+
+        /**
+        * @brief Executes one pre-decoded instruction, pc and opcode being set.
+        */
+        template <AddrMode Mode, byte (CPU::*Operate)(), byte Cycles>
+        byte executeDecoded(const DecodedOp& op);
+
+        /** @brief executeDecoded() instantiation of an opcode. */
+        static DecodedHandler decodedHandler(byte opcode);
+
+#if NES_ENABLE_TRACE
+        TraceWriter* tracer = nullptr;
+#endif
+
+        /**
+        * @brief Records the instruction about to run, pc pointing at its
+        * opcode. Compiles to nothing without NES_ENABLE_TRACE.
+        */
+        void trace() {
+#if NES_ENABLE_TRACE
+            if (tracer)
+                tracer->record({ clock_count, pc, opcode, a, x, y, sp, status });
+#endif
+        }
+
+#if NES_ENABLE_PROFILE
+        CpuProfile* profiler = nullptr;
+#endif
+
+        /**
+        * @brief Counts the instruction about to run, pc pointing at its
+        * opcode. Compiles to nothing without NES_ENABLE_PROFILE.
+        */
+        void profileStart() {
+#if NES_ENABLE_PROFILE
+            if (profiler) {
+                profiler->executed[opcode]++;
+                profiler->pc_hits[pc]++;
+            }
+#endif
+        }
+
+        /**
+        * @brief Adds the cycles of the instruction just run, `page_cross`
+        * being its indexed read penalty.
+        */
+        void profileCycles(byte page_cross) {
+#if NES_ENABLE_PROFILE
+            if (profiler) {
+                profiler->cycles[opcode] += cycles;
+                profiler->page_cross[opcode] += page_cross;
+            }
+#else
+            (void)page_cross;
+#endif
+        }
+};
\ No newline at end of file
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "nes_common.hpp"
+
+/**
+ * @brief Read callback of a memory mapped device.
+ *
+ * @param device The device registered with the handler.
+ * @param address Full bus address being read.
+ * @param bReadOnly True when the read must not have side effects (debuggers).
+ */
+using ReadHandler = byte (*)(void* device, h_word address, bool bReadOnly);
+
+/**
+ * @brief Write callback of a memory mapped device.
+ */
+using WriteHandler = void (*)(void* device, h_word address, byte data);
+
+/**
+ * @brief Called when a watched page is written or remapped.
+ */
+using WatchHandler = void (*)(void* context, byte page);
+
+/** @brief A device answering reads and/or writes on some pages. */
+struct IoHandler {
+    void* device = nullptr;
+    ReadHandler read = nullptr;     // nullptr reads as open bus (0x00)
+    WriteHandler write = nullptr;   // nullptr ignores the write
+};
+
+/**
+ * @brief One 256 byte page of the CPU address space.
+ *
+ * A direct host pointer is used when set, otherwise the access goes to the
+ * handler. Reads and writes are separate so that ROM can be read directly
+ * while its writes still reach the mapper registers.
+ */
+struct MemoryPage {
+    const byte* read = nullptr; // direct pointer for reads (RAM/ROM)
+    byte* write = nullptr;      // direct pointer for writes, `ram` unless watched
+    byte* ram = nullptr;        // host RAM behind the page, if any
+    uint16_t slot = 0;          // dirty tracking slot of `ram`
+    bool watched = false;       // writes and remaps are reported to the watcher
+    IoHandler io;               // mapped I/O for whatever has no pointer
+};
+
+/**
+ * @class MemoryMap
+ * @brief 256 entry page table decoding the 16 bit CPU address space.
+ *
+ * Mirrored regions are set up by pointing several pages at the same host
+ * memory, so no masking happens on the access path.
+ *
+ * Every host page mapped as RAM gets a tracking slot (mirrors share it) and
+ * write() flags the slot dirty, so checkpoints only copy what changed. The
+ * slot of RAM that is no longer mapped anywhere is emptied and recycled.
+ * Memory outside the CPU address space (PPU nametables, CHR-RAM) can be
+ * tracked too, its owner flagging its own writes with markDirty().
+ *
+ * Pages can be watched (by the CPU block cache): their direct write pointer is
+ * hidden so their writes take the slow path and get reported, which keeps the
+ * fast path free of any check.
+ */
+class MemoryMap {
+public:
+    static constexpr size_t PAGE_SIZE = 0x100;
+    static constexpr size_t PAGE_COUNT = 0x100;
+    static constexpr size_t MAX_TRACKED = 0x200;
+
+    /**
+     * @brief Maps host RAM on [first, last], mirrored every `size` bytes.
+     *
+     * The host memory is registered for dirty tracking and must outlive the
+     * map.
+     *
+     * @param size Size of `data`, a multiple of PAGE_SIZE.
+     */
+    void mapRam(h_word first, h_word last, byte* data, size_t size);
+
+    /**
+     * @brief Maps read-only host memory on [first, last], mirrored every
+     * `size` bytes. Writes keep going to the page handler, if any.
+     */
+    void mapRom(h_word first, h_word last, const byte* data, size_t size);
+
+    /**
+     * @brief Routes every access on [first, last] to a device.
+     */
+    void mapIo(h_word first, h_word last, const IoHandler& handler);
+
+    /**
+     * @brief Routes the writes on [first, last] to a device, the read
+     * pointers are left as they are (mapper registers over ROM).
+     */
+    void mapWriteIo(h_word first, h_word last, const IoHandler& handler);
+
+    /**
+     * @brief Makes [first, last] open bus again.
+     */
+    void unmap(h_word first, h_word last);
+
+    /** @brief Direct read pointer of a page, nullptr if it is mapped I/O. */
+    const byte* readPointer(byte page) const { return pages[page].read; }
+
+    /** @brief Direct write pointer of a page, nullptr if it is ROM or I/O. */
+    byte* writePointer(byte page) const { return pages[page].write; }
+
+    /**
+     * @brief Host RAM behind a page, nullptr if it is ROM or I/O: writes to
+     * it have no side effect beyond the dirty flag (and the watcher).
+     */
+    byte* ramPointer(byte page) const { return pages[page].ram; }
+
+    /**
+     * @brief Sets who is told about writes to, and remaps of, watched pages.
+     */
+    void setWatcher(WatchHandler handler, void* context);
+
+    /** @brief Starts reporting the writes and remaps of a page. */
+    void watch(byte page);
+
+    /** @brief Stops watching every page. */
+    void unwatchAll();
+
+    /**
+     * @brief Reports every watched page as rewritten, for whoever changes
+     * memory behind write()'s back.
+     */
+    void invalidateWatched();
+
+    /**
+     * @brief Tracks a host page that is not mapped in the CPU address space,
+     * until untrack().
+     *
+     * @return Its slot, for markDirty().
+     */
+    uint16_t track(byte* page);
+    void untrack(uint16_t slot);
+
+    /**
+     * @brief Flags the RAM behind a page as written, for whoever stores
+     * through its host pointer instead of write().
+     */
+    void markPageDirty(byte page) { dirty[pages[page].slot] = 1; }
+
+    /** @brief Flags a slot as written, for memory that write() never sees. */
+    void markDirty(size_t slot) { dirty[slot] = 1; }
+
+    /** @brief Number of distinct host RAM pages ever mapped. */
+    size_t trackedCount() const { return tracked_count; }
+
+    /** @brief Host memory of a tracking slot, nullptr once it is unmapped. */
+    byte* trackedPage(size_t slot) const { return tracked[slot]; }
+
+    /** @brief True if the slot was written since the last clearDirty(). */
+    bool isDirty(size_t slot) const { return dirty[slot] != 0; }
+
+    void clearDirty() { dirty.fill(0); }
+
+    /** @brief For whoever rewrites RAM behind write()'s back (state loads). */
+    void markAllDirty() {
+        dirty.fill(1);
+        invalidateWatched();
+    }
+
+    byte read(h_word address, bool bReadOnly = false) const {
+        const MemoryPage& page = pages[address >> 8];
+        if (page.read)
+            return page.read[address & 0x00FF];
+        return readIo(page, address, bReadOnly);
+    }
+
+    void write(h_word address, byte data) {
+        const MemoryPage& page = pages[address >> 8];
+        if (page.write) {
+            page.write[address & 0x00FF] = data;
+            dirty[page.slot] = 1;
+        } else
+            writeSlow(page, address, data);
+    }
+
+private:
+    std::array<MemoryPage, PAGE_COUNT> pages;
+
+    std::array<byte*, MAX_TRACKED> tracked{};   // host page of each slot
+    std::array<byte, MAX_TRACKED> dirty{};      // one flag per slot, a plain store on write
+    std::array<bool, MAX_TRACKED> pinned{};     // slots taken by track()
+    size_t tracked_count = 0;
+
+    WatchHandler watcher = nullptr;
+    void* watcher_context = nullptr;
+
+    uint16_t trackPage(byte* host);
+    bool covers(h_word first, h_word last) const;   // any RAM on those pages
+    void releaseSlots();
+    void remapped(size_t page);
+
+    // slow paths, kept out of line
+    static byte readIo(const MemoryPage& page, h_word address, bool bReadOnly);
+    void writeSlow(const MemoryPage& page, h_word address, byte data);
+};
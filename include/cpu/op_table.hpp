@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include "nes_common.hpp"
+
+/**
+ * @file op_table.hpp
+ * @brief The R6502 opcode table.
+ *
+ * The table is written once as an X-macro and expanded both into the constexpr
+ * OP_TABLE metadata below and into the compile-time dispatch switch used by
+ * CPU::step() and CPU::clock(), so every path agrees on the instruction set and
+ * on the base cycle counts.
+ */
+
+// Every operation of the instruction set, XXX standing for illegal opcodes
+#define NES_MNEMONICS(M) \
+    M(ADC) M(AND) M(ASL) M(BCC) M(BCS) M(BEQ) M(BIT) M(BMI) M(BNE) M(BPL) M(BRK) M(BVC) M(BVS) M(CLC) \
+    M(CLD) M(CLI) M(CLV) M(CMP) M(CPX) M(CPY) M(DEC) M(DEX) M(DEY) M(EOR) M(INC) M(INX) M(INY) M(JMP) \
+    M(JSR) M(LDA) M(LDX) M(LDY) M(LSR) M(NOP) M(ORA) M(PHA) M(PHP) M(PLA) M(PLP) M(ROL) M(ROR) M(RTI) \
+    M(RTS) M(SBC) M(SEC) M(SED) M(SEI) M(STA) M(STX) M(STY) M(TAX) M(TAY) M(TSX) M(TXA) M(TXS) M(TYA) \
+    M(XXX)
+
+// Every addressing mode
+#define NES_ADDRMODES(M) \
+    M(IMP) M(IMM) M(ZP0) M(ZPX) M(ZPY) M(REL) M(ABS) M(ABX) M(ABY) M(IND) M(IZX) M(IZY)
+
+/**
+ * It is 16x16 entries. This gives 256 instructions. It is arranged so that the
+ * bottom 4 bits of the instruction choose the column, and the top 4 bits choose
+ * the row. Each entry is X(opcode, name, operation, addressing mode, cycles),
+ * the name being "???" for the opcodes that are not officially documented.
+ */
+#define NES_OP_TABLE(X) \
+    X(0x00, "BRK", BRK, IMM, 7) X(0x01, "ORA", ORA, IZX, 6) X(0x02, "???", XXX, IMP, 2) X(0x03, "???", XXX, IMP, 8) X(0x04, "???", NOP, IMP, 3) X(0x05, "ORA", ORA, ZP0, 3) X(0x06, "ASL", ASL, ZP0, 5) X(0x07, "???", XXX, IMP, 5) X(0x08, "PHP", PHP, IMP, 3) X(0x09, "ORA", ORA, IMM, 2) X(0x0A, "ASL", ASL, IMP, 2) X(0x0B, "???", XXX, IMP, 2) X(0x0C, "???", NOP, IMP, 4) X(0x0D, "ORA", ORA, ABS, 4) X(0x0E, "ASL", ASL, ABS, 6) X(0x0F, "???", XXX, IMP, 6) \
+    X(0x10, "BPL", BPL, REL, 2) X(0x11, "ORA", ORA, IZY, 5) X(0x12, "???", XXX, IMP, 2) X(0x13, "???", XXX, IMP, 8) X(0x14, "???", NOP, IMP, 4) X(0x15, "ORA", ORA, ZPX, 4) X(0x16, "ASL", ASL, ZPX, 6) X(0x17, "???", XXX, IMP, 6) X(0x18, "CLC", CLC, IMP, 2) X(0x19, "ORA", ORA, ABY, 4) X(0x1A, "???", NOP, IMP, 2) X(0x1B, "???", XXX, IMP, 7) X(0x1C, "???", NOP, IMP, 4) X(0x1D, "ORA", ORA, ABX, 4) X(0x1E, "ASL", ASL, ABX, 7) X(0x1F, "???", XXX, IMP, 7) \
+    X(0x20, "JSR", JSR, ABS, 6) X(0x21, "AND", AND, IZX, 6) X(0x22, "???", XXX, IMP, 2) X(0x23, "???", XXX, IMP, 8) X(0x24, "BIT", BIT, ZP0, 3) X(0x25, "AND", AND, ZP0, 3) X(0x26, "ROL", ROL, ZP0, 5) X(0x27, "???", XXX, IMP, 5) X(0x28, "PLP", PLP, IMP, 4) X(0x29, "AND", AND, IMM, 2) X(0x2A, "ROL", ROL, IMP, 2) X(0x2B, "???", XXX, IMP, 2) X(0x2C, "BIT", BIT, ABS, 4) X(0x2D, "AND", AND, ABS, 4) X(0x2E, "ROL", ROL, ABS, 6) X(0x2F, "???", XXX, IMP, 6) \
+    X(0x30, "BMI", BMI, REL, 2) X(0x31, "AND", AND, IZY, 5) X(0x32, "???", XXX, IMP, 2) X(0x33, "???", XXX, IMP, 8) X(0x34, "???", NOP, IMP, 4) X(0x35, "AND", AND, ZPX, 4) X(0x36, "ROL", ROL, ZPX, 6) X(0x37, "???", XXX, IMP, 6) X(0x38, "SEC", SEC, IMP, 2) X(0x39, "AND", AND, ABY, 4) X(0x3A, "???", NOP, IMP, 2) X(0x3B, "???", XXX, IMP, 7) X(0x3C, "???", NOP, IMP, 4) X(0x3D, "AND", AND, ABX, 4) X(0x3E, "ROL", ROL, ABX, 7) X(0x3F, "???", XXX, IMP, 7) \
+    X(0x40, "RTI", RTI, IMP, 6) X(0x41, "EOR", EOR, IZX, 6) X(0x42, "???", XXX, IMP, 2) X(0x43, "???", XXX, IMP, 8) X(0x44, "???", NOP, IMP, 3) X(0x45, "EOR", EOR, ZP0, 3) X(0x46, "LSR", LSR, ZP0, 5) X(0x47, "???", XXX, IMP, 5) X(0x48, "PHA", PHA, IMP, 3) X(0x49, "EOR", EOR, IMM, 2) X(0x4A, "LSR", LSR, IMP, 2) X(0x4B, "???", XXX, IMP, 2) X(0x4C, "JMP", JMP, ABS, 3) X(0x4D, "EOR", EOR, ABS, 4) X(0x4E, "LSR", LSR, ABS, 6) X(0x4F, "???", XXX, IMP, 6) \
+    X(0x50, "BVC", BVC, REL, 2) X(0x51, "EOR", EOR, IZY, 5) X(0x52, "???", XXX, IMP, 2) X(0x53, "???", XXX, IMP, 8) X(0x54, "???", NOP, IMP, 4) X(0x55, "EOR", EOR, ZPX, 4) X(0x56, "LSR", LSR, ZPX, 6) X(0x57, "???", XXX, IMP, 6) X(0x58, "CLI", CLI, IMP, 2) X(0x59, "EOR", EOR, ABY, 4) X(0x5A, "???", NOP, IMP, 2) X(0x5B, "???", XXX, IMP, 7) X(0x5C, "???", NOP, IMP, 4) X(0x5D, "EOR", EOR, ABX, 4) X(0x5E, "LSR", LSR, ABX, 7) X(0x5F, "???", XXX, IMP, 7) \
+    X(0x60, "RTS", RTS, IMP, 6) X(0x61, "ADC", ADC, IZX, 6) X(0x62, "???", XXX, IMP, 2) X(0x63, "???", XXX, IMP, 8) X(0x64, "???", NOP, IMP, 3) X(0x65, "ADC", ADC, ZP0, 3) X(0x66, "ROR", ROR, ZP0, 5) X(0x67, "???", XXX, IMP, 5) X(0x68, "PLA", PLA, IMP, 4) X(0x69, "ADC", ADC, IMM, 2) X(0x6A, "ROR", ROR, IMP, 2) X(0x6B, "???", XXX, IMP, 2) X(0x6C, "JMP", JMP, IND, 5) X(0x6D, "ADC", ADC, ABS, 4) X(0x6E, "ROR", ROR, ABS, 6) X(0x6F, "???", XXX, IMP, 6) \
+    X(0x70, "BVS", BVS, REL, 2) X(0x71, "ADC", ADC, IZY, 5) X(0x72, "???", XXX, IMP, 2) X(0x73, "???", XXX, IMP, 8) X(0x74, "???", NOP, IMP, 4) X(0x75, "ADC", ADC, ZPX, 4) X(0x76, "ROR", ROR, ZPX, 6) X(0x77, "???", XXX, IMP, 6) X(0x78, "SEI", SEI, IMP, 2) X(0x79, "ADC", ADC, ABY, 4) X(0x7A, "???", NOP, IMP, 2) X(0x7B, "???", XXX, IMP, 7) X(0x7C, "???", NOP, IMP, 4) X(0x7D, "ADC", ADC, ABX, 4) X(0x7E, "ROR", ROR, ABX, 7) X(0x7F, "???", XXX, IMP, 7) \
+    X(0x80, "???", NOP, IMP, 2) X(0x81, "STA", STA, IZX, 6) X(0x82, "???", NOP, IMP, 2) X(0x83, "???", XXX, IMP, 6) X(0x84, "STY", STY, ZP0, 3) X(0x85, "STA", STA, ZP0, 3) X(0x86, "STX", STX, ZP0, 3) X(0x87, "???", XXX, IMP, 3) X(0x88, "DEY", DEY, IMP, 2) X(0x89, "???", NOP, IMP, 2) X(0x8A, "TXA", TXA, IMP, 2) X(0x8B, "???", XXX, IMP, 2) X(0x8C, "STY", STY, ABS, 4) X(0x8D, "STA", STA, ABS, 4) X(0x8E, "STX", STX, ABS, 4) X(0x8F, "???", XXX, IMP, 4) \
+    X(0x90, "BCC", BCC, REL, 2) X(0x91, "STA", STA, IZY, 6) X(0x92, "???", XXX, IMP, 2) X(0x93, "???", XXX, IMP, 6) X(0x94, "STY", STY, ZPX, 4) X(0x95, "STA", STA, ZPX, 4) X(0x96, "STX", STX, ZPY, 4) X(0x97, "???", XXX, IMP, 4) X(0x98, "TYA", TYA, IMP, 2) X(0x99, "STA", STA, ABY, 5) X(0x9A, "TXS", TXS, IMP, 2) X(0x9B, "???", XXX, IMP, 5) X(0x9C, "???", NOP, IMP, 5) X(0x9D, "STA", STA, ABX, 5) X(0x9E, "???", XXX, IMP, 5) X(0x9F, "???", XXX, IMP, 5) \
+    X(0xA0, "LDY", LDY, IMM, 2) X(0xA1, "LDA", LDA, IZX, 6) X(0xA2, "LDX", LDX, IMM, 2) X(0xA3, "???", XXX, IMP, 6) X(0xA4, "LDY", LDY, ZP0, 3) X(0xA5, "LDA", LDA, ZP0, 3) X(0xA6, "LDX", LDX, ZP0, 3) X(0xA7, "???", XXX, IMP, 3) X(0xA8, "TAY", TAY, IMP, 2) X(0xA9, "LDA", LDA, IMM, 2) X(0xAA, "TAX", TAX, IMP, 2) X(0xAB, "???", XXX, IMP, 2) X(0xAC, "LDY", LDY, ABS, 4) X(0xAD, "LDA", LDA, ABS, 4) X(0xAE, "LDX", LDX, ABS, 4) X(0xAF, "???", XXX, IMP, 4) \
+    X(0xB0, "BCS", BCS, REL, 2) X(0xB1, "LDA", LDA, IZY, 5) X(0xB2, "???", XXX, IMP, 2) X(0xB3, "???", XXX, IMP, 5) X(0xB4, "LDY", LDY, ZPX, 4) X(0xB5, "LDA", LDA, ZPX, 4) X(0xB6, "LDX", LDX, ZPY, 4) X(0xB7, "???", XXX, IMP, 4) X(0xB8, "CLV", CLV, IMP, 2) X(0xB9, "LDA", LDA, ABY, 4) X(0xBA, "TSX", TSX, IMP, 2) X(0xBB, "???", XXX, IMP, 4) X(0xBC, "LDY", LDY, ABX, 4) X(0xBD, "LDA", LDA, ABX, 4) X(0xBE, "LDX", LDX, ABY, 4) X(0xBF, "???", XXX, IMP, 4) \
+    X(0xC0, "CPY", CPY, IMM, 2) X(0xC1, "CMP", CMP, IZX, 6) X(0xC2, "???", NOP, IMP, 2) X(0xC3, "???", XXX, IMP, 8) X(0xC4, "CPY", CPY, ZP0, 3) X(0xC5, "CMP", CMP, ZP0, 3) X(0xC6, "DEC", DEC, ZP0, 5) X(0xC7, "???", XXX, IMP, 5) X(0xC8, "INY", INY, IMP, 2) X(0xC9, "CMP", CMP, IMM, 2) X(0xCA, "DEX", DEX, IMP, 2) X(0xCB, "???", XXX, IMP, 2) X(0xCC, "CPY", CPY, ABS, 4) X(0xCD, "CMP", CMP, ABS, 4) X(0xCE, "DEC", DEC, ABS, 6) X(0xCF, "???", XXX, IMP, 6) \
+    X(0xD0, "BNE", BNE, REL, 2) X(0xD1, "CMP", CMP, IZY, 5) X(0xD2, "???", XXX, IMP, 2) X(0xD3, "???", XXX, IMP, 8) X(0xD4, "???", NOP, IMP, 4) X(0xD5, "CMP", CMP, ZPX, 4) X(0xD6, "DEC", DEC, ZPX, 6) X(0xD7, "???", XXX, IMP, 6) X(0xD8, "CLD", CLD, IMP, 2) X(0xD9, "CMP", CMP, ABY, 4) X(0xDA, "NOP", NOP, IMP, 2) X(0xDB, "???", XXX, IMP, 7) X(0xDC, "???", NOP, IMP, 4) X(0xDD, "CMP", CMP, ABX, 4) X(0xDE, "DEC", DEC, ABX, 7) X(0xDF, "???", XXX, IMP, 7) \
+    X(0xE0, "CPX", CPX, IMM, 2) X(0xE1, "SBC", SBC, IZX, 6) X(0xE2, "???", NOP, IMP, 2) X(0xE3, "???", XXX, IMP, 8) X(0xE4, "CPX", CPX, ZP0, 3) X(0xE5, "SBC", SBC, ZP0, 3) X(0xE6, "INC", INC, ZP0, 5) X(0xE7, "???", XXX, IMP, 5) X(0xE8, "INX", INX, IMP, 2) X(0xE9, "SBC", SBC, IMM, 2) X(0xEA, "NOP", NOP, IMP, 2) X(0xEB, "???", SBC, IMP, 2) X(0xEC, "CPX", CPX, ABS, 4) X(0xED, "SBC", SBC, ABS, 4) X(0xEE, "INC", INC, ABS, 6) X(0xEF, "???", XXX, IMP, 6) \
+    X(0xF0, "BEQ", BEQ, REL, 2) X(0xF1, "SBC", SBC, IZY, 5) X(0xF2, "???", XXX, IMP, 2) X(0xF3, "???", XXX, IMP, 8) X(0xF4, "???", NOP, IMP, 4) X(0xF5, "SBC", SBC, ZPX, 4) X(0xF6, "INC", INC, ZPX, 6) X(0xF7, "???", XXX, IMP, 6) X(0xF8, "SED", SED, IMP, 2) X(0xF9, "SBC", SBC, ABY, 4) X(0xFA, "NOP", NOP, IMP, 2) X(0xFB, "???", XXX, IMP, 7) X(0xFC, "???", NOP, IMP, 4) X(0xFD, "SBC", SBC, ABX, 4) X(0xFE, "INC", INC, ABX, 7) X(0xFF, "???", XXX, IMP, 7)
+
+/** @brief Operation index of an opcode. */
+enum class Mnemonic : byte {
+#define M(op) op,
+    NES_MNEMONICS(M)
+#undef M
+};
+
+/** @brief Addressing mode index of an opcode. */
+enum class AddrMode : byte {
+#define M(mode) mode,
+    NES_ADDRMODES(M)
+#undef M
+};
+
+/**
+ * @brief Packed metadata of one opcode.
+ *
+ * Four bytes per entry so that the whole table fits in 16 cache lines.
+ */
+struct OpInfo {
+    Mnemonic mnemonic;  // Operation performed
+    AddrMode addrmode;  // Addressing mode used to get the operand
+    byte cycles;        // Base number of cycles
+    byte flags;         // OP_PAGE_PENALTY | OP_ILLEGAL
+
+    constexpr bool pagePenalty() const { return flags & OP_PAGE_PENALTY; }
+    constexpr bool illegal() const { return flags & OP_ILLEGAL; }
+
+    static constexpr byte OP_PAGE_PENALTY = (1 << 0); // one more cycle when the operand crosses a page
+    static constexpr byte OP_ILLEGAL      = (1 << 1); // undocumented opcode
+};
+static_assert(sizeof(OpInfo) == 4, "OpInfo must stay packed");
+
+namespace op_table_detail {
+    // only the read instructions ask for the extra cycle of a page crossing
+    constexpr bool readsOperand(Mnemonic op) {
+        return op == Mnemonic::ADC || op == Mnemonic::AND || op == Mnemonic::CMP
+            || op == Mnemonic::EOR || op == Mnemonic::LDA || op == Mnemonic::LDX
+            || op == Mnemonic::LDY || op == Mnemonic::ORA || op == Mnemonic::SBC;
+    }
+
+    // and only the indexed modes can cross a page
+    constexpr bool canCrossPage(AddrMode mode) {
+        return mode == AddrMode::ABX || mode == AddrMode::ABY || mode == AddrMode::IZY;
+    }
+
+    constexpr byte flags(const char* name, Mnemonic op, AddrMode mode) {
+        return (readsOperand(op) && canCrossPage(mode) ? OpInfo::OP_PAGE_PENALTY : 0)
+             | (name[0] == '?' ? OpInfo::OP_ILLEGAL : 0);
+    }
+}
+
+/**
+ * @brief Opcode metadata, built at compile time and shared by every CPU.
+ */
+inline constexpr std::array<OpInfo, 256> OP_TABLE = {{
+#define X(code, name, op, mode, cyc) \
+    { Mnemonic::op, AddrMode::mode, cyc, op_table_detail::flags(name, Mnemonic::op, AddrMode::mode) },
+    NES_OP_TABLE(X)
+#undef X
+}};
+
+/**
+ * @brief Disassembly names, kept out of the hot table.
+ */
+const char* mnemonicName(Mnemonic op);
+const char* addrModeName(AddrMode mode);
+const char* opcodeName(byte opcode);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "nes_common.hpp"
+
+// Profiling counters are compiled in only when asked for (cmake -DNES_PROFILE=ON),
+// otherwise the CPU hooks are not even there.
+#ifndef NES_ENABLE_PROFILE
+#define NES_ENABLE_PROFILE 0
+#endif
+
+/**
+ * @class CpuProfile
+ * @brief Execution counters filled by a CPU it is attached to.
+ *
+ * Opcode counters are indexed like CPU::lookup; per addressing mode figures
+ * are summed from them on export. Page cross cycles are the extra cycles taken
+ * by ABX/ABY/IZY reads crossing a page, taken branches are not included.
+ */
+class CpuProfile {
+public:
+    CpuProfile() : pc_hits(0x10000, 0) {}
+
+    std::array<uint64_t, 256> executed = {};    // instructions run, by opcode
+    std::array<uint64_t, 256> cycles = {};      // cycles spent, by opcode
+    std::array<uint64_t, 256> page_cross = {};  // page cross penalty cycles, by opcode
+    std::vector<uint64_t> pc_hits;              // instructions started, by address
+
+    /** @brief Zeroes every counter. */
+    void clear();
+
+    uint64_t totalInstructions() const;
+    uint64_t totalCycles() const;
+
+    /** @brief The `count` most executed addresses, most executed first. */
+    std::vector<std::pair<h_word, uint64_t>> hottest(size_t count) const;
+
+    /**
+     * @brief Writes the counters as CSV rows of
+     * `table,key,name,mode,count,cycles,page_cross_cycles`, `table` being
+     * opcode, mode or pc (the `hot` most executed addresses).
+     *
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    void writeCsv(const std::string& path, size_t hot = 64) const;
+
+    /**
+     * @brief Writes the same figures as one JSON document.
+     *
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    void writeJson(const std::string& path, size_t hot = 64) const;
+};
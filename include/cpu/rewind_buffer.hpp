@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "nes_common.hpp"
+#include "save_state.hpp"
+
+class Bus;
+
+/**
+ * @class RewindBuffer
+ * @brief Rewind history made of dirty-page deltas.
+ *
+ * A checkpoint stores the CPU, PPU, APU, controller and mapper registers
+ * plus, for every RAM page (internal, cartridge, nametables or CHR-RAM)
+ * written since the previous checkpoint, the content that page had at the
+ * previous one (an undo record). A shadow copy of RAM at the latest
+ * checkpoint provides those pre-images, so a checkpoint costs O(dirty pages)
+ * in time and in memory.
+ *
+ * Records live in a ring of `budget` bytes; the oldest ones are dropped to
+ * make room, which only shortens how far back one can go.
+ */
+class RewindBuffer {
+public:
+    /**
+     * @param bus System to checkpoint, must outlive the buffer.
+     * @param budget Bytes of history to keep.
+     */
+    RewindBuffer(Bus& bus, size_t budget);
+
+    /** @brief Records the current state as the newest checkpoint. */
+    void checkpoint();
+
+    /**
+     * @brief Goes back in time.
+     *
+     * @param steps Checkpoints to go back past the newest one: 0 restores the
+     * newest checkpoint, 1 the one before, and so on. Checkpoints newer than
+     * the restored one are dropped.
+     * @return False if the history is not that deep.
+     */
+    bool rewind(size_t steps = 1);
+
+    /** @brief Number of checkpoints that can be restored. */
+    size_t depth() const { return records.size(); }
+
+    /** @brief Bytes of history in use, out of budget(). */
+    size_t usedBytes() const { return used; }
+    size_t budget() const { return arena.size(); }
+
+    /** @brief Bytes of undo entries the newest checkpoint took. */
+    size_t newestBytes() const { return records.empty() ? 0 : records.back().bytes; }
+
+    /** @brief Forgets the history. */
+    void clear();
+
+private:
+    static constexpr size_t PAGE_SIZE = 0x100;
+    static constexpr size_t ENTRY_SIZE = sizeof(uint16_t) + PAGE_SIZE; // slot, pre-image
+
+    struct Record {
+        CpuState cpu;       // registers at this checkpoint
+        MapperState mapper; // bank registers at this checkpoint
+        PpuState ppu;       // PPU registers, palette and OAM at this checkpoint
+        ApuState apu;       // APU channels and frame counter at this checkpoint
+        InputState input;   // controller shift registers at this checkpoint
+        size_t offset;      // start of the undo entries in the arena
+        size_t bytes;       // size of the undo entries
+        size_t pages;       // number of undo entries
+    };
+
+    Bus& bus;
+
+    std::vector<byte> arena;    // ring of undo entries
+    size_t head = 0;            // next free byte of the ring
+    size_t used = 0;
+    std::deque<Record> records; // oldest first
+
+    std::vector<byte> shadow;   // tracked RAM as of the newest checkpoint
+    size_t shadow_slots = 0;
+    std::vector<uint16_t> changed; // scratch, slots to record
+
+    size_t allocate(size_t bytes);
+    void dropOldest();
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "nes_common.hpp"
+
+/**
+ * @file save_state.hpp
+ * @brief Fixed layout snapshots of the emulated system.
+ *
+ * Every struct here is trivially copyable and padding free, so a snapshot is a
+ * single memcpy into a preallocated buffer. Fields are in host byte order: the
+ * format is meant for rewind and search within a build, not for interchange.
+ * Any change of layout must bump SaveState::VERSION.
+ */
+
+/** @brief Register file and in-flight helpers of the CPU. */
+struct CpuState {
+    uint64_t clock_count;
+    h_word pc;
+    h_word addr_abs;
+    h_word addr_rel;
+    byte a;
+    byte x;
+    byte y;
+    byte sp;
+    byte status;
+    byte fetched;
+    byte opcode;
+    byte cycles;
+    h_word stall;
+};
+static_assert(sizeof(CpuState) == 24, "CpuState layout must stay fixed");
+
+/** @brief Bank registers of the cartridge board. */
+struct MapperState {
+    static constexpr uint16_t NONE = 0xFFFF;    // no cartridge inserted
+    static constexpr size_t REGISTERS = 28;
+
+    uint16_t id;        // iNES mapper number, or NONE
+    byte irq;           // IRQ line held
+    byte reserved;
+    byte registers[REGISTERS];  // board specific
+};
+static_assert(sizeof(MapperState) == 32, "MapperState layout must stay fixed");
+
+/** @brief PPU registers, timing and on-chip memories. */
+struct PpuState {
+    uint64_t clock;     // dots since power on
+    uint64_t frames;
+    h_word line;
+    h_word dot;
+    h_word v;           // current VRAM address
+    h_word t;           // temporary VRAM address
+    h_word sprite_zero; // dot of this line's sprite 0 hit, 0 if none
+    byte fine_x;
+    byte w;             // second write toggle
+    byte ctrl;
+    byte mask;
+    byte status;
+    byte oam_addr;
+    byte buffer;        // $2007 read buffer
+    byte odd;
+    byte nmi;           // NMI raised, not yet taken
+    byte reserved[5];
+    byte palette[32];
+    byte oam[256];
+};
+static_assert(sizeof(PpuState) == 328, "PpuState layout must stay fixed");
+
+/** @brief Standard controllers: shift registers and strobe, not the buttons held. */
+struct InputState {
+    byte shift[2];      // $4016, $4017
+    byte strobe;
+    byte reserved[5];
+};
+static_assert(sizeof(InputState) == 8, "InputState layout must stay fixed");
+
+/** @brief One of the two APU pulse channels. */
+struct PulseState {
+    h_word period;
+    h_word timer;       // cycles to the next sequencer step
+    byte control;       // $4000 as written: duty, halt, constant volume, volume
+    byte sweep;         // $4001 as written
+    byte length;
+    byte sequence;
+    byte envelope[3];   // start flag, divider, decay level
+    byte sweep_divider;
+    byte sweep_reload;
+    byte reserved[3];
+};
+static_assert(sizeof(PulseState) == 16, "PulseState layout must stay fixed");
+
+/** @brief APU triangle channel. */
+struct TriangleState {
+    h_word period;
+    h_word timer;
+    byte control;       // $4008 as written: halt, linear counter reload
+    byte linear;
+    byte reload;        // linear counter reload flag
+    byte length;
+    byte sequence;
+    byte reserved[7];
+};
+static_assert(sizeof(TriangleState) == 16, "TriangleState layout must stay fixed");
+
+/** @brief APU noise channel. */
+struct NoiseState {
+    h_word shift;       // 15 bit feedback register
+    h_word timer;
+    byte control;       // $400C as written
+    byte mode;          // $400E as written
+    byte length;
+    byte envelope[3];
+    byte reserved[6];
+};
+static_assert(sizeof(NoiseState) == 16, "NoiseState layout must stay fixed");
+
+/** @brief APU delta modulation channel. */
+struct DmcState {
+    h_word address;     // next sample byte
+    h_word remaining;   // sample bytes left to fetch
+    h_word timer;
+    byte control;       // $4010 as written
+    byte level;
+    byte start;         // $4012 as written
+    byte size;          // $4013 as written
+    byte buffer;
+    byte full;          // sample buffer holds a byte
+    byte shift;
+    byte bits;          // bits left in the shift register
+    byte silence;
+    byte irq;
+};
+static_assert(sizeof(DmcState) == 16, "DmcState layout must stay fixed");
+
+/** @brief APU channels and frame counter. */
+struct ApuState {
+    uint64_t clock;         // CPU cycles run since power on
+    uint32_t frame_timer;   // cycles to the next frame counter step
+    byte frame_control;     // $4017 as written
+    byte frame_step;
+    byte frame_irq;
+    byte enabled;           // $4015 channel enables
+    PulseState pulse[2];
+    TriangleState triangle;
+    NoiseState noise;
+    DmcState dmc;
+};
+static_assert(sizeof(ApuState) == 96, "ApuState layout must stay fixed");
+
+/** @brief Whole system snapshot. */
+struct SaveState {
+    static constexpr uint32_t MAGIC = 0x5353454E; // "NESS"
+    static constexpr uint32_t VERSION = 5;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // sizeof(SaveState), catches mismatched builds
+    uint32_t reserved;
+    CpuState cpu;
+    MapperState mapper;
+    PpuState ppu;
+    InputState input;
+    ApuState apu;
+    byte ram[CPU_RAM_SIZE];
+    byte cart_ram[CART_RAM_SIZE];   // PRG-RAM at $6000, zero without any
+    byte vram[PPU_VRAM_SIZE];
+    byte chr_ram[CHR_RAM_SIZE];     // zero on CHR ROM boards
+};
+static_assert(std::is_trivially_copyable<SaveState>::value, "SaveState must be memcpy-able");
+static_assert(sizeof(SaveState) == 16 + sizeof(CpuState) + sizeof(MapperState) + sizeof(PpuState) + sizeof(InputState)
+    + sizeof(ApuState) + CPU_RAM_SIZE + CART_RAM_SIZE + PPU_VRAM_SIZE + CHR_RAM_SIZE,
+    "SaveState must have no padding");
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "nes_common.hpp"
+
+/**
+ * @brief Called when a scheduled event comes due.
+ *
+ * @param device The device registered with the event.
+ * @param time Timestamp the event was scheduled for.
+ */
+using EventHandler = void (*)(void* device, uint64_t time);
+
+/**
+ * @class Scheduler
+ * @brief Deadlines of the devices, on the master timestamp (CPU cycles since
+ * power on).
+ *
+ * Devices register their kinds of event once, then (re)schedule or cancel
+ * them whenever their registers change; each kind is pending at most once.
+ * The pending ones are kept in a binary min-heap indexed by event, so the bus
+ * can let the CPU run uninterrupted up to next() and only then call
+ * runDue(). Ties fire in registration order, which keeps runs reproducible.
+ * Nothing is allocated after construction.
+ */
+class Scheduler {
+public:
+    static constexpr size_t MAX_EVENTS = 16;
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    /**
+     * @brief Registers a kind of event.
+     *
+     * @return Its id, for schedule() and cancel().
+     * @throws std::length_error past MAX_EVENTS.
+     */
+    size_t add(EventHandler handler, void* device);
+
+    /** @brief Makes `event` due at `time`, replacing its pending deadline. */
+    void schedule(size_t event, uint64_t time);
+
+    void cancel(size_t event);
+
+    /** @brief Deadline of `event`, NEVER if it is not pending. */
+    uint64_t deadline(size_t event) const;
+
+    /** @brief Earliest pending deadline, NEVER if none. */
+    uint64_t next() const { return count ? events[heap[0]].time : NEVER; }
+
+    /**
+     * @brief Fires, earliest first, every event due at `now`. Handlers may
+     * schedule again, events they make due at `now` fire too.
+     */
+    void runDue(uint64_t now) {
+        while (count && events[heap[0]].time <= now)
+            fireFirst();
+    }
+
+private:
+    static constexpr byte NOT_PENDING = 0xFF;
+
+    struct Event {
+        uint64_t time = NEVER;
+        EventHandler handler = nullptr;
+        void* device = nullptr;
+        byte position = NOT_PENDING;    // in the heap
+    };
+
+    std::array<Event, MAX_EVENTS> events;
+    size_t registered = 0;
+    std::array<byte, MAX_EVENTS> heap{};    // event ids, earliest first
+    size_t count = 0;
+
+    bool before(byte a, byte b) const {
+        return events[a].time < events[b].time || (events[a].time == events[b].time && a < b);
+    }
+    void place(size_t position, byte event);
+    void siftUp(size_t position);
+    void siftDown(size_t position);
+    void remove(size_t position);
+    void fireFirst();
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nes_common.hpp"
+
+// Instruction tracing is compiled in only when asked for (cmake -DNES_TRACE=ON),
+// otherwise the CPU hook is not even there.
+#ifndef NES_ENABLE_TRACE
+#define NES_ENABLE_TRACE 0
+#endif
+
+/**
+ * @brief CPU state at the start of one instruction.
+ *
+ * Fixed size, host byte order, written as is to trace files.
+ */
+struct TraceRecord {
+    uint64_t cycle;     // CPU cycles elapsed before the instruction
+    h_word pc;
+    byte opcode;
+    byte a;
+    byte x;
+    byte y;
+    byte sp;
+    byte status;
+};
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord must stay 16 bytes");
+
+/** @brief Header of a trace file, followed by the records. */
+struct TraceHeader {
+    static constexpr uint32_t MAGIC = 0x5453454E; // "NEST"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+/**
+ * @class TraceWriter
+ * @brief Streams trace records to disk in chunks.
+ *
+ * The CPU fills a chunk in memory; a full chunk is handed to a background
+ * thread that writes it, and the CPU goes on with a recycled one. When the disk
+ * falls behind, more chunks are allocated rather than stalling emulation.
+ */
+class TraceWriter {
+public:
+    static constexpr size_t CHUNK_RECORDS = 1 << 16; // 1MB per chunk
+
+    /** @throws std::runtime_error if the file cannot be created. */
+    explicit TraceWriter(const std::string& path);
+
+    /** @brief Writes what is left and closes the file. */
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    void record(const TraceRecord& record) {
+        *cursor++ = record;
+        if (cursor == end)
+            submit();
+    }
+
+    /** @brief Blocks until every record so far is on disk. */
+    void flush();
+
+    /** @brief Records written so far, on disk or not. */
+    uint64_t count() const { return submitted + (cursor - current.get()); }
+
+private:
+    using Records = std::unique_ptr<TraceRecord[]>;
+
+    struct Chunk {
+        Records records;
+        size_t size;
+    };
+
+    std::FILE* file = nullptr;
+
+    Records current;
+    TraceRecord* cursor = nullptr;
+    TraceRecord* end = nullptr;
+    uint64_t submitted = 0;
+
+    std::mutex lock;
+    std::condition_variable ready;      // a chunk to write, or stopping
+    std::condition_variable drained;    // the queue went empty
+    std::deque<Chunk> queue;
+    std::vector<Records> spare;
+    bool writing = false;
+    bool stopping = false;
+    std::thread writer;
+
+    void submit();
+    void writerLoop();
+};
+
+/**
+ * @brief Reads a whole trace file.
+ *
+ * @throws std::runtime_error if the file is missing or not a trace.
+ */
+std::vector<TraceRecord> readTrace(const std::string& path);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cartridge.hpp"
+#include "nes_common.hpp"
+#include "profile.hpp"
+#include "thread_pool.hpp"
+
+/** @brief One system to emulate in a batch. */
+struct BatchInstance {
+    std::shared_ptr<const CartridgeImage> rom;  // its mapper must be supported
+    uint64_t cycles = 0;    // CPU cycles to run
+    CpuProfile* profile = nullptr;  // counters to fill, NES_PROFILE builds only
+};
+
+/** @brief Measurements of one instance. */
+struct InstanceReport {
+    std::string rom;
+    uint64_t cycles = 0;    // CPU cycles actually run
+    double seconds = 0.0;   // time spent emulating, not waiting in the queue
+    int worker = -1;        // worker that ran the last slice
+
+    double cyclesPerSecond() const { return seconds > 0.0 ? cycles / seconds : 0.0; }
+};
+
+/** @brief Measurements of a whole batch. */
+struct BatchReport {
+    std::vector<InstanceReport> instances;
+    double wall_seconds = 0.0;
+    size_t threads = 0;
+
+    uint64_t totalCycles() const;
+
+    /** @brief Aggregate emulated cycles per wall clock second. */
+    double cyclesPerSecond() const { return wall_seconds > 0.0 ? totalCycles() / wall_seconds : 0.0; }
+};
+
+/**
+ * @class BatchRunner
+ * @brief Runs many independent headless systems on a work-stealing pool.
+ *
+ * Each instance gets its own Bus/CPU and mapper; PRG banks are mapped
+ * read-only from the shared CartridgeImage so N instances of a ROM cost one
+ * copy of it. Instances
+ * run in slices of `slice_cycles` and reschedule themselves, which lets idle
+ * workers steal the remaining slices of long runs.
+ */
+class BatchRunner {
+public:
+    static constexpr uint64_t DEFAULT_SLICE = 1789773 / 60; // about one NTSC frame
+
+    explicit BatchRunner(unsigned threads = 0) : pool(threads) {}
+
+    BatchReport run(const std::vector<BatchInstance>& instances, uint64_t slice_cycles = DEFAULT_SLICE);
+
+    size_t threads() const { return pool.size(); }
+
+private:
+    ThreadPool pool;
+};
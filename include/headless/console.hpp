@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "bus.hpp"
+#include "nes_common.hpp"
+#include "output_ring.hpp"
+#include "ppu.hpp"
+#include "save_state.hpp"
+
+class Movie;
+
+/** @brief A completed frame, rendered in place by the PPU. */
+struct VideoFrame {
+    uint64_t number = 0;        // PPU frame count, 1 for the first frame
+    uint64_t timestamp = 0;     // CPU cycle its vblank started on
+    alignas(64) std::array<byte, PPU::WIDTH * PPU::HEIGHT> pixels{};   // palette indices
+};
+
+/** @brief A block of mono samples, filled in place by the APU. */
+struct AudioBlock {
+    static constexpr size_t CAPACITY = 2048;    // more than a frame at 96kHz
+
+    uint64_t frame = 0;         // video frame the samples go with
+    uint32_t rate = 0;          // samples per second
+    uint32_t count = 0;         // samples used
+    alignas(64) std::array<int16_t, CAPACITY> samples{};
+};
+
+/** @brief Sizes and policy of the output rings of a Console. */
+struct OutputConfig {
+    size_t video_frames = 4;
+    size_t audio_blocks = 8;
+    Backpressure backpressure = Backpressure::Drop;
+};
+
+/**
+ * @class Console
+ * @brief A whole system, its Bus and the output rings its frames and audio
+ * are published to, for headless pipelines (encoders, preprocessing).
+ *
+ * The PPU renders each frame straight into a slot of the video ring and the
+ * slot is published on vblank, so a consumer thread reads the pixels where
+ * they were drawn. The emulation thread is the producer of both rings; when
+ * the consumer is a whole ring behind, it either skips frames (rendering
+ * them into a scratch buffer) or waits, as configured; when it waits, both
+ * rings have to be drained. Every buffer is allocated by the constructor.
+ *
+ * Run-ahead cuts the input latency of games that react a few frames late:
+ * after each real frame the console snapshots itself, emulates a few frames
+ * further with the same input, shows the last one and restores the
+ * snapshot. The snapshot is a SaveState kept in the console, so the system
+ * is never copied as objects. The APU makes no samples for the frames run
+ * ahead, only the real ones are heard.
+ */
+class Console {
+public:
+    explicit Console(const OutputConfig& config = OutputConfig());
+    ~Console();
+
+    // the PPU renders into the rings of this very object
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    Bus& getBus() { return bus; }
+
+    /**
+     * @brief Runs until `count` more frames have been completed (and
+     * published or dropped).
+     *
+     * @return The number of CPU cycles run, not counting run-ahead.
+     */
+    uint64_t runFrames(uint64_t count);
+
+    /**
+     * @brief Records the controller input of every frame runFrames() runs
+     * into `movie`, nullptr to stop. Start right after the reset for the
+     * movie to replay.
+     */
+    void record(Movie* movie) { recording = movie; }
+
+    /**
+     * @brief Shows every frame as it will be `frames` frames later if the
+     * input stays the same, 0 to show the real frames.
+     *
+     * The frames shown carry the number and timestamp of the frame emulated
+     * ahead; each costs `frames` more frames of emulation and a snapshot
+     * save and restore.
+     */
+    void setRunAhead(unsigned frames) { run_ahead = frames; }
+    unsigned runAhead() const { return run_ahead; }
+
+    /** @brief Completed frames, read by the consumer. */
+    OutputRing<VideoFrame>& video() { return video_ring; }
+
+    /**
+     * @brief Sample blocks, one per frame, filled in place by the APU on the
+     * emulation thread and read by the consumer.
+     */
+    OutputRing<AudioBlock>& audio() { return audio_ring; }
+
+    /** @brief Frames rendered while the video ring was full, never published. */
+    uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+
+    /** @brief Sample blocks made while the audio ring was full, never published. */
+    uint64_t droppedAudio() const { return dropped_audio.load(std::memory_order_relaxed); }
+
+    /** @brief Closes both rings: consumers drain them, the producer stops waiting. */
+    void closeOutputs();
+
+private:
+    Bus bus;
+
+    OutputRing<VideoFrame> video_ring;
+    OutputRing<AudioBlock> audio_ring;
+
+    Movie* recording = nullptr;
+    unsigned run_ahead = 0;
+    SaveState snapshot;             // real frame under run-ahead
+    uint64_t hidden = 0;            // frames to complete without showing them
+
+    VideoFrame* rendering = nullptr;    // slot the PPU renders into, nullptr when dropping
+    std::array<byte, PPU::WIDTH * PPU::HEIGHT> scratch{};  // frames nobody will see
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> dropped_audio{0};
+
+    /** @brief Publishes the frame the PPU completed and picks the next slot. */
+    static byte* onFrame(void* device, byte* frame);
+
+    byte* nextBuffer();
+
+    /** @brief Moves the samples of the frame just run into the audio ring. */
+    void publishAudio();
+};
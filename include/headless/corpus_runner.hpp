@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "cartridge.hpp"
+#include "nes_common.hpp"
+#include "thread_pool.hpp"
+
+/** @brief Outcome of a test ROM. */
+enum class RomStatus {
+    Passed,     // final result code 0
+    Failed,     // final result code 1-$7F
+    Timeout,    // the cycle budget ran out first
+    Error,      // cannot be loaded or run
+};
+
+const char* romStatusName(RomStatus status);
+
+/** @brief One ROM of a corpus run. */
+struct RomResult {
+    std::string path;
+    uint64_t hash = 0;          // CartridgeImage::hash(), 0 if it did not load
+    RomStatus status = RomStatus::Error;
+    int code = -1;              // result code at $6000, -1 if none was reported
+    std::string message;        // text at $6004, or why it could not run
+    uint64_t cycles = 0;        // CPU cycles run
+    double seconds = 0.0;       // time spent on it, of the run that made it if cached
+    bool cached = false;        // taken from the ResultCache, not run
+};
+
+/** @brief Results of a whole corpus, in the order the ROMs were given. */
+struct CorpusReport {
+    std::vector<RomResult> results;
+    std::string build_id;
+    uint64_t cycles = 0;        // budget of each ROM
+    double wall_seconds = 0.0;
+    size_t threads = 0;
+
+    size_t count(RomStatus status) const;
+    size_t cachedCount() const;
+
+    /** @brief All passed, and there is at least one. */
+    bool passed() const { return !results.empty() && count(RomStatus::Passed) == results.size(); }
+
+    /**
+     * @brief Writes a JUnit XML report: a test case per ROM, named after
+     * the file and classed by its directory, with its time.
+     *
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    void writeJUnit(const std::string& path) const;
+
+    /**
+     * @brief Writes the same results as one JSON document.
+     *
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    void writeJson(const std::string& path) const;
+};
+
+/**
+ * @class ResultCache
+ * @brief Results of earlier runs, keyed by ROM hash, emulator build id and
+ * cycle budget, so a corpus run only runs the ROMs or builds that changed.
+ *
+ * The file is text, one result per line. Only results of the build id the
+ * cache was opened with are kept: saving drops the others.
+ */
+class ResultCache {
+public:
+    explicit ResultCache(std::string build_id) : build(std::move(build_id)) {}
+
+    const std::string& buildId() const { return build; }
+
+    /**
+     * @brief Reads the results of this build from a cache file. A missing
+     * file is an empty cache, malformed lines are skipped.
+     */
+    void load(const std::string& path);
+
+    /**
+     * @brief Writes every result of this build.
+     *
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void save(const std::string& path) const;
+
+    /** @brief Result of a ROM run with this budget, nullptr if there is none. */
+    const RomResult* find(uint64_t hash, uint64_t cycles) const;
+
+    /** @brief Keeps a result, errors excepted: nothing ran to give one. */
+    void store(const RomResult& result, uint64_t cycles);
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Key {
+        uint64_t hash;
+        uint64_t cycles;
+        bool operator==(const Key& other) const { return hash == other.hash && cycles == other.cycles; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash ^ (key.cycles * 0x9E3779B97F4A7C15ull)); }
+    };
+
+    std::string build;
+    std::unordered_map<Key, RomResult, KeyHash> entries;
+};
+
+/**
+ * @class CorpusRunner
+ * @brief Runs a corpus of test ROMs headless on a work-stealing pool and
+ * reads their verdict out of cartridge RAM.
+ *
+ * The ROMs report the way blargg's tests do: $6001-$6003 hold DE B0 61 once
+ * $6000 is valid; $6000 is $80 while running, $81 when the reset button
+ * must be pressed (at least 100ms later), otherwise the final result code,
+ * 0 for a pass; $6004 on is a zero terminated text. Each ROM runs in
+ * slices of a frame like BatchRunner instances, and is checked after every
+ * slice until it reports or its cycle budget runs out. ROMs the cache
+ * already has a result for are not run at all.
+ */
+class CorpusRunner {
+public:
+    static constexpr h_word STATUS = 0x6000;
+    static constexpr h_word SIGNATURE = 0x6001;
+    static constexpr h_word TEXT = 0x6004;
+    static constexpr byte RUNNING = 0x80;
+    static constexpr byte NEEDS_RESET = 0x81;
+    static constexpr uint64_t RESET_DELAY = 1789773 / 10;  // 100ms
+    static constexpr uint64_t SLICE = 1789773 / 60;        // about one NTSC frame
+
+    explicit CorpusRunner(unsigned threads = 0) : pool(threads) {}
+
+    /**
+     * @param paths ROM files, loaded through CartridgeImage::load().
+     * @param cycles CPU cycle budget of each ROM.
+     * @param cache Results to reuse, and to fill with the new ones; may be nullptr.
+     */
+    CorpusReport run(const std::vector<std::string>& paths, uint64_t cycles, ResultCache* cache = nullptr);
+
+    size_t threads() const { return pool.size(); }
+
+private:
+    ThreadPool pool;
+};
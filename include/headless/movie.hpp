@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cartridge.hpp"
+#include "nes_common.hpp"
+
+/** @brief Header of a movie file, followed by its MovieEvent records. */
+struct MovieHeader {
+    static constexpr uint32_t MAGIC = 0x4D53454E;   // "NESM"
+    static constexpr uint32_t VERSION = 2;     // 2: the ROM hash covers the header
+    static constexpr uint32_t HAS_STATE_HASH = 0x01;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t rom_hash;      // CartridgeImage::hash() of the cartridge
+    uint64_t frames;        // length of the movie
+    uint64_t state_hash;    // Bus::stateHash() after the last frame
+    uint32_t flags;
+    uint32_t events;        // number of records that follow
+};
+static_assert(sizeof(MovieHeader) == 40, "MovieHeader layout must stay fixed");
+
+/** @brief Buttons held on both controllers from `frame` on, until the next record. */
+struct MovieEvent {
+    uint32_t frame;
+    byte buttons[2];
+    byte reserved[2];
+};
+static_assert(sizeof(MovieEvent) == 8, "MovieEvent layout must stay fixed");
+
+/**
+ * @class Movie
+ * @brief Controller input of a session, frame by frame, from power on.
+ *
+ * Frame `n` is the `n`-th frame run after the cartridge is inserted and the
+ * system reset; its input is set before it starts. Only changes of input
+ * are stored, one 8 byte record each, so a movie of an hour of play is a
+ * few kilobytes. Fields are in host byte order, like save states.
+ *
+ * A movie may end with the hash of the system state after its last frame:
+ * replaying it must end in the very same state, which makes it a
+ * regression check of the whole emulator.
+ */
+class Movie {
+public:
+    Movie() = default;
+
+    /** @brief Empty movie for a cartridge. */
+    explicit Movie(const CartridgeImage& rom) : rom_hash(rom.hash()) {}
+
+    /**
+     * @brief Reads a movie file.
+     *
+     * @throws std::runtime_error if it cannot be read or is malformed.
+     */
+    static Movie load(const std::string& path);
+
+    /**
+     * @brief Writes the movie to a file.
+     *
+     * @throws std::runtime_error if it cannot be written.
+     */
+    void save(const std::string& path) const;
+
+    /** @brief Appends a frame held with these buttons (or of BUTTON_*). */
+    void record(byte port0, byte port1);
+
+    /** @brief Buttons held on both controllers on `frame`. */
+    std::array<byte, 2> input(uint64_t frame) const;
+
+    uint64_t frames() const { return length; }
+    uint64_t cartridge() const { return rom_hash; }
+
+    /** @brief Number of input changes stored. */
+    size_t events() const { return changes.size(); }
+
+    /** @brief Expected state after the last frame, if recorded. */
+    bool hasStateHash() const { return has_state_hash; }
+    uint64_t stateHash() const { return state_hash; }
+    void setStateHash(uint64_t hash) { state_hash = hash; has_state_hash = true; }
+
+private:
+    uint64_t rom_hash = 0;
+    uint64_t length = 0;
+    uint64_t state_hash = 0;
+    bool has_state_hash = false;
+    std::vector<MovieEvent> changes;
+};
+
+/** @brief Outcome of a replay. */
+struct ReplayReport {
+    uint64_t frames = 0;
+    uint64_t cycles = 0;
+    double seconds = 0.0;
+    uint64_t state_hash = 0;    // Bus::stateHash() after the last frame
+
+    /** @brief Emulated time over wall clock time, at 60 frames per second. */
+    double speed() const { return seconds > 0.0 ? frames / 60.0988 / seconds : 0.0; }
+};
+
+/**
+ * @brief Replays a movie as fast as the host goes: no output, no pacing.
+ *
+ * @param render_from First frame whose pixels are drawn; the PPU skips
+ * drawing before it (PPU::setRenderSkip), which does not change the run.
+ * @throws std::runtime_error if the movie was recorded on another cartridge.
+ */
+ReplayReport replayMovie(const Movie& movie, std::shared_ptr<const CartridgeImage> rom,
+    uint64_t render_from = UINT64_MAX);
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "nes_common.hpp"
+
+/** @brief What a producer does when the consumer is a whole ring behind. */
+enum class Backpressure : byte {
+    Drop,   // acquire() fails, the producer skips its output
+    Block,  // wait for the consumer to release one
+};
+
+/**
+ * @class OutputRing
+ * @brief Lock-free single producer, single consumer ring of preallocated
+ * slots.
+ *
+ * Slots are allocated once, by the constructor. The producer fills a slot in
+ * place between acquire() and publish(), the consumer reads it in place
+ * between front() and release(): nothing is copied on the way, and the two
+ * sides only share a pair of counters. Slot `n` (publication order) lives at
+ * index `n % capacity()`.
+ *
+ * Exactly one thread may call the producer functions and one the consumer
+ * functions; close() may be called from either.
+ */
+template <typename Slot>
+class OutputRing {
+public:
+    /**
+     * @param capacity Number of slots, at least 1.
+     * @param mode What acquire() does when every slot is taken.
+     */
+    explicit OutputRing(size_t capacity, Backpressure mode = Backpressure::Drop)
+        : slots(new Slot[capacity ? capacity : 1]), count(capacity ? capacity : 1), mode(mode) {}
+
+    OutputRing(const OutputRing&) = delete;
+    OutputRing& operator=(const OutputRing&) = delete;
+
+    size_t capacity() const { return count; }
+
+    void setBackpressure(Backpressure backpressure) { mode.store(backpressure, std::memory_order_relaxed); }
+    Backpressure backpressure() const { return mode.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Producer: the next slot to fill, the one of publication number
+     * published(). Calling it again before publish() gives the same slot.
+     *
+     * @return nullptr if the ring is full and dropping, or closed.
+     */
+    Slot* acquire() {
+        uint64_t next = head.load(std::memory_order_relaxed);
+        unsigned spins = 0;
+        while (next - tail.load(std::memory_order_acquire) == count) {
+            if (closed.load(std::memory_order_relaxed))
+                return nullptr;
+            if (mode.load(std::memory_order_relaxed) == Backpressure::Drop)
+                return nullptr;
+            backoff(spins);
+        }
+        return &slots[next % count];
+    }
+
+    /** @brief Producer: makes the acquired slot visible to the consumer. */
+    void publish() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /**
+     * @brief Consumer: oldest published slot not yet released.
+     *
+     * @return nullptr if there is none.
+     */
+    const Slot* front() const {
+        uint64_t first = tail.load(std::memory_order_relaxed);
+        if (first == head.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[first % count];
+    }
+
+    /**
+     * @brief Consumer: front(), waiting for the producer to publish.
+     *
+     * @return nullptr once the ring is closed and drained.
+     */
+    const Slot* wait() const {
+        unsigned spins = 0;
+        for (;;) {
+            if (const Slot* slot = front())
+                return slot;
+            if (closed.load(std::memory_order_acquire))
+                return front();
+            backoff(spins);
+        }
+    }
+
+    /** @brief Consumer: hands the front slot back to the producer. */
+    void release() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /** @brief Wakes both sides for good: acquire() fails, wait() drains. */
+    void close() { closed.store(true, std::memory_order_release); }
+    bool isClosed() const { return closed.load(std::memory_order_acquire); }
+
+    /** @brief Slots published since construction. */
+    uint64_t published() const { return head.load(std::memory_order_acquire); }
+
+    /** @brief Published slots not yet released. */
+    size_t pending() const {
+        uint64_t first = tail.load(std::memory_order_acquire);
+        return static_cast<size_t>(head.load(std::memory_order_acquire) - first);
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t count;
+    std::atomic<Backpressure> mode;
+    std::atomic<bool> closed{false};
+
+    // each side writes its own counter only, on a line of its own
+    alignas(CACHE_LINE) std::atomic<uint64_t> head{0};  // publications
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail{0};  // releases
+
+    /** @brief Spins, then yields, then sleeps while the other side catches up. */
+    static void backoff(unsigned& spins) {
+        if (spins < 64) {
+            spins++;
+        } else if (spins < 256) {
+            spins++;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
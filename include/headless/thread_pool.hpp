@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Work-stealing pool for headless emulation jobs.
+ *
+ * Every worker owns a deque: it pushes and pops its own tasks at the back and
+ * steals from the front of the other deques when it runs dry, so long running
+ * instances that reschedule themselves in slices keep every core busy.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Starts the workers.
+     *
+     * @param threads Number of workers, 0 for one per hardware thread.
+     */
+    explicit ThreadPool(unsigned threads = 0);
+
+    /** @brief Waits for the queued tasks, then joins the workers. */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task.
+     *
+     * Called from a worker, the task goes on that worker's own deque (cheap
+     * rescheduling, good locality); otherwise queues are filled round robin.
+     */
+    void submit(Task task);
+
+    /** @brief Blocks until every submitted task, and what they submitted, is done. */
+    void wait();
+
+    /** @brief Number of workers. */
+    size_t size() const { return workers.size(); }
+
+    /** @brief Index of the calling worker, or -1 outside of the pool. */
+    static int currentWorker();
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;       // tasks available or stopping
+    std::condition_variable idle;       // pending dropped to 0
+    std::atomic<size_t> pending{0};     // submitted but not finished
+    std::atomic<size_t> next_queue{0};
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    bool popOrSteal(size_t index, Task& task);
+};
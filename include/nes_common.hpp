@@ -1,15 +1,51 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+// The SIMD kernels (PPU pixels, batched CPU) are compiled in unless asked not
+// to (cmake -DNES_SIMD=OFF), and only on x86 with a GNU compatible compiler.
+// AVX2 is picked at run time, the binary still runs on CPUs without it.
+#ifndef NES_ENABLE_SIMD
+#define NES_ENABLE_SIMD 1
+#endif
+
+#if NES_ENABLE_SIMD && (defined(__x86_64__) || defined(__SSE2__)) && defined(__GNUC__)
+#define NES_X86_SIMD 1
+#else
+#define NES_X86_SIMD 0
+#endif
+
 // Define redefine types
 using byte      = uint8_t;
 using h_word    = uint16_t;
 using word      = uint32_t;
 
+// FNV-1a, for state, ROM and frame hashes; chain calls through `hash`
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET) {
+    const byte* bytes = static_cast<const byte*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    return hash;
+}
+
 // Define bus widths
 const unsigned int DATA_WIDTH = 8;
 const unsigned int ADDRESS_WIDTH = 16;
 
 // Define bus regions
 const unsigned int BUS_RANGE = 0xFFFF; // 64KB
+
+// Internal RAM, mirrored up to CPU_RAM_END
+const unsigned int CPU_RAM_SIZE = 0x0800; // 2KB
+const unsigned int CPU_RAM_END = 0x1FFF;
+
+// Cartridge RAM window, $6000-$7FFF
+const unsigned int CART_RAM_START = 0x6000;
+const unsigned int CART_RAM_SIZE = 0x2000; // 8KB
+
+// PPU memory: nametable RAM (room for four screen boards) and CHR-RAM
+const unsigned int PPU_VRAM_SIZE = 0x1000; // 4KB
+const unsigned int CHR_RAM_SIZE = 0x2000; // 8KB
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "nes_common.hpp"
+#include "render.hpp"
+#include "save_state.hpp"
+
+class Mapper;
+class MemoryMap;
+
+/**
+ * @class PPU
+ * @brief 2C02 picture processor, run lazily by the bus.
+ *
+ * The PPU does not tick along with the CPU: it keeps its own dot clock (three
+ * dots per CPU cycle) and is only brought up to date by runTo() when the CPU
+ * touches its registers or when something it schedules comes due. Catching up
+ * jumps from one event of the line to the next instead of stepping dots:
+ *
+ * - dot 1 of a visible line renders the whole line (background, sprites) and
+ *   works out the dot of a sprite 0 hit, flagged when that dot is reached;
+ * - dots 257 and 260 apply the end of line scroll copy and clock the mapper
+ *   scanline counter; the pre-render line adds the vertical copy at 280 and
+ *   the odd frame short line;
+ * - dot 1 of line 241 starts vblank and raises NMI.
+ *
+ * Since every event happens at a fixed dot, whatever the steps runTo() is
+ * called with, catching up late gives the same result as ticking the PPU on
+ * every CPU cycle. The price is that mid-line writes take effect on the next
+ * line.
+ *
+ * The frame holds 6 bit palette indices, one byte per pixel. The pixel work
+ * of a line goes through SIMD kernels when the CPU has them (render.hpp).
+ * Lines go to the PPU's own buffer unless a frame handler hands it others,
+ * which lets frames be rendered straight into an output queue.
+ */
+class PPU {
+public:
+    static constexpr unsigned WIDTH = 256;
+    static constexpr unsigned HEIGHT = 240;
+    static constexpr unsigned DOTS_PER_LINE = 341;
+    static constexpr unsigned LINES = 262;
+    static constexpr h_word VBLANK_LINE = 241;
+    static constexpr h_word PRE_RENDER_LINE = 261;
+    static constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+    /**
+     * @brief Called on vblank start with the frame just rendered.
+     *
+     * @return The buffer (WIDTH x HEIGHT bytes) to render the next frame
+     * into, nullptr to keep the current one.
+     */
+    using FrameHandler = byte* (*)(void* device, byte* frame);
+
+    PPU();
+    ~PPU();
+
+    PPU(const PPU&) = delete;
+    PPU& operator=(const PPU&) = delete;
+
+    /** @brief Registers the nametables for dirty tracking in `memory`. */
+    void connect(MemoryMap& memory);
+
+    /** @brief Board providing CHR and mirroring, nullptr for none. */
+    void setCartridge(Mapper* mapper) { cart = mapper; }
+
+    /**
+     * @brief Picks the pixel kernels, the fastest supported ones by default.
+     *
+     * @return False, keeping the current ones, if this CPU or build cannot
+     * run them.
+     */
+    bool setRenderPath(RenderPath path);
+    RenderPath renderPath() const { return path; }
+
+    /**
+     * @brief Installs the handler told of every completed frame, nullptr to
+     * remove it and go back to the PPU's own buffer.
+     */
+    void setFrameHandler(FrameHandler handler, void* device);
+
+    /**
+     * @brief Renders from now on into `buffer` (WIDTH x HEIGHT bytes),
+     * nullptr for the PPU's own buffer.
+     */
+    void setFrameBuffer(byte* buffer) { target = buffer ? buffer : pixels.data(); }
+
+    /**
+     * @brief Stops drawing pixels, for runs nobody watches (replays). Only
+     * what the CPU can see of rendering is worked out, the sprite 0 hit and
+     * overflow, so the system goes on exactly as if it rendered; the frame
+     * buffer is left as it is.
+     */
+    void setRenderSkip(bool skip) { skip_pixels = skip; }
+    bool renderSkip() const { return skip_pixels; }
+
+    /** @brief Reset line: clears the registers, timing goes on. */
+    void reset();
+
+    /** @brief Catches up to `dot` dots since power on. */
+    void runTo(uint64_t dot);
+
+    /** @brief Dots run since power on. */
+    uint64_t dots() const { return clock; }
+
+    /**
+     * @brief Dot of the next vblank start, if it raises NMI. Never late,
+     * possibly a dot early.
+     *
+     * @return NO_EVENT if NMI is off.
+     */
+    uint64_t nextVblank() const;
+
+    /** @brief Dot of the next vblank start, whether it raises NMI or not. */
+    uint64_t nextFrame() const;
+
+    /**
+     * @brief Dot of the next mapper scanline clock. Never late, possibly
+     * early (a line end stands for the lines that may not clock it).
+     */
+    uint64_t nextScanline() const;
+
+    /** @brief CPU access to $2000-$2007 (and mirrors), caught up already. */
+    byte readRegister(h_word address, bool bReadOnly = false);
+    void writeRegister(h_word address, byte data);
+
+    /** @brief OAM DMA: 256 bytes from the CPU, starting at OAMADDR. */
+    void writeOam(const byte* data);
+
+    /** @brief NMI raised and not yet taken by the CPU. */
+    bool nmiPending() const { return nmi; }
+    void acknowledgeNmi() { nmi = false; }
+
+    /** @brief Palette indices of the last rendered lines, WIDTH x HEIGHT. */
+    const byte* frame() const { return target; }
+
+    /** @brief Number of vblanks started since power on. */
+    uint64_t frameCount() const { return frames; }
+
+    /** @brief Nametable RAM, PPU_VRAM_SIZE bytes. */
+    byte* vram() { return nametables.data(); }
+    const byte* vram() const { return nametables.data(); }
+
+    void saveState(PpuState& state) const;
+    void loadState(const PpuState& state);
+
+private:
+    Mapper* cart = nullptr;
+    MemoryMap* memory = nullptr;
+    const RenderKernels* kernels;
+    RenderPath path;
+    bool skip_pixels = false;
+    FrameHandler frame_handler = nullptr;
+    void* frame_device = nullptr;
+
+    // timing
+    uint64_t clock = 0;
+    uint64_t frames = 0;
+    h_word line = 0;
+    h_word dot = 0;
+    bool odd = false;
+
+    // registers, with the usual v/t/x/w scroll model
+    byte ctrl = 0x00;
+    byte mask = 0x00;
+    byte status = 0x00;
+    byte oam_addr = 0x00;
+    byte buffer = 0x00;
+    h_word v = 0x0000;
+    h_word t = 0x0000;
+    byte fine_x = 0x00;
+    bool w = false;
+    bool nmi = false;
+    h_word sprite_zero = 0;
+
+    std::array<byte, PPU_VRAM_SIZE> nametables{};
+    std::array<byte, 32> palette{};
+    std::array<byte, 256> oam{};
+    std::array<byte, WIDTH * HEIGHT> pixels{};
+    byte* target = pixels.data();  // frame being rendered
+    std::array<uint16_t, PPU_VRAM_SIZE / 0x100> slots{};
+
+    bool rendering() const { return mask & 0x18; }
+    h_word nextDot() const;
+    void event();
+    void newLine();
+    void renderLine();
+    bool skipLine();
+    void incrementY();
+
+    byte read(h_word address) const;
+    void write(h_word address, byte data);
+    size_t nametableOffset(h_word address) const;
+    static byte paletteIndex(h_word address);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "nes_common.hpp"
+
+/**
+ * @file render.hpp
+ * @brief Pixel kernels of the PPU scanline renderer.
+ *
+ * The PPU fetches the tiles of a line itself (those are memory reads through
+ * the mapper), the kernels do the per pixel work on whole lines: bitplane
+ * decoding, sprite merging, priority and palette lookup. Every path gives
+ * bit-identical lines.
+ *
+ * A decoded pixel is its 2 bit color in bits 0-1, its palette in bits 2-4 (4
+ * and up for sprites) and 0 when transparent. Sprite pixels also carry
+ * RENDER_BEHIND and RENDER_SPRITE_ZERO.
+ */
+
+const byte RENDER_BEHIND = 0x40;        // sprite behind the background
+const byte RENDER_SPRITE_ZERO = 0x80;   // pixel of OAM sprite 0
+
+enum class RenderPath : byte { Scalar, Sse2, Avx2 };
+
+struct RenderKernels {
+    /**
+     * @brief Decodes `count` tiles into 8 pixels each.
+     *
+     * @param lo, hi The bitplanes, leftmost pixel in bit 7.
+     * @param bits What opaque pixels of each tile are or-ed with (palette).
+     */
+    void (*decodeTiles)(const byte* lo, const byte* hi, const byte* bits, size_t count, byte* out);
+
+    /**
+     * @brief Lays one sprite row at `out` (8 pixels, the line is padded),
+     * where no sprite pixel is yet.
+     */
+    void (*mergeSprite)(byte lo, byte hi, byte bits, byte* out);
+
+    /**
+     * @brief Puts the sprites in front of or behind the background and looks
+     * the 256 pixels up in the 32 entry palette, masked with `grey`.
+     *
+     * @return 1 + the x of the first sprite 0 hit, 0 if none.
+     */
+    unsigned (*composite)(const byte* background, const byte* sprites, const byte* palette, byte grey, byte* out);
+};
+
+/** @brief Kernels of a path, the scalar ones if it is not supported. */
+const RenderKernels& renderKernels(RenderPath path);
+
+/** @brief True if this build has the path and this CPU can run it. */
+bool renderPathSupported(RenderPath path);
+
+/** @brief Fastest supported path. */
+RenderPath bestRenderPath();
+
+const char* renderPathName(RenderPath path);
@@ -0,0 +1,561 @@
+#include "apu.hpp"
+
+#include <algorithm>
+
+namespace {
+    const byte LENGTHS[32] = {
+        10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+        12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+    };
+
+    // pulse output of each sequencer step, bit n for step n
+    const byte DUTIES[4] = { 0x02, 0x06, 0x1E, 0xF9 };
+
+    // NTSC timer periods, in CPU cycles
+    const h_word NOISE_PERIODS[16] = {
+        4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+    };
+    const h_word DMC_PERIODS[16] = {
+        428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+    };
+
+    // frame counter steps from the start of the sequence, 4 and 5 step modes;
+    // the 4 step sequence restarts on the cycle after its last step
+    const uint32_t FRAME_STEPS[2][5] = {
+        { 7457, 14913, 22371, 29829, 0 },
+        { 7457, 14913, 22371, 29829, 37281 },
+    };
+    const uint32_t FRAME_PERIODS[2] = { 29830, 37282 };
+    const byte FRAME_STEP_COUNT[2] = { 4, 5 };
+
+    const byte FRAME_FIVE_STEP = 0x80;
+    const byte FRAME_IRQ_INHIBIT = 0x40;
+
+    // linear approximation of the mixer, full scale (every channel at its
+    // loudest) a bit under 28000
+    const int PULSE_GAIN = 246;
+    const int TRIANGLE_GAIN = 279;
+    const int NOISE_GAIN = 162;
+    const int DMC_GAIN = 110;
+
+    // the triangle is held below this period, its steps are ultrasonic
+    const h_word TRIANGLE_MIN_PERIOD = 2;
+
+    int triangleStep(byte sequence) {
+        return sequence < 16 ? 15 - sequence : sequence - 16;
+    }
+
+    int envelopeVolume(byte control, const byte* envelope) {
+        return (control & 0x10) ? control & 0x0F : envelope[2];
+    }
+
+    void clockEnvelope(byte control, byte* envelope) {
+        if (envelope[0]) {
+            envelope[0] = 0;
+            envelope[1] = control & 0x0F;
+            envelope[2] = 15;
+        } else if (envelope[1] == 0) {
+            envelope[1] = control & 0x0F;
+            if (envelope[2])
+                envelope[2]--;
+            else if (control & 0x20)
+                envelope[2] = 15;
+        } else {
+            envelope[1]--;
+        }
+    }
+
+    void clockLength(byte& length, bool halt) {
+        if (length && !halt)
+            length--;
+    }
+
+    int sweepTarget(const PulseState& p, bool second) {
+        int change = p.period >> (p.sweep & 0x07);
+        if (p.sweep & 0x08)
+            return p.period - change - (second ? 0 : 1);
+        return p.period + change;
+    }
+
+    // silenced by the sweep unit, whether it is enabled or not
+    bool sweepMuted(const PulseState& p, bool second) {
+        return p.period < 8 || sweepTarget(p, second) > 0x07FF;
+    }
+
+    // the noise shift register after `count` clocks; the bits a clock shifts
+    // in only depend on bits already there, so up to 15 - tap of them are
+    // worked out at once
+    h_word advanceNoise(h_word shift, uint64_t count, bool short_mode) {
+        unsigned tap = short_mode ? 6 : 1;
+        unsigned most = 15 - tap;
+        while (count) {
+            unsigned steps = static_cast<unsigned>(std::min<uint64_t>(count, most));
+            h_word feedback = (shift ^ (shift >> tap)) & ((1u << steps) - 1);
+            shift = static_cast<h_word>((shift >> steps) | (feedback << (15 - steps)));
+            count -= steps;
+        }
+        return shift;
+    }
+
+    // timer clocks from `next` up to (not including) `end`
+    uint64_t clocksBefore(uint64_t next, uint64_t end, uint64_t period) {
+        return next < end ? (end - next + period - 1) / period : 0;
+    }
+}
+
+APU::APU() {
+    pulse[1].second = true;
+    noise.shift = 1;
+    dmc.bits = 8;
+    dmc.silence = 1;
+    pulse[0].next = pulse[1].next = 2;
+    triangle.next = 1;
+    noise.next = NOISE_PERIODS[0];
+    dmc.next = DMC_PERIODS[0];
+    blip.setRates(CLOCK_RATE, SAMPLE_RATE);
+}
+
+void APU::setDmcReader(DmcReader reader, void* device) {
+    dmc_reader = reader;
+    dmc_device = device;
+}
+
+void APU::setSampleRate(uint32_t rate) {
+    blip.setRates(CLOCK_RATE, std::max<uint32_t>(rate, 1));
+    block_start = clock;
+    pulse[0].heard = pulse[1].heard = triangle.heard = noise.heard = dmc.heard = 0;
+    updateLevels(clock);
+}
+
+void APU::setOutputEnabled(bool enabled) {
+    if (enabled == output)
+        return;
+    output = enabled;
+    // the levels moved on unheard, the buffer hears the difference now
+    block_start = clock;
+    updateLevels(clock);
+}
+
+void APU::reset() {
+    writeRegister(0x4015, 0x00);
+    writeRegister(0x4017, frame_control);
+    frame_irq = false;
+    dmc.irq = 0;
+    dmc.level &= 0x01;
+    updateLevels(clock);
+}
+
+void APU::runTo(uint64_t cycle) {
+    while (clock < cycle) {
+        uint64_t end = std::min(cycle, nextFrameStep());
+        if (output) {
+            // nobody reads: keep the latest samples only
+            endBlock();
+            size_t keep = blip.capacity() / 2;
+            if (blip.available() > keep)
+                blip.read(nullptr, blip.available() - keep);
+            end = std::min<uint64_t>(end, clock + blip.maxBlock());
+        }
+        runChannels(end);
+        clock = end;
+        if (clock == nextFrameStep())
+            clockFrameCounter();
+    }
+    endBlock();
+}
+
+void APU::endBlock() {
+    if (output)
+        blip.endBlock(static_cast<uint32_t>(clock - block_start));
+    block_start = clock;
+}
+
+uint64_t APU::nextFrameStep() const {
+    return frame_start + FRAME_STEPS[(frame_control & FRAME_FIVE_STEP) ? 1 : 0][frame_step];
+}
+
+void APU::clockFrameCounter() {
+    size_t mode = (frame_control & FRAME_FIVE_STEP) ? 1 : 0;
+    switch (frame_step) {
+    case 0:
+    case 2:
+        quarterFrame();
+        break;
+    case 1:
+        quarterFrame();
+        halfFrame();
+        break;
+    case 3:
+        if (mode == 0) {
+            quarterFrame();
+            halfFrame();
+            if (!(frame_control & FRAME_IRQ_INHIBIT))
+                frame_irq = true;
+        }
+        break;
+    default:
+        quarterFrame();
+        halfFrame();
+        break;
+    }
+    if (++frame_step == FRAME_STEP_COUNT[mode]) {
+        frame_step = 0;
+        frame_start += FRAME_PERIODS[mode];
+    }
+    updateLevels(clock);
+}
+
+void APU::quarterFrame() {
+    clockEnvelope(pulse[0].control, pulse[0].envelope);
+    clockEnvelope(pulse[1].control, pulse[1].envelope);
+    clockEnvelope(noise.control, noise.envelope);
+
+    if (triangle.reload)
+        triangle.linear = triangle.control & 0x7F;
+    else if (triangle.linear)
+        triangle.linear--;
+    if (!(triangle.control & 0x80))
+        triangle.reload = 0;
+}
+
+void APU::halfFrame() {
+    for (Pulse& p : pulse) {
+        clockLength(p.length, p.control & 0x20);
+
+        if (p.sweep_divider == 0 && (p.sweep & 0x80) && (p.sweep & 0x07) && !sweepMuted(p, p.second))
+            p.period = static_cast<h_word>(sweepTarget(p, p.second));
+        if (p.sweep_divider == 0 || p.sweep_reload) {
+            p.sweep_divider = (p.sweep >> 4) & 0x07;
+            p.sweep_reload = 0;
+        } else {
+            p.sweep_divider--;
+        }
+    }
+    clockLength(triangle.length, triangle.control & 0x80);
+    clockLength(noise.length, noise.control & 0x20);
+}
+
+void APU::runChannels(uint64_t end) {
+    runPulse(pulse[0], end);
+    runPulse(pulse[1], end);
+    runTriangle(end);
+    runNoise(end);
+    runDmc(end);
+}
+
+void APU::runPulse(Pulse& p, uint64_t end) {
+    uint64_t period = (p.period + 1u) * 2u;
+    int volume = envelopeVolume(p.control, p.envelope);
+    if (!output || !p.length || !volume || sweepMuted(p, p.second)) {
+        // the level stays where it is, only the sequencer moves
+        uint64_t count = clocksBefore(p.next, end, period);
+        p.sequence = static_cast<byte>((p.sequence + count) & 0x07);
+        p.next += count * period;
+        return;
+    }
+    byte duty = DUTIES[p.control >> 6];
+    for (; p.next < end; p.next += period) {
+        p.sequence = (p.sequence + 1) & 0x07;
+        emit(p.heard, ((duty >> p.sequence) & 0x01) ? volume : 0, PULSE_GAIN, p.next);
+    }
+}
+
+void APU::runTriangle(uint64_t end) {
+    uint64_t period = triangle.period + 1u;
+    uint64_t count = clocksBefore(triangle.next, end, period);
+    if (!count)
+        return;
+    if (!triangle.length || !triangle.linear) {
+        // halted, the sequencer holds its step
+        triangle.next += count * period;
+        return;
+    }
+    if (!output || triangle.period < TRIANGLE_MIN_PERIOD) {
+        triangle.sequence = static_cast<byte>((triangle.sequence + count) & 0x1F);
+        triangle.next += count * period;
+        return;
+    }
+    for (; triangle.next < end; triangle.next += period) {
+        triangle.sequence = (triangle.sequence + 1) & 0x1F;
+        emit(triangle.heard, triangleStep(triangle.sequence), TRIANGLE_GAIN, triangle.next);
+    }
+}
+
+void APU::runNoise(uint64_t end) {
+    uint64_t period = NOISE_PERIODS[noise.mode & 0x0F];
+    bool short_mode = noise.mode & 0x80;
+    int volume = envelopeVolume(noise.control, noise.envelope);
+    if (!output || !noise.length || !volume) {
+        uint64_t count = clocksBefore(noise.next, end, period);
+        noise.shift = advanceNoise(noise.shift, count, short_mode);
+        noise.next += count * period;
+        return;
+    }
+    unsigned tap = short_mode ? 6 : 1;
+    for (; noise.next < end; noise.next += period) {
+        h_word feedback = (noise.shift ^ (noise.shift >> tap)) & 0x01;
+        noise.shift = static_cast<h_word>((noise.shift >> 1) | (feedback << 14));
+        int level = (noise.shift & 0x01) ? 0 : volume;
+        blip.addDeltaFast(static_cast<uint32_t>(noise.next - block_start), (level - noise.heard) * NOISE_GAIN);
+        noise.heard = level;
+    }
+}
+
+void APU::runDmc(uint64_t end) {
+    uint64_t period = DMC_PERIODS[dmc.control & 0x0F];
+    if (dmc.silence && !dmc.full) {
+        // nothing to play and nothing to fetch: only the bit counter turns
+        uint64_t count = clocksBefore(dmc.next, end, period);
+        dmc.bits = static_cast<byte>((dmc.bits - 1 + 8 - count % 8) % 8 + 1);
+        dmc.shift = count >= 8 ? 0 : static_cast<byte>(dmc.shift >> count);
+        dmc.next += count * period;
+        return;
+    }
+    for (; dmc.next < end; dmc.next += period) {
+        if (!dmc.silence) {
+            if (dmc.shift & 0x01) {
+                if (dmc.level <= 125)
+                    dmc.level += 2;
+            } else if (dmc.level >= 2) {
+                dmc.level -= 2;
+            }
+            emit(dmc.heard, dmc.level, DMC_GAIN, dmc.next);
+        }
+        dmc.shift >>= 1;
+        if (--dmc.bits == 0) {
+            dmc.bits = 8;
+            dmc.silence = !dmc.full;
+            if (dmc.full) {
+                dmc.shift = dmc.buffer;
+                dmc.full = 0;
+                fetchSample();
+            }
+        }
+    }
+}
+
+void APU::fetchSample() {
+    if (dmc.full || !dmc.remaining)
+        return;
+    dmc.buffer = dmc_reader ? dmc_reader(dmc_device, dmc.address) : 0x00;
+    dmc.full = 1;
+    dmc.address = dmc.address == 0xFFFF ? 0x8000 : static_cast<h_word>(dmc.address + 1);
+    if (--dmc.remaining == 0) {
+        if (dmc.control & 0x40)
+            restartSample();
+        else if (dmc.control & 0x80)
+            dmc.irq = 1;
+    }
+}
+
+void APU::restartSample() {
+    dmc.address = static_cast<h_word>(0xC000 | (dmc.start << 6));
+    dmc.remaining = static_cast<h_word>((dmc.size << 4) | 1);
+}
+
+uint64_t APU::nextEvent() const {
+    uint64_t next = NO_EVENT;
+    if (!(frame_control & (FRAME_FIVE_STEP | FRAME_IRQ_INHIBIT)) && !frame_irq)
+        next = frame_start + FRAME_STEPS[0][3] + 1;
+    // the buffer empties into the shift register on the last bit, and is
+    // refilled on the spot
+    if (dmc.full && dmc.remaining) {
+        uint64_t period = DMC_PERIODS[dmc.control & 0x0F];
+        next = std::min(next, dmc.next + (dmc.bits - 1) * period + 1);
+    }
+    return next;
+}
+
+byte APU::readStatus(bool bReadOnly) {
+    byte status = 0x00;
+    if (pulse[0].length)
+        status |= 0x01;
+    if (pulse[1].length)
+        status |= 0x02;
+    if (triangle.length)
+        status |= 0x04;
+    if (noise.length)
+        status |= 0x08;
+    if (dmc.remaining)
+        status |= 0x10;
+    if (frame_irq)
+        status |= 0x40;
+    if (dmc.irq)
+        status |= 0x80;
+    if (!bReadOnly)
+        frame_irq = false;
+    return status;
+}
+
+void APU::writeRegister(h_word address, byte data) {
+    if (address <= 0x4007) {
+        Pulse& p = pulse[(address >> 2) & 0x01];
+        switch (address & 0x03) {
+        case 0:
+            p.control = data;
+            break;
+        case 1:
+            p.sweep = data;
+            p.sweep_reload = 1;
+            break;
+        case 2:
+            p.period = static_cast<h_word>((p.period & 0x0700) | data);
+            break;
+        default:
+            p.period = static_cast<h_word>((p.period & 0x00FF) | ((data & 0x07) << 8));
+            if (enabled & (address < 0x4004 ? 0x01 : 0x02))
+                p.length = LENGTHS[data >> 3];
+            p.sequence = 0;
+            p.envelope[0] = 1;
+            break;
+        }
+    } else {
+        switch (address) {
+        case 0x4008:
+            triangle.control = data;
+            break;
+        case 0x400A:
+            triangle.period = static_cast<h_word>((triangle.period & 0x0700) | data);
+            break;
+        case 0x400B:
+            triangle.period = static_cast<h_word>((triangle.period & 0x00FF) | ((data & 0x07) << 8));
+            if (enabled & 0x04)
+                triangle.length = LENGTHS[data >> 3];
+            triangle.reload = 1;
+            break;
+        case 0x400C:
+            noise.control = data;
+            break;
+        case 0x400E:
+            noise.mode = data;
+            break;
+        case 0x400F:
+            if (enabled & 0x08)
+                noise.length = LENGTHS[data >> 3];
+            noise.envelope[0] = 1;
+            break;
+        case 0x4010:
+            dmc.control = data;
+            if (!(data & 0x80))
+                dmc.irq = 0;
+            break;
+        case 0x4011:
+            dmc.level = data & 0x7F;
+            break;
+        case 0x4012:
+            dmc.start = data;
+            break;
+        case 0x4013:
+            dmc.size = data;
+            break;
+        case 0x4015:
+            enabled = data & 0x1F;
+            if (!(data & 0x01))
+                pulse[0].length = 0;
+            if (!(data & 0x02))
+                pulse[1].length = 0;
+            if (!(data & 0x04))
+                triangle.length = 0;
+            if (!(data & 0x08))
+                noise.length = 0;
+            dmc.irq = 0;
+            if (!(data & 0x10)) {
+                dmc.remaining = 0;
+            } else if (!dmc.remaining) {
+                restartSample();
+                fetchSample();
+            }
+            break;
+        case 0x4017:
+            // the few cycles the sequencer takes to restart are not counted
+            frame_control = data;
+            if (data & FRAME_IRQ_INHIBIT)
+                frame_irq = false;
+            frame_start = clock;
+            frame_step = 0;
+            if (data & FRAME_FIVE_STEP) {
+                quarterFrame();
+                halfFrame();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    updateLevels(clock);
+}
+
+int APU::pulseLevel(const Pulse& p) const {
+    if (!p.length || sweepMuted(p, p.second) || !((DUTIES[p.control >> 6] >> p.sequence) & 0x01))
+        return 0;
+    return envelopeVolume(p.control, p.envelope);
+}
+
+int APU::triangleLevel() const {
+    return triangleStep(triangle.sequence);
+}
+
+int APU::noiseLevel() const {
+    if (!noise.length || (noise.shift & 0x01))
+        return 0;
+    return envelopeVolume(noise.control, noise.envelope);
+}
+
+inline void APU::emit(int& heard, int level, int gain, uint64_t at) {
+    if (level == heard || !output)
+        return;
+    blip.addDelta(static_cast<uint32_t>(at - block_start), (level - heard) * gain);
+    heard = level;
+}
+
+void APU::updateLevels(uint64_t at) {
+    emit(pulse[0].heard, pulseLevel(pulse[0]), PULSE_GAIN, at);
+    emit(pulse[1].heard, pulseLevel(pulse[1]), PULSE_GAIN, at);
+    if (triangle.period >= TRIANGLE_MIN_PERIOD)
+        emit(triangle.heard, triangleLevel(), TRIANGLE_GAIN, at);
+    emit(noise.heard, noiseLevel(), NOISE_GAIN, at);
+    emit(dmc.heard, dmc.level, DMC_GAIN, at);
+}
+
+void APU::saveState(ApuState& state) const {
+    state.clock = clock;
+    state.frame_timer = static_cast<uint32_t>(nextFrameStep() - clock);
+    state.frame_control = frame_control;
+    state.frame_step = frame_step;
+    state.frame_irq = frame_irq ? 1 : 0;
+    state.enabled = enabled;
+    for (size_t i = 0; i < 2; i++) {
+        state.pulse[i] = pulse[i];
+        state.pulse[i].timer = static_cast<h_word>(pulse[i].next - clock);
+    }
+    state.triangle = triangle;
+    state.triangle.timer = static_cast<h_word>(triangle.next - clock);
+    state.noise = noise;
+    state.noise.timer = static_cast<h_word>(noise.next - clock);
+    state.dmc = dmc;
+    state.dmc.timer = static_cast<h_word>(dmc.next - clock);
+}
+
+void APU::loadState(const ApuState& state) {
+    clock = state.clock;
+    frame_control = state.frame_control;
+    frame_step = state.frame_step;
+    frame_start = clock + state.frame_timer
+        - FRAME_STEPS[(frame_control & FRAME_FIVE_STEP) ? 1 : 0][frame_step];
+    frame_irq = state.frame_irq != 0;
+    enabled = state.enabled;
+    for (size_t i = 0; i < 2; i++) {
+        static_cast<PulseState&>(pulse[i]) = state.pulse[i];
+        pulse[i].next = clock + state.pulse[i].timer;
+    }
+    static_cast<TriangleState&>(triangle) = state.triangle;
+    triangle.next = clock + state.triangle.timer;
+    static_cast<NoiseState&>(noise) = state.noise;
+    noise.next = clock + state.noise.timer;
+    static_cast<DmcState&>(dmc) = state.dmc;
+    dmc.next = clock + state.dmc.timer;
+
+    // the output jumps to the restored levels from here
+    block_start = clock;
+    updateLevels(clock);
+}
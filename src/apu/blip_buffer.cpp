@@ -0,0 +1,94 @@
+#include "blip_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    // passband, as a fraction of the output Nyquist frequency
+    const double CUTOFF = 0.9;
+
+    struct KernelTable {
+        int32_t taps[BlipBuffer::PHASES][BlipBuffer::KERNEL_WIDTH];
+
+        KernelTable() {
+            const int unit = 1 << BlipBuffer::KERNEL_BITS;
+            const double half = BlipBuffer::KERNEL_WIDTH / 2.0;
+            for (unsigned phase = 0; phase < BlipBuffer::PHASES; phase++) {
+                // the step sits `phase / PHASES` into sample half - 1
+                double center = half - 1.0 + double(phase) / BlipBuffer::PHASES;
+                double impulse[BlipBuffer::KERNEL_WIDTH];
+                double sum = 0.0;
+                for (unsigned i = 0; i < BlipBuffer::KERNEL_WIDTH; i++) {
+                    double t = i - center;
+                    double x = CUTOFF * t;
+                    double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(PI * x) / (PI * x);
+                    double w = std::fabs(t) >= half ? 0.0
+                        : 0.42 + 0.5 * std::cos(PI * t / half) + 0.08 * std::cos(2.0 * PI * t / half);
+                    impulse[i] = sinc * w;
+                    sum += impulse[i];
+                }
+                // every impulse adds up to exactly one step, rounding error
+                // goes to the largest tap
+                int total = 0;
+                unsigned peak = 0;
+                for (unsigned i = 0; i < BlipBuffer::KERNEL_WIDTH; i++) {
+                    taps[phase][i] = static_cast<int32_t>(std::lround(impulse[i] * unit / sum));
+                    total += taps[phase][i];
+                    if (taps[phase][i] > taps[phase][peak])
+                        peak = i;
+                }
+                taps[phase][peak] = static_cast<int32_t>(taps[phase][peak] + unit - total);
+            }
+        }
+    };
+}
+
+BlipBuffer::BlipBuffer(size_t capacity) : buffer(capacity + KERNEL_WIDTH + 1, 0), size(capacity) {}
+
+const BlipBuffer::Kernel& BlipBuffer::kernel() {
+    static const KernelTable table;
+    return table.taps;
+}
+
+void BlipBuffer::setRates(double clock_rate, uint32_t sample_rate) {
+    rate = sample_rate;
+    factor = static_cast<uint64_t>(std::llround(sample_rate / clock_rate * double(1ull << FRAC_BITS)));
+    clear();
+}
+
+uint32_t BlipBuffer::maxBlock() const {
+    size_t room = size - std::min(size, available());
+    if (!factor)
+        return UINT32_MAX;
+    uint64_t clocks = ((uint64_t(room) << FRAC_BITS) - (offset & ((1ull << FRAC_BITS) - 1))) / factor;
+    return static_cast<uint32_t>(std::min<uint64_t>(clocks, UINT32_MAX));
+}
+
+size_t BlipBuffer::read(int16_t* out, size_t max) {
+    size_t count = std::min(max, available());
+    int32_t sum = integrator;
+    for (size_t i = 0; i < count; i++) {
+        sum += buffer[i];
+        int32_t sample = sum >> KERNEL_BITS;
+        if (out)
+            out[i] = static_cast<int16_t>(std::clamp<int32_t>(sample, INT16_MIN, INT16_MAX));
+        sum -= sample * (1 << (KERNEL_BITS - BASS_SHIFT));
+    }
+    integrator = sum;
+
+    // the impulses of the last steps reach past what was read
+    size_t keep = available() - count + KERNEL_WIDTH;
+    std::memmove(buffer.data(), buffer.data() + count, keep * sizeof(int32_t));
+    std::fill(buffer.begin() + keep, buffer.begin() + keep + count, 0);
+    offset -= uint64_t(count) << FRAC_BITS;
+    return count;
+}
+
+void BlipBuffer::clear() {
+    std::fill(buffer.begin(), buffer.end(), 0);
+    offset = 0;
+    integrator = 0;
+}
@@ -0,0 +1,165 @@
+#include "cartridge.hpp"
+#include "memory_map.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NES_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define NES_HAS_MMAP 0
+#endif
+
+namespace {
+    const size_t HEADER_SIZE = 16;
+    const size_t TRAINER_SIZE = 512;
+    const size_t PRG_UNIT = 16 * 1024;
+    const size_t CHR_UNIT = 8 * 1024;
+
+    // the magic only, the header may still be cut short
+    bool isINes(const byte* data, size_t size) {
+        return size >= 4 && data[0] == 'N' && data[1] == 'E' && data[2] == 'S' && data[3] == 0x1A;
+    }
+
+    // NES 2.0 ROM size: a 12 bit unit count, or an exponent-multiplier pair
+    // when the top nibble is all ones. Sizes that would not fit a size_t give
+    // SIZE_MAX, which no file is large enough for.
+    size_t nes2RomSize(byte lsb, byte msb, size_t unit) {
+        if (msb == 0x0F) {
+            unsigned exponent = lsb >> 2;
+            // the multiplier is below 8, three more bits
+            if (exponent >= sizeof(size_t) * 8 - 3)
+                return SIZE_MAX;
+            return (size_t(1) << exponent) * ((lsb & 0x03) * 2 + 1);
+        }
+        return ((size_t(msb) << 8) | lsb) * unit;
+    }
+
+    size_t nes2RamSize(byte shift) {
+        return shift ? size_t(64) << shift : 0;
+    }
+}
+
+std::shared_ptr<const CartridgeImage> CartridgeImage::load(const std::string& path) {
+    std::shared_ptr<CartridgeImage> image(new CartridgeImage());
+    image->name = path;
+
+#if NES_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open " + path);
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        throw std::runtime_error(path + ": empty or unreadable file");
+    }
+    void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping holds its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+    image->mapping = mapping;
+    image->mapping_size = info.st_size;
+    image->parse(static_cast<const byte*>(mapping), image->mapping_size);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+    image->owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    image->parse(image->owned.data(), image->owned.size());
+#endif
+    return image;
+}
+
+std::shared_ptr<const CartridgeImage> CartridgeImage::fromMemory(std::vector<byte> file, const std::string& name) {
+    std::shared_ptr<CartridgeImage> image(new CartridgeImage());
+    image->name = name;
+    image->owned = std::move(file);
+    image->parse(image->owned.data(), image->owned.size());
+    return image;
+}
+
+CartridgeImage::~CartridgeImage() {
+#if NES_HAS_MMAP
+    if (mapping)
+        ::munmap(mapping, mapping_size);
+#endif
+}
+
+uint64_t CartridgeImage::hash() const {
+    const byte board[8] = {
+        static_cast<byte>(mapper), static_cast<byte>(mapper >> 8), submapper, static_cast<byte>(mirroring),
+        static_cast<byte>(battery), static_cast<byte>(prg_ram_size >> 10), static_cast<byte>(chr_ram_size >> 10),
+        static_cast<byte>(trainer != nullptr),
+    };
+    uint64_t value = fnv1a(board, sizeof(board));
+    value = fnv1a(prg, prg_size, value);
+    if (chr)
+        value = fnv1a(chr, chr_size, value);
+    if (trainer)
+        value = fnv1a(trainer, TRAINER_SIZE, value);
+    return value;
+}
+
+void CartridgeImage::parse(const byte* data, size_t size) {
+    if (!isINes(data, size)) {
+        // raw PRG dump, mirrored over $8000-$FFFF
+        if (size == 0 || size % MemoryMap::PAGE_SIZE != 0 || size > 0x8000)
+            throw std::runtime_error(name + ": raw PRG ROM must be 256 bytes to 32KB in whole pages");
+        prg = data;
+        prg_size = size;
+        chr_ram_size = CHR_UNIT;
+        return;
+    }
+    if (size < HEADER_SIZE)
+        throw std::runtime_error(name + ": truncated iNES header");
+
+    const byte* header = data;
+    nes2 = (header[7] & 0x0C) == 0x08;
+    battery = (header[6] & 0x02) != 0;
+    if (header[6] & 0x08)
+        mirroring = Mirroring::FourScreen;
+    else
+        mirroring = (header[6] & 0x01) ? Mirroring::Vertical : Mirroring::Horizontal;
+
+    if (nes2) {
+        mapper = (header[6] >> 4) | (header[7] & 0xF0) | ((header[8] & 0x0F) << 8);
+        submapper = header[8] >> 4;
+        prg_size = nes2RomSize(header[4], header[9] & 0x0F, PRG_UNIT);
+        chr_size = nes2RomSize(header[5], header[9] >> 4, CHR_UNIT);
+        prg_ram_size = nes2RamSize(header[10] & 0x0F) + nes2RamSize(header[10] >> 4);
+        chr_ram_size = nes2RamSize(header[11] & 0x0F) + nes2RamSize(header[11] >> 4);
+    } else {
+        // old dumping tools left signatures in bytes 7-15, only trust the
+        // upper mapper nibble when the padding is clean
+        bool clean = header[12] == 0 && header[13] == 0 && header[14] == 0 && header[15] == 0;
+        mapper = (header[6] >> 4) | (clean ? (header[7] & 0xF0) : 0);
+        prg_size = header[4] * PRG_UNIT;
+        chr_size = header[5] * CHR_UNIT;
+        prg_ram_size = 0x2000;
+        chr_ram_size = chr_size ? 0 : CHR_UNIT;
+    }
+
+    size_t offset = HEADER_SIZE;
+    if (header[6] & 0x04) {
+        if (offset + TRAINER_SIZE > size)
+            throw std::runtime_error(name + ": truncated trainer");
+        trainer = data + offset;
+        offset += TRAINER_SIZE;
+    }
+
+    // one at a time, a sum of header sizes could wrap
+    if (prg_size > size - offset)
+        throw std::runtime_error(name + ": truncated PRG ROM");
+    if (chr_size > size - offset - prg_size)
+        throw std::runtime_error(name + ": truncated CHR ROM");
+    if (prg_size == 0 || prg_size % MemoryMap::PAGE_SIZE != 0)
+        throw std::runtime_error(name + ": PRG ROM size must be a non zero number of pages");
+    prg = data + offset;
+    chr = chr_size ? data + offset + prg_size : nullptr;
+}
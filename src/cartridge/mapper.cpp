@@ -0,0 +1,135 @@
+#include "mapper.hpp"
+#include "mappers.hpp"
+#include "memory_map.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+std::unique_ptr<Mapper> Mapper::create(std::shared_ptr<const CartridgeImage> image) {
+    std::unique_ptr<Mapper> mapper;
+    switch (image->mapper) {
+    case 0: mapper = std::make_unique<Nrom>(image); break;
+    case 1: mapper = std::make_unique<Mmc1>(image); break;
+    case 2: mapper = std::make_unique<Uxrom>(image); break;
+    case 4: mapper = std::make_unique<Mmc3>(image); break;
+    default:
+        throw std::runtime_error(image->name + ": mapper " + std::to_string(image->mapper) + " is not supported");
+    }
+    mapper->powerOn();
+    return mapper;
+}
+
+bool Mapper::supports(uint16_t mapper) {
+    return mapper == 0 || mapper == 1 || mapper == 2 || mapper == 4;
+}
+
+Mapper::Mapper(std::shared_ptr<const CartridgeImage> image) : rom(std::move(image)), mirror(rom->mirroring) {
+    // whole pages, the window shows smaller RAM mirrored
+    if (rom->prg_ram_size) {
+        size_t pages = (rom->prg_ram_size + MemoryMap::PAGE_SIZE - 1) / MemoryMap::PAGE_SIZE;
+        prg_ram.assign(std::min(pages * MemoryMap::PAGE_SIZE, PRG_RAM_WINDOW), 0);
+    }
+    // none of the supported boards switches CHR-RAM banks, 8KB is all a
+    // save state keeps
+    if (!rom->chr)
+        chr_ram.assign(CHR_RAM_SIZE, 0);
+}
+
+Mapper::~Mapper() {
+    if (memory) {
+        memory->unmap(CART_RAM_START, CART_RAM_START + PRG_RAM_WINDOW - 1);
+        memory->unmap(0x8000, 0xFFFF);
+        for (uint16_t slot : chr_slots)
+            memory->untrack(slot);
+    }
+}
+
+void Mapper::connect(MemoryMap& map) {
+    memory = &map;
+    if (!prg_ram.empty())
+        memory->mapRam(CART_RAM_START, CART_RAM_START + PRG_RAM_WINDOW - 1, prg_ram.data(), prg_ram.size());
+    memory->mapWriteIo(0x8000, 0xFFFF, { this, nullptr, &Mapper::onWrite });
+    for (size_t at = 0; at < chr_ram.size(); at += MemoryMap::PAGE_SIZE)
+        chr_slots.push_back(memory->track(&chr_ram[at]));
+    updateBanks();
+}
+
+void Mapper::powerOn() {
+    resetRegisters();
+    irq = false;
+    mirror = rom->mirroring;
+    if (rom->trainer && prg_ram.size() == PRG_RAM_WINDOW)
+        std::memcpy(&prg_ram[0x1000], rom->trainer, 512);
+    updateBanks();
+}
+
+void Mapper::saveState(MapperState& state) const {
+    state.id = rom->mapper;
+    state.irq = irq ? 1 : 0;
+    state.reserved = 0;
+    std::memset(state.registers, 0, sizeof(state.registers));
+    saveRegisters(state.registers);
+}
+
+bool Mapper::loadState(const MapperState& state) {
+    if (state.id != rom->mapper)
+        return false;
+    irq = state.irq != 0;
+    mirror = rom->mirroring;
+    loadRegisters(state.registers);
+    updateBanks();
+    return true;
+}
+
+void Mapper::mapPrg(h_word address, size_t size, int bank) {
+    if (!memory)
+        return;
+
+    // a ROM smaller than the window is mirrored in it
+    const byte* data = rom->prg;
+    size_t data_size = rom->prg_size;
+    if (size_t count = prgBanks(size)) {
+        size_t index = bank < 0 ? count - (size_t(-bank) % count) : size_t(bank);
+        data += (index % count) * size;
+        data_size = size;
+    }
+
+    size_t first = address >> 8;
+    size_t pages = size / MemoryMap::PAGE_SIZE;
+    for (size_t i = 0; i < pages; i++) {
+        if (memory->readPointer(static_cast<byte>(first + i)) != data + (i * MemoryMap::PAGE_SIZE) % data_size) {
+            memory->mapRom(address, static_cast<h_word>(address + size - 1), data, data_size);
+            return;
+        }
+    }
+}
+
+void Mapper::mapChr(h_word address, size_t size, int bank) {
+    byte* ram = chr_ram.empty() ? nullptr : chr_ram.data();
+    const byte* data = ram ? ram : rom->chr;
+    size_t count = std::max<size_t>(chrBanks(size), 1);
+    size_t index = bank < 0 ? count - (size_t(-bank) % count) : size_t(bank);
+    size_t offset = (index % count) * size;
+
+    for (size_t slot = address / CHR_WINDOW, i = 0; i < size / CHR_WINDOW; slot++, i++) {
+        size_t at = (offset + i * CHR_WINDOW) % chrSize();
+        chr_read[slot & 0x07] = data + at;
+        chr_write[slot & 0x07] = ram ? ram + at : nullptr;
+        chr_offset[slot & 0x07] = at;
+    }
+}
+
+void Mapper::writeChr(h_word address, byte data) {
+    size_t window = (address >> 10) & 0x07;
+    if (byte* bank = chr_write[window]) {
+        bank[address & 0x03FF] = data;
+        if (!chr_slots.empty())
+            memory->markDirty(chr_slots[(chr_offset[window] + (address & 0x03FF)) / MemoryMap::PAGE_SIZE]);
+    }
+}
+
+void Mapper::onWrite(void* device, h_word address, byte data) {
+    static_cast<Mapper*>(device)->writeRegister(address, data);
+}
@@ -0,0 +1,186 @@
+#include "mappers.hpp"
+
+#include <cstring>
+
+// Mapper 0
+void Nrom::updateBanks() {
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0x0000, 0x2000, 0);
+}
+
+// Mapper 1
+void Mmc1::resetRegisters() {
+    regs = {};
+    regs.shift = 0x10;
+    regs.control = 0x0C; // last PRG bank fixed at $C000
+}
+
+void Mmc1::writeRegister(h_word address, byte data) {
+    if (data & 0x80) {
+        regs.shift = 0x10;
+        regs.control |= 0x0C;
+        updateBanks();
+        return;
+    }
+
+    // the marker bit reaching bit 0 means this is the fifth write
+    bool full = regs.shift & 0x01;
+    regs.shift = (regs.shift >> 1) | ((data & 0x01) << 4);
+    if (!full)
+        return;
+
+    byte value = regs.shift & 0x1F;
+    switch ((address >> 13) & 0x03) {
+    case 0: regs.control = value; break;
+    case 1: regs.chr0 = value; break;
+    case 2: regs.chr1 = value; break;
+    case 3: regs.prg = value; break;
+    }
+    regs.shift = 0x10;
+    updateBanks();
+}
+
+void Mmc1::updateBanks() {
+    static const Mirroring MIRRORING[4] = {
+        Mirroring::SingleLow, Mirroring::SingleHigh, Mirroring::Vertical, Mirroring::Horizontal
+    };
+    mirror = MIRRORING[regs.control & 0x03];
+
+    // 512KB boards (SUROM) pick the 256KB half with a CHR register bit
+    int outer = (image().prg_size > 0x40000 && (regs.chr0 & 0x10)) ? 0x10 : 0;
+    int bank = (regs.prg & 0x0F) | outer;
+    switch ((regs.control >> 2) & 0x03) {
+    case 0:
+    case 1:
+        mapPrg(0x8000, 0x8000, bank >> 1);
+        break;
+    case 2:
+        mapPrg(0x8000, 0x4000, outer);
+        mapPrg(0xC000, 0x4000, bank);
+        break;
+    case 3:
+        mapPrg(0x8000, 0x4000, bank);
+        mapPrg(0xC000, 0x4000, 0x0F | outer);
+        break;
+    }
+
+    if (regs.control & 0x10) {
+        mapChr(0x0000, 0x1000, regs.chr0);
+        mapChr(0x1000, 0x1000, regs.chr1);
+    } else {
+        mapChr(0x0000, 0x2000, regs.chr0 >> 1);
+    }
+}
+
+size_t Mmc1::saveRegisters(byte* out) const {
+    std::memcpy(out, &regs, sizeof(regs));
+    return sizeof(regs);
+}
+
+void Mmc1::loadRegisters(const byte* in) {
+    std::memcpy(&regs, in, sizeof(regs));
+}
+
+// Mapper 2
+void Uxrom::writeRegister(h_word, byte data) {
+    bank = data;
+    updateBanks();
+}
+
+void Uxrom::updateBanks() {
+    mapPrg(0x8000, 0x4000, bank);
+    mapPrg(0xC000, 0x4000, -1);
+    mapChr(0x0000, 0x2000, 0);
+}
+
+size_t Uxrom::saveRegisters(byte* out) const {
+    out[0] = bank;
+    return 1;
+}
+
+void Uxrom::loadRegisters(const byte* in) {
+    bank = in[0];
+}
+
+// Mapper 4
+void Mmc3::resetRegisters() {
+    regs = {};
+    const byte banks[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    std::memcpy(regs.banks, banks, sizeof(banks));
+}
+
+void Mmc3::writeRegister(h_word address, byte data) {
+    switch (address & 0xE001) {
+    case 0x8000:
+        regs.select = data;
+        updateBanks();
+        break;
+    case 0x8001:
+        regs.banks[regs.select & 0x07] = data;
+        updateBanks();
+        break;
+    case 0xA000:
+        regs.mirroring = data & 0x01;
+        updateBanks();
+        break;
+    case 0xA001:
+        // PRG-RAM write protection, left always enabled
+        break;
+    case 0xC000:
+        regs.irq_latch = data;
+        break;
+    case 0xC001:
+        regs.irq_counter = 0;
+        regs.irq_reload = 1;
+        break;
+    case 0xE000:
+        regs.irq_enabled = 0;
+        irq = false;
+        break;
+    case 0xE001:
+        regs.irq_enabled = 1;
+        break;
+    }
+}
+
+void Mmc3::updateBanks() {
+    if (image().mirroring != Mirroring::FourScreen)
+        mirror = (regs.mirroring & 0x01) ? Mirroring::Horizontal : Mirroring::Vertical;
+
+    // PRG mode swaps $8000 and $C000, one of them fixed to the second last bank
+    int r6 = regs.banks[6] & 0x3F;
+    bool swapped = regs.select & 0x40;
+    mapPrg(0x8000, 0x2000, swapped ? -2 : r6);
+    mapPrg(0xA000, 0x2000, regs.banks[7] & 0x3F);
+    mapPrg(0xC000, 0x2000, swapped ? r6 : -2);
+    mapPrg(0xE000, 0x2000, -1);
+
+    // CHR A12 inversion swaps the 2KB and the 1KB halves
+    h_word invert = (regs.select & 0x80) ? 0x1000 : 0x0000;
+    mapChr(invert ^ 0x0000, 0x0800, regs.banks[0] >> 1);
+    mapChr(invert ^ 0x0800, 0x0800, regs.banks[1] >> 1);
+    mapChr(invert ^ 0x1000, 0x0400, regs.banks[2]);
+    mapChr(invert ^ 0x1400, 0x0400, regs.banks[3]);
+    mapChr(invert ^ 0x1800, 0x0400, regs.banks[4]);
+    mapChr(invert ^ 0x1C00, 0x0400, regs.banks[5]);
+}
+
+void Mmc3::scanline() {
+    if (regs.irq_counter == 0 || regs.irq_reload) {
+        regs.irq_counter = regs.irq_latch;
+        regs.irq_reload = 0;
+    } else {
+        regs.irq_counter--;
+    }
+    if (regs.irq_counter == 0 && regs.irq_enabled)
+        irq = true;
+}
+
+size_t Mmc3::saveRegisters(byte* out) const {
+    std::memcpy(out, &regs, sizeof(regs));
+    return sizeof(regs);
+}
+
+void Mmc3::loadRegisters(const byte* in) {
+    std::memcpy(&regs, in, sizeof(regs));
+}
@@ -0,0 +1,805 @@
+#include "batch_cpu.hpp"
+#include "bus.hpp"
+#include "cpu.hpp"
+
+#include <cstring>
+
+#if NES_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // status flags, as CPU::FLAGS6502
+    const byte C = 0x01;
+    const byte Z = 0x02;
+    const byte I = 0x04;
+    const byte D = 0x08;
+    const byte B = 0x10;
+    const byte U = 0x20;
+    const byte V = 0x40;
+    const byte N = 0x80;
+
+    constexpr size_t instructionLength(AddrMode mode) {
+        switch (mode) {
+        case AddrMode::IMP: return 1;
+        case AddrMode::ABS:
+        case AddrMode::ABX:
+        case AddrMode::ABY:
+        case AddrMode::IND: return 3;
+        default: return 2;
+        }
+    }
+
+    // ops calling CPU::fetch(), which reads memory unless implied
+    constexpr bool fetches(Mnemonic op) {
+        using M = Mnemonic;
+        return op == M::ADC || op == M::AND || op == M::ASL || op == M::BIT || op == M::CMP
+            || op == M::CPX || op == M::CPY || op == M::DEC || op == M::EOR || op == M::INC
+            || op == M::LDA || op == M::LDX || op == M::LDY || op == M::LSR || op == M::ORA
+            || op == M::ROL || op == M::ROR || op == M::SBC;
+    }
+
+    constexpr bool shifts(Mnemonic op) {
+        return op == Mnemonic::ASL || op == Mnemonic::LSR || op == Mnemonic::ROL || op == Mnemonic::ROR;
+    }
+
+    inline byte zn(byte s, byte r) {
+        return static_cast<byte>((s & ~(Z | N)) | (r ? 0 : Z) | (r & N));
+    }
+
+    // Kernels over the registers of a group, `n` lanes. The SSE2 loops do 16
+    // lanes at a time and leave the rest to the scalar ones.
+
+#if NES_X86_SIMD
+    const size_t WIDTH = 16;
+
+    inline __m128i loadLanes(const byte* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void storeLanes(byte* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline __m128i splat(byte v) { return _mm_set1_epi8(static_cast<char>(v)); }
+
+    // unsigned x >= y, all ones or zero
+    inline __m128i atLeast(__m128i x, __m128i y) { return _mm_cmpeq_epi8(_mm_max_epu8(x, y), x); }
+
+    inline __m128i zn128(__m128i s, __m128i r) {
+        __m128i z = _mm_and_si128(_mm_cmpeq_epi8(r, _mm_setzero_si128()), splat(Z));
+        return _mm_or_si128(_mm_andnot_si128(splat(Z | N), s), _mm_or_si128(z, _mm_and_si128(r, splat(N))));
+    }
+#endif
+
+    /** @brief a = a + m + C with every flag, SBC passing m inverted. */
+    void addCarry(byte* a, byte* s, const byte* m, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i va = loadLanes(a + i), vs = loadLanes(s + i), vm = loadLanes(m + i);
+            __m128i carry_in = _mm_and_si128(vs, splat(C));
+            __m128i sum = _mm_add_epi8(va, vm);
+            __m128i t = _mm_add_epi8(sum, carry_in);
+            // out of a + m, or out of the carry on a 0xFF sum
+            __m128i carry = _mm_or_si128(_mm_andnot_si128(atLeast(sum, va), splat(C)),
+                _mm_and_si128(_mm_cmpeq_epi8(sum, splat(0xFF)), carry_in));
+            __m128i overflow = _mm_and_si128(_mm_andnot_si128(_mm_xor_si128(va, vm), _mm_xor_si128(va, t)), splat(N));
+            __m128i flags = _mm_or_si128(carry, _mm_srli_epi16(overflow, 1));
+            vs = _mm_or_si128(zn128(_mm_andnot_si128(splat(C | V), vs), t), flags);
+            storeLanes(a + i, t);
+            storeLanes(s + i, vs);
+        }
+#endif
+        for (; i < n; i++) {
+            h_word t = static_cast<h_word>(a[i] + m[i] + (s[i] & C));
+            byte overflow = ~(a[i] ^ m[i]) & (a[i] ^ t) & N;
+            byte flags = static_cast<byte>((t > 0xFF ? C : 0) | (overflow ? V : 0));
+            a[i] = static_cast<byte>(t);
+            s[i] = zn(static_cast<byte>(s[i] & ~(C | V)), a[i]) | flags;
+        }
+    }
+
+    /** @brief CMP/CPX/CPY of `reg` with m. */
+    void compare(const byte* reg, byte* s, const byte* m, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i vr = loadLanes(reg + i), vm = loadLanes(m + i);
+            __m128i carry = _mm_and_si128(atLeast(vr, vm), splat(C));
+            __m128i vs = _mm_andnot_si128(splat(C), loadLanes(s + i));
+            storeLanes(s + i, _mm_or_si128(zn128(vs, _mm_sub_epi8(vr, vm)), carry));
+        }
+#endif
+        for (; i < n; i++) {
+            byte flags = zn(static_cast<byte>(s[i] & ~C), static_cast<byte>(reg[i] - m[i]));
+            s[i] = flags | (reg[i] >= m[i] ? C : 0);
+        }
+    }
+
+    /** @brief AND/ORA/EOR of a with m. */
+    template <Mnemonic Op>
+    void logic(byte* a, byte* s, const byte* m, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i va = loadLanes(a + i), vm = loadLanes(m + i);
+            if constexpr (Op == Mnemonic::AND)
+                va = _mm_and_si128(va, vm);
+            else if constexpr (Op == Mnemonic::ORA)
+                va = _mm_or_si128(va, vm);
+            else
+                va = _mm_xor_si128(va, vm);
+            storeLanes(a + i, va);
+            storeLanes(s + i, zn128(loadLanes(s + i), va));
+        }
+#endif
+        for (; i < n; i++) {
+            if constexpr (Op == Mnemonic::AND)
+                a[i] &= m[i];
+            else if constexpr (Op == Mnemonic::ORA)
+                a[i] |= m[i];
+            else
+                a[i] ^= m[i];
+            s[i] = zn(s[i], a[i]);
+        }
+    }
+
+    /** @brief BIT: Z from a & m, N and V straight from m. */
+    void bitTest(const byte* a, byte* s, const byte* m, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i vm = loadLanes(m + i);
+            __m128i z = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(loadLanes(a + i), vm), _mm_setzero_si128()), splat(Z));
+            __m128i vs = _mm_andnot_si128(splat(Z | V | N), loadLanes(s + i));
+            storeLanes(s + i, _mm_or_si128(vs, _mm_or_si128(z, _mm_and_si128(vm, splat(V | N)))));
+        }
+#endif
+        for (; i < n; i++)
+            s[i] = static_cast<byte>((s[i] & ~(Z | V | N)) | ((a[i] & m[i]) ? 0 : Z) | (m[i] & (V | N)));
+    }
+
+    /** @brief Loads and transfers: dst = src, with Z and N. */
+    void transfer(byte* dst, byte* s, const byte* src, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i v = loadLanes(src + i);
+            storeLanes(dst + i, v);
+            storeLanes(s + i, zn128(loadLanes(s + i), v));
+        }
+#endif
+        for (; i < n; i++) {
+            dst[i] = src[i];
+            s[i] = zn(s[i], dst[i]);
+        }
+    }
+
+    /** @brief ASL/LSR/ROL/ROR of v in place. */
+    template <Mnemonic Op>
+    void shift(byte* v, byte* s, size_t n) {
+        constexpr bool left = Op == Mnemonic::ASL || Op == Mnemonic::ROL;
+        constexpr bool rotate = Op == Mnemonic::ROL || Op == Mnemonic::ROR;
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i vv = loadLanes(v + i), vs = loadLanes(s + i);
+            __m128i carry_in = _mm_and_si128(vs, splat(C));
+            __m128i r, carry;
+            if constexpr (left) {
+                // bit 7 of each byte down to bit 0, 16 bit shifts stay within bytes once masked
+                carry = _mm_and_si128(_mm_srli_epi16(vv, 7), splat(C));
+                r = _mm_add_epi8(vv, vv);
+                if constexpr (rotate)
+                    r = _mm_or_si128(r, carry_in);
+            } else {
+                carry = _mm_and_si128(vv, splat(C));
+                r = _mm_and_si128(_mm_srli_epi16(vv, 1), splat(0x7F));
+                if constexpr (rotate)
+                    r = _mm_or_si128(r, _mm_slli_epi16(carry_in, 7));
+            }
+            storeLanes(v + i, r);
+            storeLanes(s + i, _mm_or_si128(zn128(_mm_andnot_si128(splat(C), vs), r), carry));
+        }
+#endif
+        for (; i < n; i++) {
+            byte carry_in = s[i] & C;
+            byte carry, r;
+            if constexpr (left) {
+                carry = v[i] >> 7;
+                r = static_cast<byte>((v[i] << 1) | (rotate ? carry_in : 0));
+            } else {
+                carry = v[i] & C;
+                r = static_cast<byte>((v[i] >> 1) | (rotate ? carry_in << 7 : 0));
+            }
+            v[i] = r;
+            s[i] = zn(static_cast<byte>(s[i] & ~C), r) | carry;
+        }
+    }
+
+    /** @brief INC/DEC/INX/INY/DEX/DEY of v in place. */
+    void increment(byte* v, byte* s, byte delta, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH) {
+            __m128i r = _mm_add_epi8(loadLanes(v + i), splat(delta));
+            storeLanes(v + i, r);
+            storeLanes(s + i, zn128(loadLanes(s + i), r));
+        }
+#endif
+        for (; i < n; i++) {
+            v[i] = static_cast<byte>(v[i] + delta);
+            s[i] = zn(s[i], v[i]);
+        }
+    }
+
+    /** @brief Flag instructions. */
+    void setFlags(byte* s, byte clear, byte set, size_t n) {
+        size_t i = 0;
+#if NES_X86_SIMD
+        for (; i + WIDTH <= n; i += WIDTH)
+            storeLanes(s + i, _mm_or_si128(_mm_andnot_si128(splat(clear), loadLanes(s + i)), splat(set)));
+#endif
+        for (; i < n; i++)
+            s[i] = static_cast<byte>((s[i] & ~clear) | set);
+    }
+
+    template <Mnemonic Op>
+    bool branchTaken(byte s) {
+        switch (Op) {
+        case Mnemonic::BCC: return !(s & C);
+        case Mnemonic::BCS: return s & C;
+        case Mnemonic::BEQ: return s & Z;
+        case Mnemonic::BNE: return !(s & Z);
+        case Mnemonic::BMI: return s & N;
+        case Mnemonic::BPL: return !(s & N);
+        case Mnemonic::BVC: return !(s & V);
+        default: return s & V;   // BVS
+        }
+    }
+
+    template <typename T>
+    void gather(const std::vector<T>& from, const uint32_t* lanes, size_t n, T* to) {
+        for (size_t i = 0; i < n; i++)
+            to[i] = from[lanes[i]];
+    }
+
+    template <typename T>
+    void scatter(const T* from, const uint32_t* lanes, size_t n, std::vector<T>& to) {
+        for (size_t i = 0; i < n; i++)
+            to[lanes[i]] = from[i];
+    }
+}
+
+void BatchCpu::addLane(Bus& bus) {
+    CPU& cpu = bus.getCpu();
+    buses.push_back(&bus);
+    cpus.push_back(&cpu);
+    maps.push_back(&bus.memoryMap());
+    zero_pages.push_back(cpu.zero_page);
+    stack_pages.push_back(cpu.stack_page);
+
+    size_t k = lanes();
+    rams.push_back(nullptr);
+    for (auto* v : { &a, &x, &y, &sp, &status, &fetched, &opcode, &busy, &written, &crossed, &operand, &result, &ga, &gx, &gy, &gs })
+        v->resize(k);
+    for (auto* v : { &pc, &addr_abs, &addr_rel, &address })
+        v->resize(k);
+    for (auto* v : { &clock, &limit, &ends })
+        v->resize(k);
+    group.resize(k);
+    diverted.reserve(k);
+}
+
+uint64_t BatchCpu::run(uint64_t cycles) {
+    size_t k = lanes();
+    uint64_t start = 0;
+    for (size_t l = 0; l < k; l++) {
+        start += cpus[l]->cycleCount();
+        ends[l] = cpus[l]->cycleCount() + cycles;
+    }
+
+    // Bus::run() lane by lane, with the CPU runs of every lane in one go
+    for (;;) {
+        bool running = false;
+        for (size_t l = 0; l < k; l++) {
+            const CPU& cpu = *cpus[l];
+            busy[l] = cpu.cycleCount() < ends[l] || !cpu.complete();
+            limit[l] = busy[l] ? buses[l]->cpuDeadline(ends[l]) : 0;
+            running |= busy[l] != 0;
+        }
+        if (!running)
+            break;
+        runLanes();
+        for (size_t l = 0; l < k; l++)
+            if (busy[l])
+                buses[l]->serviceDevices();
+    }
+
+    uint64_t spent = 0;
+    for (size_t l = 0; l < k; l++) {
+        buses[l]->syncDevices();
+        spent += cpus[l]->cycleCount();
+    }
+    return spent - start;
+}
+
+void BatchCpu::runLanes() {
+    size_t k = lanes();
+    for (size_t l = 0; l < k; l++) {
+        CPU& cpu = *cpus[l];
+        if (busy[l]) {
+            // what an interrupt or a DMA left in flight, as CPU::run() would
+            cpu.run_end = limit[l];
+            while (!cpu.complete() && cpu.clock_count < cpu.run_end)
+                cpu.step();
+            limit[l] = cpu.run_end;
+            cpu.run_end = UINT64_MAX;
+        }
+        load(l);
+
+        // internal RAM is stored to directly unless a block cache watches it
+        rams[l] = maps[l]->writePointer(0x00);
+        for (size_t page = 0; page <= (CPU_RAM_END >> 8) && rams[l]; page++)
+            if (!maps[l]->writePointer(static_cast<byte>(page)))
+                rams[l] = nullptr;
+    }
+
+    for (size_t page = 0; page < shared.size(); page++) {
+        const byte* pointer = k ? maps[0]->readPointer(static_cast<byte>(page)) : nullptr;
+        for (size_t l = 1; l < k && pointer; l++)
+            if (maps[l]->readPointer(static_cast<byte>(page)) != pointer)
+                pointer = nullptr;
+        shared[page] = pointer;
+    }
+
+    uniform = false;
+    byte code[3];
+    while (pickGroup(code)) {
+        if (count)
+            dispatch(code);
+    }
+
+    for (size_t l = 0; l < k; l++)
+        spill(l);
+}
+
+inline byte BatchCpu::readLane(size_t lane, h_word address) const {
+    if (address <= CPU_RAM_END)
+        return zero_pages[lane][address & (CPU_RAM_SIZE - 1)];
+    if (const byte* page = shared[address >> 8])
+        return page[address & 0xFF];
+    return maps[lane]->readPointer(address >> 8)[address & 0xFF];
+}
+
+inline void BatchCpu::writeLane(size_t lane, h_word address, byte data) {
+    if (address <= CPU_RAM_END && rams[lane]) {
+        rams[lane][address & (CPU_RAM_SIZE - 1)] = data;
+        written[lane] |= static_cast<byte>(1 << ((address >> 8) & 0x07));
+    } else {
+        maps[lane]->write(address, data);
+    }
+}
+
+bool BatchCpu::codeAt(size_t lane, h_word at, size_t length, byte* code) const {
+    for (size_t i = 0; i < length; i++) {
+        h_word address = static_cast<h_word>(at + i);
+        const byte* page = maps[lane]->readPointer(address >> 8);
+        if (!page)
+            return false;
+        code[i] = page[address & 0xFF];
+    }
+    return true;
+}
+
+bool BatchCpu::pickGroup(byte* code) {
+    size_t k = lanes();
+    size_t lead = 0;
+    if (!uniform) {
+        // lowest program counter first, so that lanes running behind on the
+        // same code catch up with the others and merge
+        lead = k;
+        for (size_t l = 0; l < k; l++)
+            if (clock[l] < limit[l] && (lead == k || pc[l] < pc[lead]))
+                lead = l;
+        if (lead == k)
+            return false;
+    }
+
+    h_word at = pc[lead];
+    code[1] = code[2] = 0;
+    size_t length = 0;
+    if (codeAt(lead, at, 1, code))
+        length = instructionLength(OP_TABLE[code[0]].addrmode);
+    if (!length || !codeAt(lead, at, length, code)) {
+        count = 0;
+        uniform = false;
+        stepScalar(lead);
+        return true;
+    }
+
+    // lanes fetching from the same host memory have the same bytes, others
+    // (code in RAM, other banks) are compared
+    count = 0;
+    if (shared[at >> 8] && shared[static_cast<h_word>(at + length - 1) >> 8]) {
+        if (uniform) {
+            // still every lane, in order
+            count = k;
+            return true;
+        }
+        for (size_t l = lead; l < k; l++)
+            if (clock[l] < limit[l] && pc[l] == at)
+                group[count++] = static_cast<uint32_t>(l);
+        return true;
+    }
+    for (size_t l = lead; l < k; l++) {
+        byte other[3] = {};
+        if (clock[l] < limit[l] && pc[l] == at && codeAt(l, at, length, other)
+            && std::memcmp(other, code, length) == 0)
+            group[count++] = static_cast<uint32_t>(l);
+    }
+    return true;
+}
+
+void BatchCpu::dispatch(const byte* code) {
+    switch (code[0]) {
+#define X(value, name, op, mode, cyc) case value: return execute<AddrMode::mode, Mnemonic::op, cyc>(code);
+        NES_OP_TABLE(X)
+#undef X
+    }
+}
+
+template <typename Keep>
+void BatchCpu::divert(Keep keep) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (keep(i)) {
+            group[kept] = group[i];
+            address[kept] = address[i];
+            crossed[kept] = crossed[i];
+            kept++;
+        } else {
+            diverted.push_back(group[i]);
+        }
+    }
+    count = kept;
+}
+
+template <AddrMode Mode, Mnemonic Op, byte Cycles>
+void BatchCpu::execute(const byte* code) {
+    using M = Mnemonic;
+    constexpr bool implied = Mode == AddrMode::IMP;
+    constexpr bool branch = Mode == AddrMode::REL;
+    constexpr bool addressed = !implied && !branch;
+    constexpr bool reads = !implied && fetches(Op);
+    constexpr bool modifies = !implied && (shifts(Op) || Op == M::INC || Op == M::DEC);
+    constexpr bool stores = Op == M::STA || Op == M::STX || Op == M::STY;
+    constexpr bool jumps = Op == M::JMP || Op == M::JSR || Op == M::RTS || Op == M::RTI || Op == M::BRK;
+    constexpr bool penalty = op_table_detail::readsOperand(Op) && op_table_detail::canCrossPage(Mode);
+
+    const h_word at = pc[group[0]];
+    const h_word next = static_cast<h_word>(at + instructionLength(Mode));
+    const h_word base = static_cast<h_word>(code[1] | (code[2] << 8));
+
+    // calls f(member, lane) over the group, as a plain loop when it is every
+    // lane so that the compiler can vectorize the bookkeeping
+    auto each = [&](auto f) {
+        if (whole) {
+            for (size_t i = 0; i < count; i++)
+                f(i, i);
+        } else {
+            for (size_t i = 0; i < count; i++)
+                f(i, group[i]);
+        }
+    };
+    whole = count == lanes();
+
+    // effective addresses, lane by lane
+    if constexpr (addressed) {
+        each([&](size_t i, size_t l) {
+            if constexpr (Mode == AddrMode::IMM) {
+                address[i] = static_cast<h_word>(at + 1);
+            } else if constexpr (Mode == AddrMode::ZP0) {
+                address[i] = code[1];
+            } else if constexpr (Mode == AddrMode::ZPX) {
+                address[i] = static_cast<byte>(code[1] + x[l]);
+            } else if constexpr (Mode == AddrMode::ZPY) {
+                address[i] = static_cast<byte>(code[1] + y[l]);
+            } else if constexpr (Mode == AddrMode::ABS || Mode == AddrMode::IND) {
+                address[i] = base;
+            } else if constexpr (Mode == AddrMode::ABX || Mode == AddrMode::ABY) {
+                address[i] = static_cast<h_word>(base + (Mode == AddrMode::ABX ? x[l] : y[l]));
+                crossed[i] = (address[i] & 0xFF00) != (base & 0xFF00);
+            } else if constexpr (Mode == AddrMode::IZX) {
+                const byte* zp = zero_pages[l];
+                byte pointer = static_cast<byte>(code[1] + x[l]);
+                address[i] = static_cast<h_word>(zp[pointer] | (zp[static_cast<byte>(pointer + 1)] << 8));
+            } else if constexpr (Mode == AddrMode::IZY) {
+                const byte* zp = zero_pages[l];
+                h_word pointer = static_cast<h_word>(zp[code[1]] | (zp[static_cast<byte>(code[1] + 1)] << 8));
+                address[i] = static_cast<h_word>(pointer + y[l]);
+                crossed[i] = (address[i] & 0xFF00) != (pointer & 0xFF00);
+            }
+        });
+    }
+
+    // whatever is not plain RAM/ROM goes through the lane's CPU
+    if constexpr ((reads && Mode != AddrMode::IMM) || stores) {
+        divert([&](size_t i) {
+            if (address[i] <= CPU_RAM_END)
+                return true;
+            const MemoryMap& memory = *maps[group[i]];
+            byte page = address[i] >> 8;
+            if constexpr (modifies || stores)
+                return memory.readPointer(page) && memory.ramPointer(page);
+            else
+                return shared[page] || memory.readPointer(page);
+        });
+    } else if constexpr (Mode == AddrMode::IND) {
+        divert([&](size_t i) { return maps[group[i]]->readPointer(code[2]) != nullptr; });
+    } else if constexpr (Op == M::BRK) {
+        divert([&](size_t i) { return maps[group[i]]->readPointer(0xFF) != nullptr; });
+    } else if constexpr (Op == M::CLI) {
+        // unmasking a held IRQ stops the lane's run, its CPU takes care of it
+        divert([&](size_t i) { return !buses[group[i]]->irqPending(); });
+    } else if constexpr (Op == M::PLP || Op == M::RTI) {
+        divert([&](size_t i) {
+            size_t l = group[i];
+            bool masked = stack_pages[l][static_cast<byte>(sp[l] + 1)] & I;
+            return masked || !buses[l]->irqPending();
+        });
+    }
+    whole = count == lanes();
+
+    if (count) {
+        const uint32_t* lanes_of = group.data();
+        const size_t n = count;
+
+        // the group's registers, gathered unless it is every lane
+        byte* ra = a.data();
+        byte* rx = x.data();
+        byte* ry = y.data();
+        byte* rs = status.data();
+        if (!whole) {
+            gather(a, lanes_of, n, ga.data());
+            gather(x, lanes_of, n, gx.data());
+            gather(y, lanes_of, n, gy.data());
+            gather(status, lanes_of, n, gs.data());
+            ra = ga.data();
+            rx = gx.data();
+            ry = gy.data();
+            rs = gs.data();
+        }
+
+        byte* m = operand.data();
+        if constexpr (Mode == AddrMode::IND) {
+            // the pointer wraps within its page
+            each([&](size_t i, size_t l) {
+                const byte* page = shared[code[2]] ? shared[code[2]] : maps[l]->readPointer(code[2]);
+                address[i] = static_cast<h_word>(page[code[1]] | (page[static_cast<byte>(code[1] + 1)] << 8));
+            });
+        }
+        if constexpr (reads && Mode == AddrMode::IMM)
+            std::memset(m, code[1], n);
+        else if constexpr (reads)
+            each([&](size_t i, size_t l) { m[i] = readLane(l, address[i]); });
+        each([&](size_t i, size_t l) {
+            opcode[l] = code[0];
+            if constexpr (implied)
+                fetched[l] = ra[i];
+            if constexpr (reads)
+                fetched[l] = m[i];
+            if constexpr (addressed)
+                addr_abs[l] = address[i];
+        });
+
+        auto push = [&](size_t l, byte value) {
+            writeLane(l, static_cast<h_word>(0x0100 + sp[l]), value);
+            sp[l]--;
+        };
+        auto pull = [&](size_t l) {
+            sp[l]++;
+            return stack_pages[l][sp[l]];
+        };
+
+        if constexpr (Op == M::ADC) {
+            addCarry(ra, rs, m, n);
+        } else if constexpr (Op == M::SBC) {
+            // the implied one (0xEB) subtracts a from itself
+            const byte* from = implied ? ra : m;
+            for (size_t i = 0; i < n; i++)
+                result[i] = static_cast<byte>(~from[i]);
+            addCarry(ra, rs, result.data(), n);
+        } else if constexpr (Op == M::AND || Op == M::ORA || Op == M::EOR) {
+            logic<Op>(ra, rs, m, n);
+        } else if constexpr (Op == M::BIT) {
+            bitTest(ra, rs, m, n);
+        } else if constexpr (Op == M::CMP || Op == M::CPX || Op == M::CPY) {
+            compare(Op == M::CMP ? ra : Op == M::CPX ? rx : ry, rs, m, n);
+        } else if constexpr (Op == M::LDA || Op == M::LDX || Op == M::LDY) {
+            transfer(Op == M::LDA ? ra : Op == M::LDX ? rx : ry, rs, m, n);
+        } else if constexpr (shifts(Op) && implied) {
+            shift<Op>(ra, rs, n);
+        } else if constexpr (modifies) {
+            std::memcpy(result.data(), m, n);
+            if constexpr (shifts(Op))
+                shift<Op>(result.data(), rs, n);
+            else
+                increment(result.data(), rs, Op == M::INC ? 1 : 0xFF, n);
+            for (size_t i = 0; i < n; i++)
+                writeLane(lanes_of[i], address[i], result[i]);
+        } else if constexpr (Op == M::INX || Op == M::DEX) {
+            increment(rx, rs, Op == M::INX ? 1 : 0xFF, n);
+        } else if constexpr (Op == M::INY || Op == M::DEY) {
+            increment(ry, rs, Op == M::INY ? 1 : 0xFF, n);
+        } else if constexpr (Op == M::TAX || Op == M::TAY) {
+            transfer(Op == M::TAX ? rx : ry, rs, ra, n);
+        } else if constexpr (Op == M::TXA || Op == M::TYA) {
+            transfer(ra, rs, Op == M::TXA ? rx : ry, n);
+        } else if constexpr (Op == M::TSX) {
+            gather(sp, lanes_of, n, m);
+            transfer(rx, rs, m, n);
+        } else if constexpr (Op == M::TXS) {
+            scatter(rx, lanes_of, n, sp);
+        } else if constexpr (Op == M::CLC || Op == M::SEC) {
+            setFlags(rs, C, Op == M::SEC ? C : 0, n);
+        } else if constexpr (Op == M::CLI || Op == M::SEI) {
+            setFlags(rs, I, Op == M::SEI ? I : 0, n);
+        } else if constexpr (Op == M::CLD || Op == M::SED) {
+            setFlags(rs, D, Op == M::SED ? D : 0, n);
+        } else if constexpr (Op == M::CLV) {
+            setFlags(rs, V, 0, n);
+        } else if constexpr (stores) {
+            const byte* from = Op == M::STA ? ra : Op == M::STX ? rx : ry;
+            for (size_t i = 0; i < n; i++)
+                writeLane(lanes_of[i], address[i], from[i]);
+        } else if constexpr (Op == M::PHA) {
+            for (size_t i = 0; i < n; i++)
+                push(lanes_of[i], ra[i]);
+        } else if constexpr (Op == M::PHP) {
+            // the break flag is set on the pushed copy only
+            for (size_t i = 0; i < n; i++)
+                push(lanes_of[i], rs[i] | B | U);
+        } else if constexpr (Op == M::PLA) {
+            for (size_t i = 0; i < n; i++) {
+                ra[i] = pull(lanes_of[i]);
+                rs[i] = zn(rs[i], ra[i]);
+            }
+        } else if constexpr (Op == M::PLP) {
+            for (size_t i = 0; i < n; i++)
+                rs[i] = static_cast<byte>((pull(lanes_of[i]) & ~B) | U);
+        } else if constexpr (Op == M::JMP) {
+            for (size_t i = 0; i < n; i++)
+                pc[lanes_of[i]] = address[i];
+        } else if constexpr (Op == M::JSR) {
+            h_word back = static_cast<h_word>(next - 1);
+            for (size_t i = 0; i < n; i++) {
+                size_t l = lanes_of[i];
+                push(l, back >> 8);
+                push(l, back & 0xFF);
+                pc[l] = address[i];
+            }
+        } else if constexpr (Op == M::RTS) {
+            for (size_t i = 0; i < n; i++) {
+                size_t l = lanes_of[i];
+                h_word lo = pull(l);
+                h_word hi = pull(l);
+                pc[l] = static_cast<h_word>(((hi << 8) | lo) + 1);
+            }
+        } else if constexpr (Op == M::RTI) {
+            for (size_t i = 0; i < n; i++) {
+                size_t l = lanes_of[i];
+                rs[i] = static_cast<byte>((pull(l) & ~B) | U);
+                h_word lo = pull(l);
+                h_word hi = pull(l);
+                pc[l] = static_cast<h_word>((hi << 8) | lo);
+            }
+        } else if constexpr (Op == M::BRK) {
+            // CPU::BRK() steps over the padding byte once more
+            h_word back = static_cast<h_word>(next + 1);
+            for (size_t i = 0; i < n; i++) {
+                size_t l = lanes_of[i];
+                push(l, back >> 8);
+                push(l, back & 0xFF);
+                push(l, rs[i] | B | U);
+                rs[i] |= I;
+                const byte* vectors = maps[l]->readPointer(0xFF);
+                pc[l] = static_cast<h_word>(vectors[0xFE] | (vectors[0xFF] << 8));
+            }
+        }
+        // NOP and XXX do nothing
+
+        if (!whole) {
+            scatter(ga.data(), lanes_of, n, a);
+            scatter(gx.data(), lanes_of, n, x);
+            scatter(gy.data(), lanes_of, n, y);
+            scatter(gs.data(), lanes_of, n, status);
+        }
+
+        // program counters and cycles
+        bool together = true;
+        each([&](size_t i, size_t l) {
+            uint64_t spent = Cycles;
+            if constexpr (penalty)
+                spent += crossed[i];
+            if constexpr (branch) {
+                h_word rel = static_cast<h_word>(static_cast<int8_t>(code[1]));
+                addr_rel[l] = rel;
+                h_word target = next;
+                if (branchTaken<Op>(rs[i])) {
+                    target = static_cast<h_word>(next + rel);
+                    addr_abs[l] = target;
+                    spent += (target & 0xFF00) != (next & 0xFF00) ? 2 : 1;
+                }
+                pc[l] = target;
+            } else if constexpr (!jumps) {
+                pc[l] = next;
+            }
+            clock[l] += spent;
+            if constexpr (branch || jumps)
+                together &= pc[l] == pc[lanes_of[0]];
+            together &= clock[l] < limit[l];
+        });
+        uniform = whole && together;
+
+        counters.batched += n;
+        counters.groups++;
+    } else {
+        uniform = false;
+    }
+
+    if (!diverted.empty()) {
+        uniform = false;
+        for (uint32_t l : diverted)
+            stepScalar(l);
+        diverted.clear();
+    }
+}
+
+void BatchCpu::stepScalar(size_t lane) {
+    CPU& cpu = *cpus[lane];
+    spill(lane);
+    // CPU::run(), for one instruction: shortenRun() from the I/O is honored
+    cpu.run_end = limit[lane];
+    cpu.step();
+    while (!cpu.complete() && cpu.clock_count < cpu.run_end)
+        cpu.step();
+    limit[lane] = cpu.run_end;
+    cpu.run_end = UINT64_MAX;
+    load(lane);
+    counters.scalar++;
+
+    // a mapper write may have switched banks
+    const MemoryMap& memory = *maps[lane];
+    for (size_t page = 0; page < shared.size(); page++)
+        if (shared[page] && memory.readPointer(static_cast<byte>(page)) != shared[page])
+            shared[page] = nullptr;
+}
+
+void BatchCpu::load(size_t lane) {
+    const CPU& cpu = *cpus[lane];
+    a[lane] = cpu.a;
+    x[lane] = cpu.x;
+    y[lane] = cpu.y;
+    sp[lane] = cpu.sp;
+    status[lane] = cpu.status;
+    pc[lane] = cpu.pc;
+    fetched[lane] = cpu.fetched;
+    opcode[lane] = cpu.opcode;
+    addr_abs[lane] = cpu.addr_abs;
+    addr_rel[lane] = cpu.addr_rel;
+    clock[lane] = cpu.clock_count;
+}
+
+void BatchCpu::spill(size_t lane) {
+    CPU& cpu = *cpus[lane];
+    for (byte page = 0; written[lane]; page++, written[lane] >>= 1)
+        if (written[lane] & 0x01)
+            maps[lane]->markPageDirty(page);
+    cpu.a = a[lane];
+    cpu.x = x[lane];
+    cpu.y = y[lane];
+    cpu.sp = sp[lane];
+    cpu.status = status[lane];
+    cpu.pc = pc[lane];
+    cpu.fetched = fetched[lane];
+    cpu.opcode = opcode[lane];
+    cpu.addr_abs = addr_abs[lane];
+    cpu.addr_rel = addr_rel[lane];
+    cpu.clock_count = clock[lane];
+}
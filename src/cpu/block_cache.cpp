@@ -0,0 +1,213 @@
+#include "block_cache.hpp"
+#include "cpu.hpp"
+
+// Addressing modes on a decoded operand, mirroring the ones in op_code.cpp
+// minus the reads of the instruction stream
+template <AddrMode Mode>
+inline byte CPU::resolve(h_word operand) {
+    if constexpr (Mode == AddrMode::IMP) {
+        fetched = a;
+    } else if constexpr (Mode == AddrMode::IMM || Mode == AddrMode::ZP0 || Mode == AddrMode::ABS) {
+        addr_abs = operand;
+    } else if constexpr (Mode == AddrMode::ZPX) {
+        addr_abs = (operand + x) & 0x00FF;
+    } else if constexpr (Mode == AddrMode::ZPY) {
+        addr_abs = (operand + y) & 0x00FF;
+    } else if constexpr (Mode == AddrMode::REL) {
+        addr_rel = operand;
+    } else if constexpr (Mode == AddrMode::ABX || Mode == AddrMode::ABY) {
+        addr_abs = operand + (Mode == AddrMode::ABX ? x : y);
+        // one more cycle when the index changes page
+        return (addr_abs & 0xFF00) != (operand & 0xFF00) ? 1 : 0;
+    } else if constexpr (Mode == AddrMode::IND) {
+        if ((operand & 0x00FF) == 0x00FF) // Simulate page boundary HW bug
+            addr_abs = (read(operand & 0xFF00) << 8) | read(operand);
+        else
+            addr_abs = (read(operand + 1) << 8) | read(operand);
+    } else if constexpr (Mode == AddrMode::IZX) {
+        h_word addr_offset = zero_page[(operand + x) & 0x00FF];
+        h_word addr_page = zero_page[(operand + x + 1) & 0x00FF];
+        addr_abs = (addr_page << 8) | addr_offset;
+    } else if constexpr (Mode == AddrMode::IZY) {
+        h_word addr_offset = zero_page[operand & 0x00FF];
+        h_word addr_page = zero_page[(operand + 1) & 0x00FF];
+        addr_abs = ((addr_page << 8) | addr_offset) + y;
+        return (addr_abs & 0xFF00) != (addr_page << 8) ? 1 : 0;
+    }
+    return 0;
+}
+
+template <AddrMode Mode, byte (CPU::*Operate)(), byte Cycles>
+byte CPU::executeDecoded(const DecodedOp& op) {
+    cycles = Cycles;
+    byte additional_cycle1 = resolve<Mode>(op.operand);
+    byte additional_cycle2 = (this->*Operate)();
+    byte page_cross = additional_cycle1 & additional_cycle2;
+    cycles += page_cross;
+    profileCycles(page_cross);
+    return cycles;
+}
+
+DecodedHandler CPU::decodedHandler(byte opcode) {
+    static constexpr DecodedHandler HANDLERS[256] = {
+#define X(code, name, op, mode, cyc) &CPU::executeDecoded<AddrMode::mode, &CPU::op, cyc>,
+        NES_OP_TABLE(X)
+#undef X
+    };
+    return HANDLERS[opcode];
+}
+
+namespace {
+    byte instructionLength(AddrMode mode) {
+        switch (mode) {
+        case AddrMode::IMP:
+            return 1;
+        case AddrMode::ABS:
+        case AddrMode::ABX:
+        case AddrMode::ABY:
+        case AddrMode::IND:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
+    // anything that may not fall through to the next instruction
+    bool endsBlock(const OpInfo& info) {
+        return info.addrmode == AddrMode::REL
+            || info.mnemonic == Mnemonic::JMP || info.mnemonic == Mnemonic::JSR
+            || info.mnemonic == Mnemonic::RTS || info.mnemonic == Mnemonic::RTI
+            || info.mnemonic == Mnemonic::BRK;
+    }
+}
+
+BlockCache::BlockCache(CPU& cpu, MemoryMap& memory) : cpu(cpu), memory(memory) {
+    memory.setWatcher(&BlockCache::onWatch, this);
+}
+
+BlockCache::~BlockCache() {
+    memory.setWatcher(nullptr, nullptr);
+    memory.unwatchAll();
+}
+
+void BlockCache::onWatch(void* context, byte page) {
+    static_cast<BlockCache*>(context)->invalidatePage(page);
+}
+
+void BlockCache::invalidatePage(byte page) {
+    // blocks starting on the previous page may run into this one
+    for (int p : { (int)page, (int)page - 1 }) {
+        if (p >= 0 && blocks[p]) {
+            retired.push_back(std::move(blocks[p]));
+            invalidated = true;
+        }
+    }
+}
+
+void BlockCache::flush() {
+    for (auto& page : blocks)
+        if (page)
+            retired.push_back(std::move(page));
+    invalidated = true;
+    memory.unwatchAll();
+}
+
+const Block* BlockCache::build(h_word start) {
+    auto block = std::make_unique<Block>();
+    size_t first_page = start >> 8;
+    size_t pc = start;
+
+    while (block->ops.size() < MAX_BLOCK) {
+        const byte* code = memory.readPointer(pc >> 8);
+        if (!code)
+            break;
+        byte opcode = code[pc & 0x00FF];
+        const OpInfo& info = OP_TABLE[opcode];
+
+        // the whole instruction must be readable and within the two pages
+        size_t next_pc = pc + instructionLength(info.addrmode);
+        size_t last = next_pc - 1;
+        if (last > 0xFFFF || (last >> 8) > first_page + 1)
+            break;
+        const byte* tail = memory.readPointer(last >> 8);
+        if (!tail)
+            break;
+
+        h_word operand = 0;
+        if (next_pc - pc == 2) {
+            byte value = (pc & 0x00FF) == 0x00FF ? tail[0] : code[(pc + 1) & 0x00FF];
+            if (info.addrmode == AddrMode::IMM)
+                operand = static_cast<h_word>(pc + 1);
+            else if (info.addrmode == AddrMode::REL)
+                operand = (value & 0x80) ? (value | 0xFF00) : value;
+            else
+                operand = value;
+        } else if (next_pc - pc == 3) {
+            byte lo = ((pc + 1) >> 8) == (pc >> 8) ? code[(pc + 1) & 0x00FF] : tail[(pc + 1) & 0x00FF];
+            byte hi = tail[(pc + 2) & 0x00FF];
+            operand = static_cast<h_word>((hi << 8) | lo);
+        }
+
+        block->ops.push_back({ CPU::decodedHandler(opcode), operand, static_cast<h_word>(next_pc), opcode });
+        block->cycles += info.cycles;
+        pc = next_pc;
+
+        if (endsBlock(info) || next_pc > 0xFFFF)
+            break;
+    }
+
+    if (block->ops.empty())
+        return nullptr;
+
+    // any write or remap of the pages it was read from drops it
+    memory.watch(static_cast<byte>(first_page));
+    if (((pc - 1) >> 8) != first_page)
+        memory.watch(static_cast<byte>(first_page + 1));
+
+    auto& page = blocks[first_page];
+    if (!page)
+        page = std::make_unique<PageBlocks>();
+    decoded++;
+    return ((*page)[start & 0x00FF] = std::move(block)).get();
+}
+
+void BlockCache::run() {
+    while (cpu.clock_count < cpu.run_end) {
+        // finish whatever clock(), an interrupt or a DMA left in flight
+        if (cpu.cycles || cpu.stall) {
+            cpu.step();
+            continue;
+        }
+
+        retired.clear();
+        invalidated = false;
+
+        const Block* block = nullptr;
+        if (const auto& page = blocks[cpu.pc >> 8])
+            block = (*page)[cpu.pc & 0x00FF].get();
+        if (!block)
+            block = build(cpu.pc);
+        if (!block) {
+            // code running from mapped I/O, nothing to cache
+            cpu.step();
+            executed++;
+            continue;
+        }
+
+        size_t ran = 0;
+        for (const DecodedOp& op : block->ops) {
+            ran++;
+            cpu.opcode = op.opcode;
+            cpu.trace();
+            cpu.profileStart();
+            cpu.pc = op.next_pc;
+            byte spent = (cpu.*op.handler)(op);
+            cpu.cycles = 0;
+            cpu.clock_count += spent;
+            // the block may just have rewritten itself, or started a DMA
+            if (cpu.clock_count >= cpu.run_end || invalidated || cpu.stall)
+                break;
+        }
+        executed += ran;
+    }
+}
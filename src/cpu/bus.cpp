@@ -1,23 +1,384 @@
 #include "bus.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+    // where each memory lives in a snapshot, from SaveState::ram on
+    const size_t RAM_AT = 0;
+    const size_t CART_RAM_AT = offsetof(SaveState, cart_ram) - offsetof(SaveState, ram);
+    const size_t VRAM_AT = offsetof(SaveState, vram) - offsetof(SaveState, ram);
+    const size_t CHR_RAM_AT = offsetof(SaveState, chr_ram) - offsetof(SaveState, ram);
+
+    const h_word APU_LAST = 0x4013;     // channel registers from $4000
+    const h_word OAM_DMA = 0x4014;
+    const h_word APU_STATUS = 0x4015;
+    const h_word JOYPAD1 = 0x4016;
+    const h_word JOYPAD2 = 0x4017;     // APU frame counter on writes
+
+    // a DMC sample fetch halts the CPU
+    const h_word DMC_STALL = 4;
+
+    // upper bits of a controller read, left on the data bus by the address
+    const byte JOYPAD_OPEN_BUS = 0x40;
+}
+
 Bus::Bus() {
-    // TODO change when implementing other devices
-    // reset ram content, TODO change when array is no more
+    // reset ram content
     for (auto &i : ram) i=0x00;
 
-    // connect CPU to bus
+    // mirrors are aliased pages, no masking on access
+    memory.mapRam(0x0000, CPU_RAM_END, ram.data(), ram.size());
+
+    // PPU registers, mirrored every 8 bytes up to $3FFF
+    memory.mapIo(0x2000, 0x3FFF, { this, &Bus::ppuRead, &Bus::ppuWrite });
+    memory.mapIo(0x4000, 0x40FF, { this, &Bus::ioRead, &Bus::ioWrite });
+    ppu.connect(memory);
+
+    vblank_event = scheduler.add(&Bus::onPpuEvent, this);
+    scanline_event = scheduler.add(&Bus::onPpuEvent, this);
+    apu_event = scheduler.add(&Bus::onApuEvent, this);
+    apu.setDmcReader(&Bus::dmcRead, this);
+
+    // connect CPU to bus, once the memory map is ready
     cpu.connectBus(this);
 }
 
-void Bus::write(h_word address, byte data) {
-    if (address >= 0x0000 && address <= BUS_RANGE)
-        ram[address] = data;
+Bus::~Bus() = default;
+
+void Bus::reset() {
+    cpu.reset();
+    ppu.reset();
+    syncApu();
+    apu.reset();
+    refreshDeadlines();
+}
+
+void Bus::clock() {
+    cpu.clock();
+    syncPpu();
+    scheduler.runDue(cpu.cycleCount());
+    serviceInterrupts();
+}
+
+uint64_t Bus::run(uint64_t cycles) {
+    uint64_t start = cpu.cycleCount();
+    uint64_t end = start + cycles;
+
+    if (lockstep) {
+        while (cpu.cycleCount() < end || !cpu.complete())
+            clock();
+        syncApu();
+        return cpu.cycleCount() - start;
+    }
+
+    // the CPU stops at the first instruction boundary past each deadline,
+    // which is where clock() would have taken the interrupt too
+    while (cpu.cycleCount() < end || !cpu.complete()) {
+        cpu.run(deadline(end) - cpu.cycleCount());
+        serviceDevices();
+    }
+    // whoever looks at the system next sees every device at the same time
+    syncDevices();
+    return cpu.cycleCount() - start;
+}
+
+void Bus::serviceDevices() {
+    scheduler.runDue(cpu.cycleCount());
+    serviceInterrupts();
+}
+
+uint64_t Bus::runFrame() {
+    uint64_t target = ppu.frameCount() + 1;
+    uint64_t cycles = 0;
+    while (ppu.frameCount() < target) {
+        // run() leaves the PPU caught up, whole CPU cycles up to the vblank
+        uint64_t dots = ppu.nextFrame() - ppu.dots();
+        cycles += run(dots / 3 + 1);
+    }
+    return cycles;
+}
+
+uint64_t Bus::deadline(uint64_t end) const {
+    uint64_t now = cpu.cycleCount();
+    // an interrupt held off by a DMA is retried every instruction; an IRQ
+    // masked by the I flag waits for the instruction clearing it to stop run()
+    if (ppu.nmiPending() || (irqPending() && !cpu.interruptsMasked()))
+        return now + 1;
+
+    return std::max(std::min(end, scheduler.next()), now + 1);
+}
+
+void Bus::schedule(size_t event, uint64_t time) {
+    scheduler.schedule(event, time);
+    cpu.shortenRun(time);
+}
+
+void Bus::refreshDeadlines() {
+    scheduleVblank();
+    scheduleScanline();
+    scheduleApu();
+}
+
+void Bus::scheduleDot(size_t event, uint64_t dot) {
+    if (dot == PPU::NO_EVENT) {
+        scheduler.cancel(event);
+        return;
+    }
+    // first cycle the dot is reached at, an estimate already behind the
+    // caught up PPU is retried on the next cycle
+    schedule(event, std::max((dot + 2) / 3, cpu.cycleCount() + 1));
+}
+
+void Bus::scheduleVblank() {
+    scheduleDot(vblank_event, ppu.nextVblank());
+}
+
+void Bus::scheduleScanline() {
+    scheduleDot(scanline_event, mapper && mapper->irqEnabled() ? ppu.nextScanline() : PPU::NO_EVENT);
+}
+
+void Bus::scheduleApu() {
+    uint64_t time = apu.nextEvent();
+    if (time == APU::NO_EVENT)
+        scheduler.cancel(apu_event);
+    else
+        schedule(apu_event, std::max(time, cpu.cycleCount() + 1));
+}
+
+void Bus::onApuEvent(void* device, uint64_t) {
+    Bus* bus = static_cast<Bus*>(device);
+    bus->syncApu();
+    bus->scheduleApu();
+}
+
+byte Bus::dmcRead(void* device, h_word address) {
+    Bus* bus = static_cast<Bus*>(device);
+    bus->cpu.addStall(DMC_STALL);
+    return bus->memory.read(address);
 }
 
-void Bus::read(h_word address, bool bReadOnly) {
-    if (address >= 0x0000 && address <= BUS_RANGE)
-        return ram[address];
-    
-    return 0x00; 
+void Bus::onPpuEvent(void* device, uint64_t) {
+    Bus* bus = static_cast<Bus*>(device);
+    bus->syncPpu();
+    bus->refreshDeadlines();
 }
 
+void Bus::serviceInterrupts() {
+    if (!cpu.complete())
+        return;
+    if (ppu.nmiPending()) {
+        ppu.acknowledgeNmi();
+        cpu.nmi();
+    } else if (irqPending()) {
+        cpu.irq();
+    }
+}
+
+byte Bus::ppuRead(void* device, h_word address, bool bReadOnly) {
+    Bus* bus = static_cast<Bus*>(device);
+    if (!bReadOnly)
+        bus->syncPpu();
+    return bus->ppu.readRegister(address, bReadOnly);
+}
+
+void Bus::ppuWrite(void* device, h_word address, byte data) {
+    Bus* bus = static_cast<Bus*>(device);
+    bus->syncPpu();
+    bus->ppu.writeRegister(address, data);
+    // PPUCTRL may raise NMI at once or move the vblank deadline
+    if ((address & 0x0007) == 0) {
+        bus->scheduleVblank();
+        if (bus->ppu.nmiPending())
+            bus->cpu.shortenRun(bus->cpu.cycleCount());
+    }
+}
+
+byte Bus::ioRead(void* device, h_word address, bool bReadOnly) {
+    Bus* bus = static_cast<Bus*>(device);
+    if (address == APU_STATUS) {
+        bus->syncApu();
+        byte status = bus->apu.readStatus(bReadOnly);
+        // the frame IRQ is acknowledged, the next one is due
+        if (!bReadOnly)
+            bus->scheduleApu();
+        return status;
+    }
+    if (address != JOYPAD1 && address != JOYPAD2)
+        return 0x00; // open bus
+    size_t port = address - JOYPAD1;
+    // while strobed the register keeps reloading, A is read over and over
+    if (bus->strobe)
+        bus->shifts[port] = bus->controllers[port];
+    byte bit = bus->shifts[port] & 0x01;
+    // ones come out once the 8 buttons are read
+    if (!bReadOnly && !bus->strobe)
+        bus->shifts[port] = 0x80 | (bus->shifts[port] >> 1);
+    return JOYPAD_OPEN_BUS | bit;
+}
+
+void Bus::ioWrite(void* device, h_word address, byte data) {
+    Bus* bus = static_cast<Bus*>(device);
+    if (address <= APU_LAST || address == APU_STATUS || address == JOYPAD2) {
+        bus->syncApu();
+        bus->apu.writeRegister(address, data);
+        bus->scheduleApu();
+        // enabling a one byte DMC sample raises its IRQ at once
+        if (bus->apu.irqPending() && !bus->cpu.interruptsMasked())
+            bus->cpu.shortenRun(bus->cpu.cycleCount());
+    } else if (address == JOYPAD1) {
+        // the buttons are latched while the strobe is high, and as it drops
+        if (bus->strobe || (data & 0x01))
+            bus->shifts = bus->controllers;
+        bus->strobe = data & 0x01;
+    } else if (address == OAM_DMA) {
+        bus->syncPpu();
+        byte page[256];
+        for (size_t i = 0; i < sizeof(page); i++)
+            page[i] = bus->memory.read(static_cast<h_word>((data << 8) | i));
+        bus->ppu.writeOam(page);
+        // the CPU is halted for the copy, one more cycle to align on odd ones
+        bus->cpu.addStall(513 + (bus->cpu.cycleCount() & 1));
+    }
+}
+
+void Bus::cartridgeWrite(void* device, h_word address, byte data) {
+    Bus* bus = static_cast<Bus*>(device);
+    // bank and mirroring switches apply from now on
+    bus->syncPpu();
+    bool irq_enabled = bus->mapper->irqEnabled();
+    bus->mapper->write(address, data);
+    if (bus->mapper->irqEnabled() != irq_enabled)
+        bus->scheduleScanline();
+}
+
+void Bus::insertCartridge(std::shared_ptr<const CartridgeImage> image) {
+    auto board = Mapper::create(std::move(image));
+    removeCartridge();
+    mapper = std::move(board);
+    mapper->connect(memory);
+    // the bus sees the register writes first, to keep the PPU and the
+    // deadlines up to date
+    memory.mapWriteIo(0x8000, 0xFFFF, { this, nullptr, &Bus::cartridgeWrite });
+    ppu.setCartridge(mapper.get());
+    refreshDeadlines();
+}
+
+void Bus::removeCartridge() {
+    syncPpu();
+    ppu.setCartridge(nullptr);
+    mapper.reset();
+    refreshDeadlines();
+}
+
+bool Bus::acceptsState(const SaveState& state) const {
+    uint16_t board = mapper ? mapper->image().mapper : MapperState::NONE;
+    return state.magic == SaveState::MAGIC && state.version == SaveState::VERSION
+        && state.size == sizeof(SaveState) && state.mapper.id == board;
+}
+
+void Bus::saveDevices(SaveState& state) const {
+    state.magic = SaveState::MAGIC;
+    state.version = SaveState::VERSION;
+    state.size = sizeof(SaveState);
+    state.reserved = 0;
+    cpu.saveState(state.cpu);
+    if (mapper) {
+        mapper->saveState(state.mapper);
+    } else {
+        std::memset(&state.mapper, 0, sizeof(state.mapper));
+        state.mapper.id = MapperState::NONE;
+    }
+    ppu.saveState(state.ppu);
+    apu.saveState(state.apu);
+    saveInputState(state.input);
+}
+
+void Bus::loadDevices(const SaveState& state) {
+    cpu.loadState(state.cpu);
+    if (mapper)
+        mapper->loadState(state.mapper);
+    ppu.loadState(state.ppu);
+    apu.loadState(state.apu);
+    loadInputState(state.input);
+    refreshDeadlines();
+}
+
+void Bus::saveInputState(InputState& state) const {
+    std::memset(&state, 0, sizeof(state));
+    state.shift[0] = shifts[0];
+    state.shift[1] = shifts[1];
+    state.strobe = strobe ? 1 : 0;
+}
+
+void Bus::loadInputState(const InputState& state) {
+    shifts = { state.shift[0], state.shift[1] };
+    strobe = state.strobe != 0;
+}
+
+void Bus::saveMemory(byte* out) const {
+    std::memcpy(out + RAM_AT, ram.data(), ram.size());
+    size_t cart_ram = mapper ? mapper->prgRamSize() : 0;
+    if (cart_ram)
+        std::memcpy(out + CART_RAM_AT, mapper->prgRam(), cart_ram);
+    std::memset(out + CART_RAM_AT + cart_ram, 0, CART_RAM_SIZE - cart_ram);
+    std::memcpy(out + VRAM_AT, ppu.vram(), PPU_VRAM_SIZE);
+    size_t chr_ram = mapper ? mapper->chrRamSize() : 0;
+    if (chr_ram)
+        std::memcpy(out + CHR_RAM_AT, mapper->chrRam(), chr_ram);
+    std::memset(out + CHR_RAM_AT + chr_ram, 0, CHR_RAM_SIZE - chr_ram);
+}
+
+void Bus::loadMemory(const byte* in) {
+    std::memcpy(ram.data(), in + RAM_AT, ram.size());
+    if (mapper && mapper->prgRamSize())
+        std::memcpy(mapper->prgRam(), in + CART_RAM_AT, mapper->prgRamSize());
+    std::memcpy(ppu.vram(), in + VRAM_AT, PPU_VRAM_SIZE);
+    if (mapper && mapper->chrRamSize())
+        std::memcpy(mapper->chrRam(), in + CHR_RAM_AT, mapper->chrRamSize());
+    memory.markAllDirty();
+}
+
+void Bus::saveState(SaveState& state) const {
+    saveDevices(state);
+    saveMemory(state.ram);
+}
+
+bool Bus::loadState(const SaveState& state) {
+    if (!acceptsState(state))
+        return false;
+    loadDevices(state);
+    loadMemory(state.ram);
+    return true;
+}
+
+uint64_t Bus::stateHash() const {
+    std::unique_ptr<SaveState> state = std::make_unique<SaveState>();
+    saveState(*state);
+    return fnv1a(state.get(), sizeof(SaveState));
+}
+
+size_t Bus::serialize(byte* buffer, size_t size) const {
+    if (size < sizeof(SaveState))
+        return 0;
+    // the layout is fixed: header and registers first, then the memory copied
+    // straight in place, the buffer needs no alignment
+    SaveState head;
+    saveDevices(head);
+    std::memcpy(buffer, &head, offsetof(SaveState, ram));
+    saveMemory(buffer + offsetof(SaveState, ram));
+    return sizeof(SaveState);
+}
+
+bool Bus::deserialize(const byte* buffer, size_t size) {
+    if (size < sizeof(SaveState))
+        return false;
+    SaveState head;
+    std::memcpy(&head, buffer, offsetof(SaveState, ram));
+    if (!acceptsState(head))
+        return false;
+    loadDevices(head);
+    loadMemory(buffer + offsetof(SaveState, ram));
+    return true;
+}
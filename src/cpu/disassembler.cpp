@@ -0,0 +1,28 @@
+#include "op_table.hpp"
+
+// Names are only needed for disassembly and traces, so they are kept apart
+// from the packed OP_TABLE that the CPU reads on every instruction.
+static const char* const MNEMONIC_NAMES[] = {
+#define M(op) #op,
+    NES_MNEMONICS(M)
+#undef M
+};
+
+static const char* const ADDRMODE_NAMES[] = {
+#define M(mode) #mode,
+    NES_ADDRMODES(M)
+#undef M
+};
+
+const char* mnemonicName(Mnemonic op) {
+    return MNEMONIC_NAMES[static_cast<byte>(op)];
+}
+
+const char* addrModeName(AddrMode mode) {
+    return ADDRMODE_NAMES[static_cast<byte>(mode)];
+}
+
+const char* opcodeName(byte opcode) {
+    const OpInfo& info = OP_TABLE[opcode];
+    return info.illegal() ? "???" : mnemonicName(info.mnemonic);
+}
@@ -0,0 +1,182 @@
+#include "memory_map.hpp"
+
+#include <stdexcept>
+
+void MemoryMap::mapRam(h_word first, h_word last, byte* data, size_t size) {
+    size_t pages_in_data = size / PAGE_SIZE;
+    bool released = covers(first, last);
+    for (size_t p = first >> 8, i = 0; p <= (size_t)(last >> 8); p++, i++) {
+        // mirrors alias the same host page
+        byte* host = data + (i % pages_in_data) * PAGE_SIZE;
+        pages[p].read = host;
+        pages[p].ram = host;
+        pages[p].write = pages[p].watched ? nullptr : host;
+        pages[p].slot = trackPage(host);
+        remapped(p);
+    }
+    if (released)
+        releaseSlots();
+}
+
+void MemoryMap::mapRom(h_word first, h_word last, const byte* data, size_t size) {
+    size_t pages_in_data = size / PAGE_SIZE;
+    bool released = covers(first, last);
+    for (size_t p = first >> 8, i = 0; p <= (size_t)(last >> 8); p++, i++) {
+        pages[p].read = data + (i % pages_in_data) * PAGE_SIZE;
+        pages[p].ram = nullptr;
+        pages[p].write = nullptr;
+        remapped(p);
+    }
+    if (released)
+        releaseSlots();
+}
+
+void MemoryMap::mapIo(h_word first, h_word last, const IoHandler& handler) {
+    bool released = covers(first, last);
+    for (size_t p = first >> 8; p <= (size_t)(last >> 8); p++) {
+        pages[p].read = nullptr;
+        pages[p].ram = nullptr;
+        pages[p].write = nullptr;
+        pages[p].io = handler;
+        remapped(p);
+    }
+    if (released)
+        releaseSlots();
+}
+
+void MemoryMap::mapWriteIo(h_word first, h_word last, const IoHandler& handler) {
+    bool released = covers(first, last);
+    for (size_t p = first >> 8; p <= (size_t)(last >> 8); p++) {
+        pages[p].ram = nullptr;
+        pages[p].write = nullptr;
+        pages[p].io = handler;
+    }
+    if (released)
+        releaseSlots();
+}
+
+void MemoryMap::unmap(h_word first, h_word last) {
+    bool released = covers(first, last);
+    for (size_t p = first >> 8; p <= (size_t)(last >> 8); p++) {
+        bool watched = pages[p].watched;
+        pages[p] = MemoryPage{};
+        pages[p].watched = watched;
+        remapped(p);
+    }
+    if (released)
+        releaseSlots();
+}
+
+void MemoryMap::setWatcher(WatchHandler handler, void* context) {
+    watcher = handler;
+    watcher_context = context;
+}
+
+void MemoryMap::watch(byte page) {
+    pages[page].watched = true;
+    pages[page].write = nullptr;
+
+    // the mirrors can rewrite the same bytes
+    if (byte* ram = pages[page].ram) {
+        for (auto& mirror : pages) {
+            if (mirror.ram == ram) {
+                mirror.watched = true;
+                mirror.write = nullptr;
+            }
+        }
+    }
+}
+
+void MemoryMap::unwatchAll() {
+    for (auto& page : pages) {
+        page.watched = false;
+        page.write = page.ram;
+    }
+}
+
+void MemoryMap::invalidateWatched() {
+    for (size_t p = 0; p < PAGE_COUNT; p++)
+        remapped(p);
+}
+
+void MemoryMap::remapped(size_t page) {
+    if (pages[page].watched && watcher)
+        watcher(watcher_context, static_cast<byte>(page));
+}
+
+bool MemoryMap::covers(h_word first, h_word last) const {
+    for (size_t p = first >> 8; p <= (size_t)(last >> 8); p++)
+        if (pages[p].ram)
+            return true;
+    return false;
+}
+
+void MemoryMap::releaseSlots() {
+    std::array<bool, MAX_TRACKED> used{};
+    for (const auto& page : pages)
+        if (page.ram)
+            used[page.slot] = true;
+    for (size_t slot = 0; slot < tracked_count; slot++) {
+        if (!used[slot] && !pinned[slot]) {
+            tracked[slot] = nullptr;
+            dirty[slot] = 0;
+        }
+    }
+}
+
+uint16_t MemoryMap::track(byte* page) {
+    uint16_t slot = trackPage(page);
+    pinned[slot] = true;
+    return slot;
+}
+
+void MemoryMap::untrack(uint16_t slot) {
+    pinned[slot] = false;
+    tracked[slot] = nullptr;
+    dirty[slot] = 0;
+}
+
+uint16_t MemoryMap::trackPage(byte* host) {
+    for (size_t slot = 0; slot < tracked_count; slot++)
+        if (tracked[slot] == host)
+            return static_cast<uint16_t>(slot);
+
+    // slots of unmapped RAM are recycled
+    for (size_t slot = 0; slot < tracked_count; slot++) {
+        if (!tracked[slot]) {
+            tracked[slot] = host;
+            dirty[slot] = 1;
+            return static_cast<uint16_t>(slot);
+        }
+    }
+
+    if (tracked_count == MAX_TRACKED)
+        throw std::length_error("MemoryMap: too many RAM pages to track");
+    tracked[tracked_count] = host;
+    dirty[tracked_count] = 1; // its content is unknown to any checkpoint yet
+    return static_cast<uint16_t>(tracked_count++);
+}
+
+byte MemoryMap::readIo(const MemoryPage& page, h_word address, bool bReadOnly) {
+    if (page.io.read)
+        return page.io.read(page.io.device, address, bReadOnly);
+    return 0x00; // open bus
+}
+
+void MemoryMap::writeSlow(const MemoryPage& page, h_word address, byte data) {
+    // watched RAM lands here, its direct pointer being hidden
+    if (page.ram) {
+        page.ram[address & 0x00FF] = data;
+        dirty[page.slot] = 1;
+        if (page.watched && watcher) {
+            // report every page showing these bytes
+            for (size_t p = 0; p < PAGE_COUNT; p++)
+                if (pages[p].ram == page.ram)
+                    watcher(watcher_context, static_cast<byte>(p));
+        }
+    } else if (page.io.write) {
+        // a ROM write cannot change ROM, a bank switch reports itself through
+        // the remap
+        page.io.write(page.io.device, address, data);
+    }
+}
@@ -58,9 +58,7 @@ byte CPU::ABX(){
     if ((addr_abs & 0xFF00) != (page_number <<8))
         return 1;
     else
-        return 0
-    
-    return 0;
+        return 0;
 }
 
 byte CPU::ABY(){
@@ -76,9 +74,7 @@ byte CPU::ABY(){
     if ((addr_abs & 0xFF00) != (page_number <<8))
         return 1;
     else
-        return 0
-    
-    return 0;
+        return 0;
 }
 
 byte CPU::IND(){
@@ -89,7 +85,7 @@ byte CPU::IND(){
     
     h_word ptr = (ptr_number<<8) | ptr_offset;
 
-    if (ptr_offset = 0x00FF) // Simulate page boundary HW bug 
+    if (ptr_offset == 0x00FF) // Simulate page boundary HW bug 
         addr_abs = (read(ptr & 0xFF00)<<8) | read(ptr+0);
     else // behave normally
         addr_abs = (read(ptr+1)<<8) | read(ptr+0);
@@ -101,8 +97,8 @@ byte CPU::IZX(){
     h_word addr = read(pc);
     pc++;
 
-    h_word addr_offset = read((h_word)(addr + (h_word)(x)) & 0x00FF);
-    h_word addr_page = read((h_word)(addr + (h_word)(x+1)) & 0x00FF);
+    h_word addr_offset = zero_page[(h_word)(addr + (h_word)(x)) & 0x00FF];
+    h_word addr_page = zero_page[(h_word)(addr + (h_word)(x+1)) & 0x00FF];
 
     addr_abs = (addr_page<<8) | addr_offset;
 
@@ -113,13 +109,13 @@ byte CPU::IZY(){
     h_word addr = read(pc);
     pc++;
 
-    h_word addr_offset = read(addr & 0x00FF);
-    h_word addr_page = read((addr+1) & 0x00FF);
+    h_word addr_offset = zero_page[addr & 0x00FF];
+    h_word addr_page = zero_page[(addr+1) & 0x00FF];
 
     addr_abs = (addr_page<<8) | addr_offset;
     addr_abs += y;
 
-    if ((addr_abs & 0x00FF) != (addr_page<<8)) // in case of out of bound and needing one more clock cycle
+    if ((addr_abs & 0xFF00) != (addr_page<<8)) // in case of out of bound and needing one more clock cycle
         return 1;
     else
         return 0;
@@ -139,19 +135,461 @@ byte CPU::REL(){
 // Instructions
 
 byte CPU::fetch(){
-    if(!(lookup[opcode].addrmode == &CPU::IMP))
+    if (lookup[opcode].addrmode != AddrMode::IMP)
         fetched = read(addr_abs);
     return fetched;
 }
 
+// Helper for the branch instructions, the relative jump costs one more cycle
+// and another one if it lands on a different page
+void CPU::branch(){
+    cycles++;
+    addr_abs = pc + addr_rel;
+
+    if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+        cycles++;
+
+    pc = addr_abs;
+}
+
+byte CPU::ADC(){
+    fetch();
+    h_word temp = (h_word)a + (h_word)fetched + (h_word)GetFlag(C);
+    SetFlag(C, temp > 0x00FF);
+    SetFlag(Z, (temp & 0x00FF) == 0x00);
+    // overflow when both operands share a sign that the result does not
+    SetFlag(V, (~((h_word)a ^ (h_word)fetched) & ((h_word)a ^ temp)) & 0x0080);
+    SetFlag(N, temp & 0x80);
+    a = temp & 0x00FF;
+    return 1;
+}
+
 byte CPU::AND(){
     fetch();
     a = a & fetched;
-    setFlag(Z, a==0x00);
-    setFlag(N, a==0x80);
+    SetFlag(Z, a==0x00);
+    SetFlag(N, a & 0x80);
     return 1;
 }
 
+byte CPU::ASL(){
+    fetch();
+    h_word temp = (h_word)fetched << 1;
+    SetFlag(C, (temp & 0xFF00) > 0);
+    SetFlag(Z, (temp & 0x00FF) == 0x00);
+    SetFlag(N, temp & 0x80);
+    if (lookup[opcode].addrmode == AddrMode::IMP)
+        a = temp & 0x00FF;
+    else
+        write(addr_abs, temp & 0x00FF);
+    return 0;
+}
+
+byte CPU::BCC(){
+    if (GetFlag(C) == 0)
+        branch();
+    return 0;
+}
+
 byte CPU::BCS(){
-    // TODO 40:36
-}
\ No newline at end of file
+    if (GetFlag(C) == 1)
+        branch();
+    return 0;
+}
+
+byte CPU::BEQ(){
+    if (GetFlag(Z) == 1)
+        branch();
+    return 0;
+}
+
+byte CPU::BIT(){
+    fetch();
+    h_word temp = a & fetched;
+    SetFlag(Z, (temp & 0x00FF) == 0x00);
+    SetFlag(N, fetched & (1 << 7));
+    SetFlag(V, fetched & (1 << 6));
+    return 0;
+}
+
+byte CPU::BMI(){
+    if (GetFlag(N) == 1)
+        branch();
+    return 0;
+}
+
+byte CPU::BNE(){
+    if (GetFlag(Z) == 0)
+        branch();
+    return 0;
+}
+
+byte CPU::BPL(){
+    if (GetFlag(N) == 0)
+        branch();
+    return 0;
+}
+
+byte CPU::BRK(){
+    pc++;
+
+    write(0x0100 + sp, (pc >> 8) & 0x00FF);
+    sp--;
+    write(0x0100 + sp, pc & 0x00FF);
+    sp--;
+
+    // the pushed P has B set and I as it was, like PHP
+    write(0x0100 + sp, status | B | U);
+    sp--;
+    SetFlag(I, 1);
+
+    pc = (h_word)read(0xFFFE) | ((h_word)read(0xFFFF) << 8);
+    return 0;
+}
+
+byte CPU::BVC(){
+    if (GetFlag(V) == 0)
+        branch();
+    return 0;
+}
+
+byte CPU::BVS(){
+    if (GetFlag(V) == 1)
+        branch();
+    return 0;
+}
+
+byte CPU::CLC(){
+    SetFlag(C, false);
+    return 0;
+}
+
+byte CPU::CLD(){
+    SetFlag(D, false);
+    return 0;
+}
+
+byte CPU::CLI(){
+    SetFlag(I, false);
+    unmaskIrq();
+    return 0;
+}
+
+byte CPU::CLV(){
+    SetFlag(V, false);
+    return 0;
+}
+
+byte CPU::CMP(){
+    fetch();
+    h_word temp = (h_word)a - (h_word)fetched;
+    SetFlag(C, a >= fetched);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    return 1;
+}
+
+byte CPU::CPX(){
+    fetch();
+    h_word temp = (h_word)x - (h_word)fetched;
+    SetFlag(C, x >= fetched);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    return 0;
+}
+
+byte CPU::CPY(){
+    fetch();
+    h_word temp = (h_word)y - (h_word)fetched;
+    SetFlag(C, y >= fetched);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    return 0;
+}
+
+byte CPU::DEC(){
+    fetch();
+    h_word temp = fetched - 1;
+    write(addr_abs, temp & 0x00FF);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    return 0;
+}
+
+byte CPU::DEX(){
+    x--;
+    SetFlag(Z, x == 0x00);
+    SetFlag(N, x & 0x80);
+    return 0;
+}
+
+byte CPU::DEY(){
+    y--;
+    SetFlag(Z, y == 0x00);
+    SetFlag(N, y & 0x80);
+    return 0;
+}
+
+byte CPU::EOR(){
+    fetch();
+    a = a ^ fetched;
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 1;
+}
+
+byte CPU::INC(){
+    fetch();
+    h_word temp = fetched + 1;
+    write(addr_abs, temp & 0x00FF);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    return 0;
+}
+
+byte CPU::INX(){
+    x++;
+    SetFlag(Z, x == 0x00);
+    SetFlag(N, x & 0x80);
+    return 0;
+}
+
+byte CPU::INY(){
+    y++;
+    SetFlag(Z, y == 0x00);
+    SetFlag(N, y & 0x80);
+    return 0;
+}
+
+byte CPU::JMP(){
+    pc = addr_abs;
+    return 0;
+}
+
+byte CPU::JSR(){
+    pc--;
+
+    write(0x0100 + sp, (pc >> 8) & 0x00FF);
+    sp--;
+    write(0x0100 + sp, pc & 0x00FF);
+    sp--;
+
+    pc = addr_abs;
+    return 0;
+}
+
+byte CPU::LDA(){
+    fetch();
+    a = fetched;
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 1;
+}
+
+byte CPU::LDX(){
+    fetch();
+    x = fetched;
+    SetFlag(Z, x == 0x00);
+    SetFlag(N, x & 0x80);
+    return 1;
+}
+
+byte CPU::LDY(){
+    fetch();
+    y = fetched;
+    SetFlag(Z, y == 0x00);
+    SetFlag(N, y & 0x80);
+    return 1;
+}
+
+byte CPU::LSR(){
+    fetch();
+    SetFlag(C, fetched & 0x0001);
+    h_word temp = fetched >> 1;
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    if (lookup[opcode].addrmode == AddrMode::IMP)
+        a = temp & 0x00FF;
+    else
+        write(addr_abs, temp & 0x00FF);
+    return 0;
+}
+
+byte CPU::NOP(){
+    return 0;
+}
+
+byte CPU::ORA(){
+    fetch();
+    a = a | fetched;
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 1;
+}
+
+byte CPU::PHA(){
+    write(0x0100 + sp, a);
+    sp--;
+    return 0;
+}
+
+byte CPU::PHP(){
+    // the break flag is set on the pushed copy only
+    write(0x0100 + sp, status | B | U);
+    sp--;
+    return 0;
+}
+
+byte CPU::PLA(){
+    sp++;
+    a = stack_page[sp];
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 0;
+}
+
+byte CPU::PLP(){
+    sp++;
+    // B only exists on the stack, U always reads as 1
+    status = (stack_page[sp] & ~B) | U;
+    if (!GetFlag(I))
+        unmaskIrq();
+    return 0;
+}
+
+byte CPU::ROL(){
+    fetch();
+    h_word temp = (h_word)(fetched << 1) | GetFlag(C);
+    SetFlag(C, temp & 0xFF00);
+    SetFlag(Z, (temp & 0x00FF) == 0x0000);
+    SetFlag(N, temp & 0x0080);
+    if (lookup[opcode].addrmode == AddrMode::IMP)
+        a = temp & 0x00FF;
+    else
+        write(addr_abs, temp & 0x00FF);
+    return 0;
+}
+
+byte CPU::ROR(){
+    fetch();
+    h_word temp = (h_word)(GetFlag(C) << 7) | (fetched >> 1);
+    SetFlag(C, fetched & 0x01);
+    SetFlag(Z, (temp & 0x00FF) == 0x00);
+    SetFlag(N, temp & 0x0080);
+    if (lookup[opcode].addrmode == AddrMode::IMP)
+        a = temp & 0x00FF;
+    else
+        write(addr_abs, temp & 0x00FF);
+    return 0;
+}
+
+byte CPU::RTI(){
+    sp++;
+    status = (stack_page[sp] & ~B) | U;
+
+    sp++;
+    pc = (h_word)stack_page[sp];
+    sp++;
+    pc |= (h_word)stack_page[sp] << 8;
+    if (!GetFlag(I))
+        unmaskIrq();
+    return 0;
+}
+
+byte CPU::RTS(){
+    sp++;
+    pc = (h_word)stack_page[sp];
+    sp++;
+    pc |= (h_word)stack_page[sp] << 8;
+
+    pc++;
+    return 0;
+}
+
+byte CPU::SBC(){
+    fetch();
+    // subtraction is an addition of the inverted operand
+    h_word value = ((h_word)fetched) ^ 0x00FF;
+    h_word temp = (h_word)a + value + (h_word)GetFlag(C);
+    SetFlag(C, temp & 0xFF00);
+    SetFlag(Z, ((temp & 0x00FF) == 0));
+    SetFlag(V, (temp ^ (h_word)a) & (temp ^ value) & 0x0080);
+    SetFlag(N, temp & 0x0080);
+    a = temp & 0x00FF;
+    return 1;
+}
+
+byte CPU::SEC(){
+    SetFlag(C, true);
+    return 0;
+}
+
+byte CPU::SED(){
+    SetFlag(D, true);
+    return 0;
+}
+
+byte CPU::SEI(){
+    SetFlag(I, true);
+    return 0;
+}
+
+byte CPU::STA(){
+    write(addr_abs, a);
+    return 0;
+}
+
+byte CPU::STX(){
+    write(addr_abs, x);
+    return 0;
+}
+
+byte CPU::STY(){
+    write(addr_abs, y);
+    return 0;
+}
+
+byte CPU::TAX(){
+    x = a;
+    SetFlag(Z, x == 0x00);
+    SetFlag(N, x & 0x80);
+    return 0;
+}
+
+byte CPU::TAY(){
+    y = a;
+    SetFlag(Z, y == 0x00);
+    SetFlag(N, y & 0x80);
+    return 0;
+}
+
+byte CPU::TSX(){
+    x = sp;
+    SetFlag(Z, x == 0x00);
+    SetFlag(N, x & 0x80);
+    return 0;
+}
+
+byte CPU::TXA(){
+    a = x;
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 0;
+}
+
+byte CPU::TXS(){
+    sp = x;
+    return 0;
+}
+
+byte CPU::TYA(){
+    a = y;
+    SetFlag(Z, a == 0x00);
+    SetFlag(N, a & 0x80);
+    return 0;
+}
+
+// Illegal opcodes are not emulated
+byte CPU::XXX(){
+    return 0;
+}
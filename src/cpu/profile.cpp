@@ -0,0 +1,143 @@
+#include "profile.hpp"
+#include "op_table.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t ADDRMODE_COUNT = 0
+#define M(mode) + 1
+        NES_ADDRMODES(M)
+#undef M
+        ;
+
+    struct ModeTotals {
+        uint64_t executed = 0;
+        uint64_t cycles = 0;
+        uint64_t page_cross = 0;
+    };
+
+    std::array<ModeTotals, ADDRMODE_COUNT> byMode(const CpuProfile& profile) {
+        std::array<ModeTotals, ADDRMODE_COUNT> modes = {};
+        for (size_t op = 0; op < 256; op++) {
+            ModeTotals& mode = modes[static_cast<size_t>(OP_TABLE[op].addrmode)];
+            mode.executed += profile.executed[op];
+            mode.cycles += profile.cycles[op];
+            mode.page_cross += profile.page_cross[op];
+        }
+        return modes;
+    }
+
+    std::FILE* create(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            throw std::runtime_error("cannot create " + path);
+        return file;
+    }
+}
+
+void CpuProfile::clear() {
+    executed.fill(0);
+    cycles.fill(0);
+    page_cross.fill(0);
+    std::fill(pc_hits.begin(), pc_hits.end(), 0);
+}
+
+uint64_t CpuProfile::totalInstructions() const {
+    uint64_t total = 0;
+    for (uint64_t count : executed)
+        total += count;
+    return total;
+}
+
+uint64_t CpuProfile::totalCycles() const {
+    uint64_t total = 0;
+    for (uint64_t count : cycles)
+        total += count;
+    return total;
+}
+
+std::vector<std::pair<h_word, uint64_t>> CpuProfile::hottest(size_t count) const {
+    std::vector<std::pair<h_word, uint64_t>> hits;
+    for (size_t address = 0; address < pc_hits.size(); address++)
+        if (pc_hits[address])
+            hits.emplace_back(static_cast<h_word>(address), pc_hits[address]);
+
+    count = std::min(count, hits.size());
+    // ties go to the lower address so exports are stable
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), [](const auto& l, const auto& r) {
+        return l.second != r.second ? l.second > r.second : l.first < r.first;
+    });
+    hits.resize(count);
+    return hits;
+}
+
+void CpuProfile::writeCsv(const std::string& path, size_t hot) const {
+    std::FILE* file = create(path);
+    std::fprintf(file, "table,key,name,mode,count,cycles,page_cross_cycles\n");
+
+    for (size_t op = 0; op < 256; op++) {
+        if (!executed[op])
+            continue;
+        std::fprintf(file, "opcode,0x%02zX,%s,%s,%llu,%llu,%llu\n", op, opcodeName(static_cast<byte>(op)),
+            addrModeName(OP_TABLE[op].addrmode), (unsigned long long)executed[op],
+            (unsigned long long)cycles[op], (unsigned long long)page_cross[op]);
+    }
+
+    auto modes = byMode(*this);
+    for (size_t mode = 0; mode < modes.size(); mode++) {
+        if (!modes[mode].executed)
+            continue;
+        const char* name = addrModeName(static_cast<AddrMode>(mode));
+        std::fprintf(file, "mode,%s,,%s,%llu,%llu,%llu\n", name, name,
+            (unsigned long long)modes[mode].executed, (unsigned long long)modes[mode].cycles,
+            (unsigned long long)modes[mode].page_cross);
+    }
+
+    for (const auto& hit : hottest(hot))
+        std::fprintf(file, "pc,0x%04X,,,%llu,,\n", hit.first, (unsigned long long)hit.second);
+
+    std::fclose(file);
+}
+
+void CpuProfile::writeJson(const std::string& path, size_t hot) const {
+    std::FILE* file = create(path);
+    std::fprintf(file, "{\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n",
+        (unsigned long long)totalInstructions(), (unsigned long long)totalCycles());
+
+    std::fprintf(file, "  \"opcodes\": [");
+    const char* separator = "\n";
+    for (size_t op = 0; op < 256; op++) {
+        if (!executed[op])
+            continue;
+        std::fprintf(file, "%s    { \"opcode\": %zu, \"name\": \"%s\", \"mode\": \"%s\", \"count\": %llu, "
+            "\"cycles\": %llu, \"page_cross_cycles\": %llu }", separator, op, opcodeName(static_cast<byte>(op)),
+            addrModeName(OP_TABLE[op].addrmode), (unsigned long long)executed[op],
+            (unsigned long long)cycles[op], (unsigned long long)page_cross[op]);
+        separator = ",\n";
+    }
+
+    std::fprintf(file, "\n  ],\n  \"modes\": [");
+    separator = "\n";
+    auto modes = byMode(*this);
+    for (size_t mode = 0; mode < modes.size(); mode++) {
+        if (!modes[mode].executed)
+            continue;
+        std::fprintf(file, "%s    { \"mode\": \"%s\", \"count\": %llu, \"cycles\": %llu, \"page_cross_cycles\": %llu }",
+            separator, addrModeName(static_cast<AddrMode>(mode)), (unsigned long long)modes[mode].executed,
+            (unsigned long long)modes[mode].cycles, (unsigned long long)modes[mode].page_cross);
+        separator = ",\n";
+    }
+
+    std::fprintf(file, "\n  ],\n  \"hot_pcs\": [");
+    separator = "\n";
+    for (const auto& hit : hottest(hot)) {
+        std::fprintf(file, "%s    { \"pc\": %u, \"count\": %llu }", separator, hit.first,
+            (unsigned long long)hit.second);
+        separator = ",\n";
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+
+    std::fclose(file);
+}
@@ -0,0 +1,148 @@
+#include "rewind_buffer.hpp"
+#include "bus.hpp"
+
+#include <cstring>
+
+namespace {
+    const size_t NO_SPACE = static_cast<size_t>(-1);
+}
+
+RewindBuffer::RewindBuffer(Bus& bus, size_t budget) : bus(bus), arena(budget) {
+    shadow.resize(MemoryMap::MAX_TRACKED * PAGE_SIZE);
+    changed.reserve(MemoryMap::MAX_TRACKED);
+}
+
+void RewindBuffer::clear() {
+    records.clear();
+    head = 0;
+    used = 0;
+}
+
+void RewindBuffer::dropOldest() {
+    used -= records.front().bytes;
+    records.pop_front();
+    // the new oldest record is never undone past, its entries are dead weight
+    // but keep their space until it goes too
+    if (records.empty())
+        head = 0;
+}
+
+size_t RewindBuffer::allocate(size_t bytes) {
+    if (bytes > arena.size())
+        return NO_SPACE;
+
+    for (;;) {
+        if (records.empty())
+            return 0;
+
+        // free space is [head, end) + [0, tail) when head is past the tail,
+        // [head, tail) otherwise; head never catches up with tail exactly
+        size_t tail = records.front().offset;
+        if (head > tail || (head == tail && records.front().bytes == 0)) {
+            if (head + bytes <= arena.size())
+                return head;
+            if (bytes < tail)
+                return 0;
+        } else if (head + bytes < tail) {
+            return head;
+        }
+        dropOldest();
+    }
+}
+
+void RewindBuffer::checkpoint() {
+    MemoryMap& memory = bus.memoryMap();
+
+    // pages written since the last checkpoint whose content really changed
+    changed.clear();
+    for (size_t slot = 0; slot < shadow_slots; slot++) {
+        if (memory.isDirty(slot) && std::memcmp(memory.trackedPage(slot), &shadow[slot * PAGE_SIZE], PAGE_SIZE))
+            changed.push_back(static_cast<uint16_t>(slot));
+    }
+
+    Record record;
+    bus.getCpu().saveState(record.cpu);
+    if (Mapper* mapper = bus.cartridge())
+        mapper->saveState(record.mapper);
+    else
+        record.mapper.id = MapperState::NONE;
+    bus.getPpu().saveState(record.ppu);
+    bus.getApu().saveState(record.apu);
+    bus.saveInputState(record.input);
+    record.pages = changed.size();
+    record.bytes = changed.size() * ENTRY_SIZE;
+    record.offset = allocate(record.bytes);
+    if (record.offset == NO_SPACE) {
+        // too big for the whole budget: start a new history from here, the
+        // oldest checkpoint never needs its undo entries
+        clear();
+        record.pages = 0;
+        record.bytes = 0;
+        record.offset = 0;
+    }
+
+    byte* out = arena.data() + record.offset;
+    for (uint16_t slot : changed) {
+        byte* page = &shadow[slot * PAGE_SIZE];
+        if (record.pages) {
+            std::memcpy(out, &slot, sizeof(slot));
+            std::memcpy(out + sizeof(slot), page, PAGE_SIZE);
+            out += ENTRY_SIZE;
+        }
+        std::memcpy(page, memory.trackedPage(slot), PAGE_SIZE);
+    }
+
+    // pages mapped since the last checkpoint have no past, they start here
+    for (size_t slot = shadow_slots; slot < memory.trackedCount(); slot++)
+        if (const byte* page = memory.trackedPage(slot))
+            std::memcpy(&shadow[slot * PAGE_SIZE], page, PAGE_SIZE);
+    shadow_slots = memory.trackedCount();
+
+    head = record.offset + record.bytes;
+    used += record.bytes;
+    records.push_back(record);
+    memory.clearDirty();
+}
+
+bool RewindBuffer::rewind(size_t steps) {
+    if (steps >= records.size())
+        return false;
+
+    MemoryMap& memory = bus.memoryMap();
+
+    // back to the newest checkpoint first
+    for (size_t slot = 0; slot < shadow_slots; slot++) {
+        if (memory.isDirty(slot))
+            std::memcpy(memory.trackedPage(slot), &shadow[slot * PAGE_SIZE], PAGE_SIZE);
+    }
+
+    // then undo whole checkpoints, newest first
+    for (size_t step = 0; step < steps; step++) {
+        const Record& record = records.back();
+        const byte* in = arena.data() + record.offset;
+        for (size_t i = 0; i < record.pages; i++) {
+            uint16_t slot;
+            std::memcpy(&slot, in, sizeof(slot));
+            // RAM unmapped since (cartridge removed) has nothing to restore
+            if (byte* page = memory.trackedPage(slot))
+                std::memcpy(page, in + sizeof(slot), PAGE_SIZE);
+            std::memcpy(&shadow[slot * PAGE_SIZE], in + sizeof(slot), PAGE_SIZE);
+            in += ENTRY_SIZE;
+        }
+        head = record.offset;
+        used -= record.bytes;
+        records.pop_back();
+    }
+
+    bus.getCpu().loadState(records.back().cpu);
+    if (Mapper* mapper = bus.cartridge())
+        mapper->loadState(records.back().mapper);
+    bus.getPpu().loadState(records.back().ppu);
+    bus.getApu().loadState(records.back().apu);
+    bus.loadInputState(records.back().input);
+    bus.refreshDeadlines();
+    memory.clearDirty();
+    // pages were rewritten behind write()'s back
+    memory.invalidateWatched();
+    return true;
+}
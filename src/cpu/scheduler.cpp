@@ -0,0 +1,89 @@
+#include "scheduler.hpp"
+
+#include <stdexcept>
+
+size_t Scheduler::add(EventHandler handler, void* device) {
+    if (registered == MAX_EVENTS)
+        throw std::length_error("Scheduler: too many kinds of event");
+    events[registered].handler = handler;
+    events[registered].device = device;
+    return registered++;
+}
+
+void Scheduler::schedule(size_t event, uint64_t time) {
+    Event& e = events[event];
+    if (e.position == NOT_PENDING) {
+        e.time = time;
+        place(count++, static_cast<byte>(event));
+        siftUp(e.position);
+        return;
+    }
+    uint64_t old = e.time;
+    e.time = time;
+    if (time < old)
+        siftUp(e.position);
+    else
+        siftDown(e.position);
+}
+
+void Scheduler::cancel(size_t event) {
+    if (events[event].position != NOT_PENDING)
+        remove(events[event].position);
+}
+
+uint64_t Scheduler::deadline(size_t event) const {
+    return events[event].position == NOT_PENDING ? NEVER : events[event].time;
+}
+
+void Scheduler::place(size_t position, byte event) {
+    heap[position] = event;
+    events[event].position = static_cast<byte>(position);
+}
+
+void Scheduler::siftUp(size_t position) {
+    byte event = heap[position];
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (!before(event, heap[parent]))
+            break;
+        place(position, heap[parent]);
+        position = parent;
+    }
+    place(position, event);
+}
+
+void Scheduler::siftDown(size_t position) {
+    byte event = heap[position];
+    for (;;) {
+        size_t child = position * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && before(heap[child + 1], heap[child]))
+            child++;
+        if (!before(heap[child], event))
+            break;
+        place(position, heap[child]);
+        position = child;
+    }
+    place(position, event);
+}
+
+void Scheduler::remove(size_t position) {
+    byte event = heap[position];
+    events[event].position = NOT_PENDING;
+    events[event].time = NEVER;
+    if (position == --count)
+        return;
+    byte moved = heap[count];
+    place(position, moved);
+    // the moved event may belong above or below
+    siftUp(position);
+    siftDown(events[moved].position);
+}
+
+void Scheduler::fireFirst() {
+    byte event = heap[0];
+    uint64_t time = events[event].time;
+    remove(0);
+    events[event].handler(events[event].device, time);
+}
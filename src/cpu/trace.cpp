@@ -0,0 +1,108 @@
+#include "trace.hpp"
+
+#include <stdexcept>
+
+TraceWriter::TraceWriter(const std::string& path) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("cannot create " + path);
+
+    TraceHeader header = { TraceHeader::MAGIC, TraceHeader::VERSION, sizeof(TraceRecord), 0 };
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    current.reset(new TraceRecord[CHUNK_RECORDS]);
+    cursor = current.get();
+    end = cursor + CHUNK_RECORDS;
+
+    writer = std::thread(&TraceWriter::writerLoop, this);
+}
+
+TraceWriter::~TraceWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_one();
+    writer.join();
+    std::fclose(file);
+}
+
+void TraceWriter::submit() {
+    size_t size = cursor - current.get();
+    if (size == 0)
+        return;
+
+    Records next;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back({ std::move(current), size });
+        if (!spare.empty()) {
+            next = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    ready.notify_one();
+
+    // never wait for the disk, grow instead
+    if (!next)
+        next.reset(new TraceRecord[CHUNK_RECORDS]);
+
+    submitted += size;
+    current = std::move(next);
+    cursor = current.get();
+    end = cursor + CHUNK_RECORDS;
+}
+
+void TraceWriter::flush() {
+    submit();
+    std::unique_lock<std::mutex> guard(lock);
+    drained.wait(guard, [this] { return queue.empty() && !writing; });
+    std::fflush(file);
+}
+
+void TraceWriter::writerLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        ready.wait(guard, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            // stopping, and everything is written
+            return;
+        }
+
+        Chunk chunk = std::move(queue.front());
+        queue.pop_front();
+        writing = true;
+
+        guard.unlock();
+        std::fwrite(chunk.records.get(), sizeof(TraceRecord), chunk.size, file);
+        guard.lock();
+
+        writing = false;
+        spare.push_back(std::move(chunk.records));
+        if (queue.empty())
+            drained.notify_all();
+    }
+}
+
+std::vector<TraceRecord> readTrace(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+
+    TraceHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != TraceHeader::MAGIC
+        || header.version != TraceHeader::VERSION || header.record_size != sizeof(TraceRecord)) {
+        std::fclose(file);
+        throw std::runtime_error(path + ": not a trace file of this version");
+    }
+
+    std::vector<TraceRecord> records;
+    TraceRecord chunk[4096];
+    size_t read;
+    while ((read = std::fread(chunk, sizeof(TraceRecord), 4096, file)) > 0)
+        records.insert(records.end(), chunk, chunk + read);
+
+    std::fclose(file);
+    return records;
+}
@@ -0,0 +1,72 @@
+#include "batch_runner.hpp"
+#include "bus.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // State of one instance while the batch runs
+    struct Job {
+        const BatchInstance* instance = nullptr;
+        InstanceReport* report = nullptr;
+        std::unique_ptr<Bus> bus;
+        uint64_t slice = 0;
+    };
+
+    void runSlice(ThreadPool& pool, Job& job) {
+        auto start = Clock::now();
+
+        // the system is built by the first worker to run it, so its memory
+        // is first touched on the core that uses it
+        if (!job.bus) {
+            job.bus = std::make_unique<Bus>();
+            job.bus->insertCartridge(job.instance->rom);
+            job.bus->reset();
+            job.bus->getCpu().setProfiler(job.instance->profile);
+        }
+
+        uint64_t remaining = job.instance->cycles - job.report->cycles;
+        job.report->cycles += job.bus->run(std::min(job.slice, remaining));
+
+        job.report->seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        job.report->worker = ThreadPool::currentWorker();
+
+        if (job.report->cycles < job.instance->cycles)
+            pool.submit([&pool, &job] { runSlice(pool, job); });
+        else
+            job.bus.reset();
+    }
+}
+
+uint64_t BatchReport::totalCycles() const {
+    uint64_t total = 0;
+    for (const auto& instance : instances)
+        total += instance.cycles;
+    return total;
+}
+
+BatchReport BatchRunner::run(const std::vector<BatchInstance>& instances, uint64_t slice_cycles) {
+    BatchReport report;
+    report.threads = pool.size();
+    report.instances.resize(instances.size());
+
+    std::vector<Job> jobs(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        jobs[i].instance = &instances[i];
+        jobs[i].report = &report.instances[i];
+        jobs[i].slice = slice_cycles ? slice_cycles : DEFAULT_SLICE;
+        report.instances[i].rom = instances[i].rom->name;
+    }
+
+    auto start = Clock::now();
+    for (auto& job : jobs) {
+        if (job.instance->cycles > 0)
+            pool.submit([this, &job] { runSlice(pool, job); });
+    }
+    pool.wait();
+    report.wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return report;
+}
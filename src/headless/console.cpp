@@ -0,0 +1,87 @@
+#include "console.hpp"
+#include "movie.hpp"
+
+Console::Console(const OutputConfig& config)
+    : video_ring(config.video_frames, config.backpressure),
+      audio_ring(config.audio_blocks, config.backpressure) {
+    PPU& ppu = bus.getPpu();
+    ppu.setFrameBuffer(nextBuffer());
+    ppu.setFrameHandler(onFrame, this);
+}
+
+Console::~Console() {
+    bus.getPpu().setFrameHandler(nullptr, nullptr);
+}
+
+uint64_t Console::runFrames(uint64_t count) {
+    uint64_t cycles = 0;
+    for (uint64_t f = 0; f < count; f++) {
+        if (recording)
+            recording->record(bus.controller(0), bus.controller(1));
+        if (!run_ahead) {
+            cycles += bus.runFrame();
+            publishAudio();
+            continue;
+        }
+        // the real frame, then the frames ahead of it, the last one shown
+        hidden = run_ahead;
+        cycles += bus.runFrame();
+        publishAudio();
+        bus.saveState(snapshot);
+        APU& apu = bus.getApu();
+        bool heard = apu.outputEnabled();
+        apu.setOutputEnabled(false);
+        for (unsigned ahead = 0; ahead < run_ahead; ahead++)
+            bus.runFrame();
+        bus.loadState(snapshot);
+        apu.setOutputEnabled(heard);
+    }
+    return cycles;
+}
+
+void Console::closeOutputs() {
+    video_ring.close();
+    audio_ring.close();
+}
+
+void Console::publishAudio() {
+    APU& apu = bus.getApu();
+    AudioBlock* block = audio_ring.acquire();
+    if (!block) {
+        if (apu.samplesAvailable())
+            dropped_audio.fetch_add(1, std::memory_order_relaxed);
+        apu.readSamples(nullptr, apu.samplesAvailable());
+        return;
+    }
+    // a block holds more than a frame; past that, the oldest samples go
+    size_t extra = apu.samplesAvailable() > AudioBlock::CAPACITY ? apu.samplesAvailable() - AudioBlock::CAPACITY : 0;
+    apu.readSamples(nullptr, extra);
+    block->frame = bus.getPpu().frameCount();
+    block->rate = apu.sampleRate();
+    block->count = static_cast<uint32_t>(apu.readSamples(block->samples.data(), AudioBlock::CAPACITY));
+    audio_ring.publish();
+}
+
+byte* Console::nextBuffer() {
+    rendering = video_ring.acquire();
+    return rendering ? rendering->pixels.data() : scratch.data();
+}
+
+byte* Console::onFrame(void* device, byte* frame) {
+    Console* console = static_cast<Console*>(device);
+    // run-ahead: the PPU draws over the same buffer until the frame to show
+    if (console->hidden) {
+        console->hidden--;
+        return nullptr;
+    }
+    VideoFrame* done = console->rendering;
+    if (done && frame == done->pixels.data()) {
+        const PPU& ppu = console->bus.getPpu();
+        done->number = ppu.frameCount();
+        done->timestamp = ppu.dots() / 3;
+        console->video_ring.publish();
+    } else {
+        console->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return console->nextBuffer();
+}
@@ -0,0 +1,432 @@
+#include "corpus_runner.hpp"
+#include "bus.hpp"
+#include "mapper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const byte SIGNATURE_BYTES[3] = { 0xDE, 0xB0, 0x61 };
+    const size_t TEXT_MAX = 0x7FFF - CorpusRunner::TEXT + 1;
+
+    std::FILE* create(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            throw std::runtime_error("cannot create " + path);
+        return file;
+    }
+
+    // State of one ROM while the corpus runs
+    struct Job {
+        RomResult* result = nullptr;
+        uint64_t budget = 0;
+        const ResultCache* cache = nullptr;
+        std::unique_ptr<Bus> bus;
+        byte last_status = 0;
+        uint64_t reset_at = 0;      // cycle to press reset on, 0 if not asked for
+    };
+
+    bool hasSignature(Bus& bus) {
+        for (h_word i = 0; i < 3; i++)
+            if (bus.read(static_cast<h_word>(CorpusRunner::SIGNATURE + i), true) != SIGNATURE_BYTES[i])
+                return false;
+        return true;
+    }
+
+    // the text the ROM printed, what is not printable ASCII becomes '?'
+    std::string readText(Bus& bus) {
+        std::string text;
+        for (size_t i = 0; i < TEXT_MAX; i++) {
+            byte c = bus.read(static_cast<h_word>(CorpusRunner::TEXT + i), true);
+            if (!c)
+                break;
+            text += (c == '\n' || (c >= 0x20 && c < 0x7F)) ? static_cast<char>(c) : '?';
+        }
+        while (!text.empty() && (text.back() == '\n' || text.back() == ' '))
+            text.pop_back();
+        return text;
+    }
+
+    // loads the ROM, or takes its result from the cache; false if there is
+    // nothing to run
+    bool start(Job& job) {
+        RomResult& result = *job.result;
+        std::shared_ptr<const CartridgeImage> rom;
+        try {
+            rom = CartridgeImage::load(result.path);
+        } catch (const std::exception& e) {
+            result.status = RomStatus::Error;
+            result.message = e.what();
+            return false;
+        }
+
+        result.hash = rom->hash();
+        if (!Mapper::supports(rom->mapper)) {
+            result.status = RomStatus::Error;
+            result.message = "mapper " + std::to_string(rom->mapper) + " is not supported";
+            return false;
+        }
+        if (job.cache) {
+            if (const RomResult* hit = job.cache->find(result.hash, job.budget)) {
+                std::string path = result.path;
+                result = *hit;
+                result.path = path;
+                result.cached = true;
+                return false;
+            }
+        }
+
+        job.bus = std::make_unique<Bus>();
+        job.bus->insertCartridge(rom);
+        job.bus->reset();
+        return true;
+    }
+
+    // true once the ROM gave its result
+    bool check(Job& job) {
+        Bus& bus = *job.bus;
+        RomResult& result = *job.result;
+        if (job.reset_at && result.cycles >= job.reset_at) {
+            bus.reset();
+            job.reset_at = 0;
+        }
+        if (!hasSignature(bus))
+            return false;
+
+        byte status = bus.read(CorpusRunner::STATUS, true);
+        if (status < CorpusRunner::RUNNING) {
+            result.status = status ? RomStatus::Failed : RomStatus::Passed;
+            result.code = status;
+            result.message = readText(bus);
+            return true;
+        }
+        // the ROM keeps $81 until it runs again after the reset
+        if (status == CorpusRunner::NEEDS_RESET && job.last_status != CorpusRunner::NEEDS_RESET)
+            job.reset_at = result.cycles + CorpusRunner::RESET_DELAY;
+        job.last_status = status;
+        return false;
+    }
+
+    void runSlice(ThreadPool& pool, Job& job) {
+        auto begin = Clock::now();
+        RomResult& result = *job.result;
+
+        bool done = false;
+        if (!job.bus && !start(job)) {
+            done = true;
+        } else {
+            uint64_t remaining = job.budget - result.cycles;
+            result.cycles += job.bus->run(std::min(CorpusRunner::SLICE, remaining));
+            done = check(job);
+            if (!done && result.cycles >= job.budget) {
+                result.status = RomStatus::Timeout;
+                result.message = hasSignature(*job.bus) ? readText(*job.bus) : std::string();
+                done = true;
+            }
+        }
+
+        if (!result.cached)
+            result.seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+        if (done)
+            job.bus.reset();
+        else
+            pool.submit([&pool, &job] { runSlice(pool, job); });
+    }
+
+    std::string escapeJson(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                out += code;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    std::string escapeXml(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&apos;"; break;
+            default:
+                // XML 1.0 has no other control characters
+                out += (static_cast<unsigned char>(c) < 0x20 && c != '\n' && c != '\t') ? '?' : c;
+            }
+        }
+        return out;
+    }
+
+    // cache fields are tab separated, one result per line
+    std::string escapeField(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '\\')
+                out += "\\\\";
+            else if (c == '\n')
+                out += "\\n";
+            else if (c == '\t')
+                out += "\\t";
+            else
+                out += c;
+        }
+        return out;
+    }
+
+    std::string unescapeField(const std::string& text) {
+        std::string out;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\' || i + 1 == text.size()) {
+                out += text[i];
+                continue;
+            }
+            char c = text[++i];
+            out += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+        }
+        return out;
+    }
+
+    std::vector<std::string> splitFields(const std::string& line) {
+        std::vector<std::string> fields(1);
+        for (char c : line) {
+            if (c == '\t')
+                fields.emplace_back();
+            else
+                fields.back() += c;
+        }
+        return fields;
+    }
+
+    // JUnit names: the file name, and its directory with dots
+    std::string caseName(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    std::string className(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash);
+        while (dir.compare(0, 2, "./") == 0)
+            dir.erase(0, 2);
+        while (!dir.empty() && (dir[0] == '/' || dir[0] == '.'))
+            dir.erase(0, 1);
+        std::replace(dir.begin(), dir.end(), '/', '.');
+        return dir.empty() ? "corpus" : dir;
+    }
+}
+
+const char* romStatusName(RomStatus status) {
+    switch (status) {
+    case RomStatus::Passed: return "passed";
+    case RomStatus::Failed: return "failed";
+    case RomStatus::Timeout: return "timeout";
+    case RomStatus::Error: return "error";
+    }
+    return "error";
+}
+
+size_t CorpusReport::count(RomStatus status) const {
+    return static_cast<size_t>(std::count_if(results.begin(), results.end(),
+        [status](const RomResult& result) { return result.status == status; }));
+}
+
+size_t CorpusReport::cachedCount() const {
+    return static_cast<size_t>(std::count_if(results.begin(), results.end(),
+        [](const RomResult& result) { return result.cached; }));
+}
+
+void CorpusReport::writeJUnit(const std::string& path) const {
+    std::FILE* file = create(path);
+    size_t failures = count(RomStatus::Failed);
+    size_t errors = count(RomStatus::Timeout) + count(RomStatus::Error);
+    std::fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    std::fprintf(file, "<testsuites name=\"nes_corpus\" tests=\"%zu\" failures=\"%zu\" errors=\"%zu\" time=\"%.3f\">\n",
+        results.size(), failures, errors, wall_seconds);
+    std::fprintf(file, "  <testsuite name=\"nes_corpus\" tests=\"%zu\" failures=\"%zu\" errors=\"%zu\" skipped=\"0\" "
+        "time=\"%.3f\">\n", results.size(), failures, errors, wall_seconds);
+    std::fprintf(file, "    <properties>\n      <property name=\"build_id\" value=\"%s\"/>\n"
+        "      <property name=\"cycles\" value=\"%" PRIu64 "\"/>\n      <property name=\"threads\" value=\"%zu\"/>\n"
+        "    </properties>\n", escapeXml(build_id).c_str(), cycles, threads);
+
+    for (const RomResult& result : results) {
+        std::fprintf(file, "    <testcase classname=\"%s\" name=\"%s\" time=\"%.3f\">\n",
+            escapeXml(className(result.path)).c_str(), escapeXml(caseName(result.path)).c_str(), result.seconds);
+        std::string text = escapeXml(result.message);
+        switch (result.status) {
+        case RomStatus::Passed:
+            break;
+        case RomStatus::Failed:
+            std::fprintf(file, "      <failure message=\"result code %d\" type=\"failed\">%s</failure>\n",
+                result.code, text.c_str());
+            break;
+        case RomStatus::Timeout:
+            std::fprintf(file, "      <error message=\"no result after %" PRIu64 " cycles\" type=\"timeout\">%s</error>\n",
+                result.cycles, text.c_str());
+            break;
+        case RomStatus::Error:
+            std::fprintf(file, "      <error message=\"%s\" type=\"error\"/>\n", text.c_str());
+            break;
+        }
+        if (result.status == RomStatus::Passed && !text.empty())
+            std::fprintf(file, "      <system-out>%s</system-out>\n", text.c_str());
+        std::fprintf(file, "      <properties>\n        <property name=\"hash\" value=\"%016" PRIx64 "\"/>\n"
+            "        <property name=\"cached\" value=\"%s\"/>\n      </properties>\n",
+            result.hash, result.cached ? "true" : "false");
+        std::fprintf(file, "    </testcase>\n");
+    }
+    std::fprintf(file, "  </testsuite>\n</testsuites>\n");
+    std::fclose(file);
+}
+
+void CorpusReport::writeJson(const std::string& path) const {
+    std::FILE* file = create(path);
+    std::fprintf(file, "{\n  \"build_id\": \"%s\",\n  \"cycles\": %" PRIu64 ",\n  \"threads\": %zu,\n"
+        "  \"wall_seconds\": %.3f,\n", escapeJson(build_id).c_str(), cycles, threads, wall_seconds);
+    std::fprintf(file, "  \"passed\": %zu,\n  \"failed\": %zu,\n  \"timeout\": %zu,\n  \"error\": %zu,\n"
+        "  \"cached\": %zu,\n", count(RomStatus::Passed), count(RomStatus::Failed), count(RomStatus::Timeout),
+        count(RomStatus::Error), cachedCount());
+
+    std::fprintf(file, "  \"roms\": [");
+    const char* separator = "\n";
+    for (const RomResult& result : results) {
+        std::fprintf(file, "%s    { \"path\": \"%s\", \"hash\": \"%016" PRIx64 "\", \"status\": \"%s\", \"code\": %d, "
+            "\"cycles\": %" PRIu64 ", \"seconds\": %.3f, \"cached\": %s, \"message\": \"%s\" }", separator,
+            escapeJson(result.path).c_str(), result.hash, romStatusName(result.status), result.code,
+            result.cycles, result.seconds, result.cached ? "true" : "false", escapeJson(result.message).c_str());
+        separator = ",\n";
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+    std::fclose(file);
+}
+
+void ResultCache::load(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (!file)
+        return;
+
+    // hash, build, budget, status, code, cycles, seconds, path, message
+    std::string line;
+    int c;
+    do {
+        c = std::fgetc(file);
+        if (c != '\n' && c != EOF) {
+            line += static_cast<char>(c);
+            continue;
+        }
+        std::vector<std::string> fields = splitFields(line);
+        line.clear();
+        if (fields.size() != 9 || unescapeField(fields[1]) != build)
+            continue;
+
+        RomResult result;
+        char* end = nullptr;
+        result.hash = std::strtoull(fields[0].c_str(), &end, 16);
+        uint64_t budget = std::strtoull(fields[2].c_str(), nullptr, 10);
+        bool known = false;
+        for (RomStatus status : { RomStatus::Passed, RomStatus::Failed, RomStatus::Timeout }) {
+            if (fields[3] == romStatusName(status)) {
+                result.status = status;
+                known = true;
+            }
+        }
+        if (!known || *end)
+            continue;
+        result.code = std::atoi(fields[4].c_str());
+        result.cycles = std::strtoull(fields[5].c_str(), nullptr, 10);
+        result.seconds = std::strtod(fields[6].c_str(), nullptr);
+        result.path = unescapeField(fields[7]);
+        result.message = unescapeField(fields[8]);
+        entries[{ result.hash, budget }] = result;
+    } while (c != EOF);
+    std::fclose(file);
+}
+
+void ResultCache::save(const std::string& path) const {
+    // written aside and renamed, a run killed halfway keeps the old cache
+    std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file)
+        throw std::runtime_error("cannot write " + temporary);
+
+    std::vector<std::pair<Key, const RomResult*>> sorted;
+    for (const auto& entry : entries)
+        sorted.emplace_back(entry.first, &entry.second);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& l, const auto& r) {
+        return l.first.hash != r.first.hash ? l.first.hash < r.first.hash : l.first.cycles < r.first.cycles;
+    });
+    for (const auto& entry : sorted) {
+        const RomResult& result = *entry.second;
+        std::fprintf(file, "%016" PRIx64 "\t%s\t%" PRIu64 "\t%s\t%d\t%" PRIu64 "\t%.6f\t%s\t%s\n", result.hash,
+            escapeField(build).c_str(), entry.first.cycles, romStatusName(result.status), result.code,
+            result.cycles, result.seconds, escapeField(result.path).c_str(), escapeField(result.message).c_str());
+    }
+
+    bool written = std::fflush(file) == 0 && !std::ferror(file);
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+const RomResult* ResultCache::find(uint64_t hash, uint64_t cycles) const {
+    auto entry = entries.find({ hash, cycles });
+    return entry == entries.end() ? nullptr : &entry->second;
+}
+
+void ResultCache::store(const RomResult& result, uint64_t cycles) {
+    if (result.status == RomStatus::Error)
+        return;
+    RomResult& entry = entries[{ result.hash, cycles }];
+    entry = result;
+    entry.cached = false;
+}
+
+CorpusReport CorpusRunner::run(const std::vector<std::string>& paths, uint64_t cycles, ResultCache* cache) {
+    CorpusReport report;
+    report.build_id = cache ? cache->buildId() : std::string();
+    report.cycles = cycles;
+    report.threads = pool.size();
+    report.results.resize(paths.size());
+
+    std::vector<Job> jobs(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        report.results[i].path = paths[i];
+        jobs[i].result = &report.results[i];
+        jobs[i].budget = cycles;
+        jobs[i].cache = cache;
+    }
+
+    auto begin = Clock::now();
+    for (auto& job : jobs)
+        pool.submit([this, &job] { runSlice(pool, job); });
+    pool.wait();
+    report.wall_seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    if (cache) {
+        for (const RomResult& result : report.results)
+            if (!result.cached)
+                cache->store(result, cycles);
+    }
+    return report;
+}
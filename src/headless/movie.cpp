@@ -0,0 +1,117 @@
+#include "movie.hpp"
+#include "bus.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct File {
+        std::FILE* handle;
+        explicit File(std::FILE* f) : handle(f) {}
+        ~File() { if (handle) std::fclose(handle); }
+
+        // bytes from the current position to the end, -1 if unknown
+        long remaining() const {
+            long here = std::ftell(handle);
+            if (here < 0 || std::fseek(handle, 0, SEEK_END) != 0)
+                return -1;
+            long end = std::ftell(handle);
+            if (std::fseek(handle, here, SEEK_SET) != 0)
+                return -1;
+            return end - here;
+        }
+    };
+}
+
+void Movie::record(byte port0, byte port1) {
+    if (changes.empty() || changes.back().buttons[0] != port0 || changes.back().buttons[1] != port1)
+        changes.push_back({ static_cast<uint32_t>(length), { port0, port1 }, { 0, 0 } });
+    length++;
+}
+
+std::array<byte, 2> Movie::input(uint64_t frame) const {
+    // last change at or before the frame
+    auto after = std::upper_bound(changes.begin(), changes.end(), frame,
+        [](uint64_t f, const MovieEvent& event) { return f < event.frame; });
+    if (after == changes.begin())
+        return { 0, 0 };
+    --after;
+    return { after->buttons[0], after->buttons[1] };
+}
+
+Movie Movie::load(const std::string& path) {
+    File file(std::fopen(path.c_str(), "rb"));
+    if (!file.handle)
+        throw std::runtime_error("cannot open " + path);
+
+    MovieHeader header;
+    if (std::fread(&header, sizeof(header), 1, file.handle) != 1)
+        throw std::runtime_error(path + ": truncated movie header");
+    if (header.magic != MovieHeader::MAGIC || header.version != MovieHeader::VERSION)
+        throw std::runtime_error(path + ": not a movie of this format version");
+
+    Movie movie;
+    movie.rom_hash = header.rom_hash;
+    movie.length = header.frames;
+    movie.state_hash = header.state_hash;
+    movie.has_state_hash = header.flags & MovieHeader::HAS_STATE_HASH;
+    // the count is only a claim, check it against the file before allocating
+    long left = file.remaining();
+    if (left < 0 || header.events > static_cast<uint64_t>(left) / sizeof(MovieEvent))
+        throw std::runtime_error(path + ": truncated movie");
+    if (header.events > header.frames)
+        throw std::runtime_error(path + ": more input records than frames");
+    movie.changes.resize(header.events);
+    if (header.events && std::fread(movie.changes.data(), sizeof(MovieEvent), header.events, file.handle) != header.events)
+        throw std::runtime_error(path + ": truncated movie");
+    for (size_t i = 0; i < movie.changes.size(); i++) {
+        uint32_t frame = movie.changes[i].frame;
+        if (frame >= movie.length || (i && frame <= movie.changes[i - 1].frame))
+            throw std::runtime_error(path + ": input records out of order");
+    }
+    return movie;
+}
+
+void Movie::save(const std::string& path) const {
+    File file(std::fopen(path.c_str(), "wb"));
+    if (!file.handle)
+        throw std::runtime_error("cannot create " + path);
+
+    MovieHeader header = { MovieHeader::MAGIC, MovieHeader::VERSION, rom_hash, length, state_hash,
+        has_state_hash ? MovieHeader::HAS_STATE_HASH : 0, static_cast<uint32_t>(changes.size()) };
+    bool written = std::fwrite(&header, sizeof(header), 1, file.handle) == 1
+        && std::fwrite(changes.data(), sizeof(MovieEvent), changes.size(), file.handle) == changes.size();
+    if (!written || std::fflush(file.handle) != 0)
+        throw std::runtime_error(path + ": write failed");
+}
+
+ReplayReport replayMovie(const Movie& movie, std::shared_ptr<const CartridgeImage> rom, uint64_t render_from) {
+    // the same ROM under another header (mapper, mirroring) runs differently
+    if (rom->hash() != movie.cartridge())
+        throw std::runtime_error(rom->name + ": not the cartridge the movie was recorded on");
+
+    auto bus = std::make_unique<Bus>();
+    bus->insertCartridge(rom);
+    bus->reset();
+    bus->getCpu().enableBlockCache(true);
+    PPU& ppu = bus->getPpu();
+
+    ReplayReport report;
+    auto start = Clock::now();
+    for (uint64_t frame = 0; frame < movie.frames(); frame++) {
+        ppu.setRenderSkip(frame < render_from);
+        std::array<byte, 2> buttons = movie.input(frame);
+        bus->setController(0, buttons[0]);
+        bus->setController(1, buttons[1]);
+        report.cycles += bus->runFrame();
+    }
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.frames = movie.frames();
+    report.state_hash = bus->stateHash();
+    return report;
+}
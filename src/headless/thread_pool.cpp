@@ -0,0 +1,112 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local int current_index = -1;
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threads; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+int ThreadPool::currentWorker() {
+    return current_index;
+}
+
+void ThreadPool::submit(Task task) {
+    size_t target;
+    if (current_pool == this)
+        target = current_index;
+    else
+        target = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    pending.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // taken so that a worker cannot miss the wake up between its last
+        // look at the queues and its wait
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    idle.wait(guard, [this] { return pending.load(std::memory_order_acquire) == 0; });
+}
+
+bool ThreadPool::popOrSteal(size_t index, Task& task) {
+    // own work first, newest end
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // then steal the oldest task of a sibling
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    current_pool = this;
+    current_index = static_cast<int>(index);
+
+    Task task;
+    for (;;) {
+        if (popOrSteal(index, task)) {
+            task();
+            task = nullptr;
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        if (stopping)
+            return;
+        // something may have been queued while we were looking
+        bool queued = false;
+        for (auto& queue : queues) {
+            std::lock_guard<std::mutex> queue_guard(queue->lock);
+            if (!queue->tasks.empty()) { queued = true; break; }
+        }
+        if (!queued)
+            wake.wait(guard);
+    }
+}
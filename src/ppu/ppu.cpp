@@ -0,0 +1,493 @@
+#include "ppu.hpp"
+#include "mapper.hpp"
+#include "memory_map.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // PPUCTRL
+    const byte CTRL_INCREMENT = 0x04;
+    const byte CTRL_SPRITE_TABLE = 0x08;
+    const byte CTRL_BACKGROUND_TABLE = 0x10;
+    const byte CTRL_TALL_SPRITES = 0x20;
+    const byte CTRL_NMI = 0x80;
+
+    // PPUMASK
+    const byte MASK_GREYSCALE = 0x01;
+    const byte MASK_BACKGROUND_LEFT = 0x02;
+    const byte MASK_SPRITES_LEFT = 0x04;
+    const byte MASK_BACKGROUND = 0x08;
+    const byte MASK_SPRITES = 0x10;
+
+    // PPUSTATUS
+    const byte STATUS_OVERFLOW = 0x20;
+    const byte STATUS_SPRITE_ZERO = 0x40;
+    const byte STATUS_VBLANK = 0x80;
+
+    // v/t bits copied at the end of a line (coarse X, horizontal nametable)
+    // and on the pre-render line (fine Y, coarse Y, vertical nametable)
+    const h_word HORIZONTAL_BITS = 0x041F;
+    const h_word VERTICAL_BITS = 0x7BE0;
+
+    // sprite palettes are the upper half
+    const byte SPRITE_OPAQUE = 0x10;
+
+    const size_t TILES_PER_LINE = 33;
+
+    byte reverseBits(byte b) {
+        b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+        b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+        return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    }
+}
+
+PPU::PPU() : kernels(&renderKernels(bestRenderPath())), path(bestRenderPath()) {}
+
+bool PPU::setRenderPath(RenderPath renderer) {
+    if (!renderPathSupported(renderer))
+        return false;
+    path = renderer;
+    kernels = &renderKernels(renderer);
+    return true;
+}
+
+void PPU::setFrameHandler(FrameHandler handler, void* device) {
+    frame_handler = handler;
+    frame_device = device;
+    if (!handler)
+        target = pixels.data();
+}
+
+PPU::~PPU() {
+    if (memory)
+        for (uint16_t slot : slots)
+            memory->untrack(slot);
+}
+
+void PPU::connect(MemoryMap& map) {
+    memory = &map;
+    for (size_t page = 0; page < slots.size(); page++)
+        slots[page] = memory->track(&nametables[page * MemoryMap::PAGE_SIZE]);
+}
+
+void PPU::reset() {
+    ctrl = 0x00;
+    mask = 0x00;
+    buffer = 0x00;
+    w = false;
+    odd = false;
+    nmi = false;
+}
+
+void PPU::runTo(uint64_t target) {
+    while (clock < target) {
+        h_word next = nextDot();
+        uint64_t step = std::min<uint64_t>(next - dot, target - clock);
+        clock += step;
+        dot += static_cast<h_word>(step);
+        if (dot == next)
+            event();
+    }
+}
+
+h_word PPU::nextDot() const {
+    if (line < HEIGHT) {
+        if (dot < 1)
+            return 1;
+        if (sprite_zero > dot)
+            return sprite_zero;
+        if (dot < 257)
+            return 257;
+        if (dot < 260)
+            return 260;
+    } else if (line == VBLANK_LINE) {
+        if (dot < 1)
+            return 1;
+    } else if (line == PRE_RENDER_LINE) {
+        for (h_word at : { 1, 257, 260, 280, 340 })
+            if (dot < at)
+                return at;
+    }
+    return DOTS_PER_LINE;
+}
+
+void PPU::event() {
+    if (dot == DOTS_PER_LINE) {
+        newLine();
+        return;
+    }
+
+    if (line < HEIGHT) {
+        if (dot == 1) {
+            renderLine();
+        } else if (dot == sprite_zero) {
+            status |= STATUS_SPRITE_ZERO;
+        } else if (dot == 257 && rendering()) {
+            incrementY();
+            v = (v & ~HORIZONTAL_BITS) | (t & HORIZONTAL_BITS);
+        } else if (dot == 260 && rendering() && cart) {
+            cart->scanline();
+        }
+    } else if (line == VBLANK_LINE) {
+        status |= STATUS_VBLANK;
+        frames++;
+        if (ctrl & CTRL_NMI)
+            nmi = true;
+        if (frame_handler) {
+            byte* next = frame_handler(frame_device, target);
+            if (next)
+                target = next;
+        }
+    } else if (line == PRE_RENDER_LINE) {
+        switch (dot) {
+        case 1:
+            status &= ~(STATUS_VBLANK | STATUS_SPRITE_ZERO | STATUS_OVERFLOW);
+            break;
+        case 257:
+            if (rendering())
+                v = (v & ~HORIZONTAL_BITS) | (t & HORIZONTAL_BITS);
+            break;
+        case 260:
+            if (rendering() && cart)
+                cart->scanline();
+            break;
+        case 280:
+            if (rendering())
+                v = (v & ~VERTICAL_BITS) | (t & VERTICAL_BITS);
+            break;
+        case 340:
+            // odd frames skip the last dot of the pre-render line
+            if (odd && rendering())
+                newLine();
+            break;
+        }
+    }
+}
+
+void PPU::newLine() {
+    dot = 0;
+    if (++line == LINES) {
+        line = 0;
+        odd = !odd;
+    }
+}
+
+void PPU::incrementY() {
+    if ((v & 0x7000) != 0x7000) {
+        v += 0x1000;
+        return;
+    }
+    v &= ~0x7000;
+    h_word y = (v & 0x03E0) >> 5;
+    if (y == 29) {
+        y = 0;
+        v ^= 0x0800;
+    } else if (y == 31) {
+        // attribute rows, wraps without switching nametable
+        y = 0;
+    } else {
+        y++;
+    }
+    v = (v & ~0x03E0) | (y << 5);
+}
+
+bool PPU::skipLine() {
+    if (!rendering())
+        return true;
+    if (!(mask & MASK_SPRITES))
+        return true;
+    int height = (ctrl & CTRL_TALL_SPRITES) ? 16 : 8;
+    int found = 0;
+    for (int i = 0; i < 64; i++) {
+        int row = static_cast<int>(line) - 1 - oam[i * 4];
+        if (row < 0 || row >= height)
+            continue;
+        // a hit is only possible on the lines of sprite 0, those are
+        // rendered (into a line nobody sees) to find its dot
+        if (i == 0 && (mask & MASK_BACKGROUND) && !(status & STATUS_SPRITE_ZERO))
+            return false;
+        if (found++ == 8) {
+            status |= STATUS_OVERFLOW;
+            break;
+        }
+    }
+    return true;
+}
+
+void PPU::renderLine() {
+    byte* out = target + line * WIDTH;
+    sprite_zero = 0;
+    alignas(32) std::array<byte, WIDTH> discarded;
+    if (skip_pixels) {
+        if (skipLine())
+            return;
+        out = discarded.data();
+    }
+    if (!rendering()) {
+        std::memset(out, palette[0], WIDTH);
+        return;
+    }
+
+    // background: 33 tiles cover the line whatever the fine scroll, the
+    // line starts fine_x pixels into the first one
+    alignas(32) std::array<byte, TILES_PER_LINE * 8> tiles;
+    byte* background = tiles.data() + fine_x;
+    if (mask & MASK_BACKGROUND) {
+        byte lo[TILES_PER_LINE], hi[TILES_PER_LINE], bits[TILES_PER_LINE];
+        h_word address = v;
+        h_word table = (ctrl & CTRL_BACKGROUND_TABLE) ? 0x1000 : 0x0000;
+        h_word fine_y = (v >> 12) & 0x07;
+        for (size_t tile = 0; tile < TILES_PER_LINE; tile++) {
+            byte id = read(0x2000 | (address & 0x0FFF));
+            byte attribute = read(0x23C0 | (address & 0x0C00) | ((address >> 4) & 0x38) | ((address >> 2) & 0x07));
+            byte quadrant = ((address >> 4) & 0x04) | (address & 0x02);
+            bits[tile] = ((attribute >> quadrant) & 0x03) << 2;
+            lo[tile] = read(table + id * 16 + fine_y);
+            hi[tile] = read(table + id * 16 + fine_y + 8);
+            // coarse X, wrapping into the next nametable
+            if ((address & 0x001F) == 31) {
+                address &= ~0x001F;
+                address ^= 0x0400;
+            } else {
+                address++;
+            }
+        }
+        kernels->decodeTiles(lo, hi, bits, TILES_PER_LINE, tiles.data());
+        if (!(mask & MASK_BACKGROUND_LEFT))
+            std::memset(background, 0, 8);
+    } else {
+        tiles.fill(0);
+    }
+
+    // sprites: the first opaque pixel in OAM order wins, behind or not; the
+    // line is padded for the rows running off its right end
+    alignas(32) std::array<byte, WIDTH + 8> sprites{};
+    if (mask & MASK_SPRITES) {
+        int height = (ctrl & CTRL_TALL_SPRITES) ? 16 : 8;
+        int found = 0;
+        for (int i = 0; i < 64; i++) {
+            const byte* sprite = &oam[i * 4];
+            // OAM holds the line before the sprite's first
+            int row = static_cast<int>(line) - 1 - sprite[0];
+            if (row < 0 || row >= height)
+                continue;
+            if (found++ == 8) {
+                status |= STATUS_OVERFLOW;
+                break;
+            }
+
+            byte attribute = sprite[2];
+            if (attribute & 0x80)
+                row = height - 1 - row;
+            h_word address;
+            if (height == 16)
+                address = ((sprite[1] & 0x01) ? 0x1000 : 0x0000) + (sprite[1] & 0xFE) * 16 + (row & 0x08) * 2 + (row & 0x07);
+            else
+                address = ((ctrl & CTRL_SPRITE_TABLE) ? 0x1000 : 0x0000) + sprite[1] * 16 + row;
+            byte lo = read(address);
+            byte hi = read(address + 8);
+            if (attribute & 0x40) {
+                lo = reverseBits(lo);
+                hi = reverseBits(hi);
+            }
+
+            byte bits = SPRITE_OPAQUE | ((attribute & 0x03) << 2)
+                | ((attribute & 0x20) ? RENDER_BEHIND : 0) | (i == 0 ? RENDER_SPRITE_ZERO : 0);
+            kernels->mergeSprite(lo, hi, bits, &sprites[sprite[3]]);
+        }
+        if (!(mask & MASK_SPRITES_LEFT))
+            std::memset(sprites.data(), 0, 8);
+    }
+
+    byte grey = (mask & MASK_GREYSCALE) ? 0x30 : 0x3F;
+    unsigned hit = kernels->composite(background, sprites.data(), palette.data(), grey, out);
+    if (hit && !(status & STATUS_SPRITE_ZERO))
+        sprite_zero = static_cast<h_word>(hit + 1);
+}
+
+byte PPU::readRegister(h_word address, bool bReadOnly) {
+    switch (address & 0x0007) {
+    case 2: {
+        byte data = (status & 0xE0) | (buffer & 0x1F);
+        if (!bReadOnly) {
+            status &= ~STATUS_VBLANK;
+            w = false;
+        }
+        return data;
+    }
+    case 4:
+        return oam[oam_addr];
+    case 7: {
+        h_word at = v & 0x3FFF;
+        // palette reads are not buffered, the nametable below them is
+        byte data = at >= 0x3F00 ? read(at) : buffer;
+        if (!bReadOnly) {
+            buffer = read(at >= 0x3F00 ? at - 0x1000 : at);
+            v = (v + ((ctrl & CTRL_INCREMENT) ? 32 : 1)) & 0x7FFF;
+        }
+        return data;
+    }
+    default:
+        // write only
+        return buffer;
+    }
+}
+
+void PPU::writeRegister(h_word address, byte data) {
+    switch (address & 0x0007) {
+    case 0: {
+        // enabling NMI during vblank raises it at once
+        if (!(ctrl & CTRL_NMI) && (data & CTRL_NMI) && (status & STATUS_VBLANK))
+            nmi = true;
+        ctrl = data;
+        t = (t & 0xF3FF) | ((data & 0x03) << 10);
+        break;
+    }
+    case 1:
+        mask = data;
+        break;
+    case 3:
+        oam_addr = data;
+        break;
+    case 4:
+        oam[oam_addr++] = data;
+        break;
+    case 5:
+        if (!w) {
+            t = (t & 0xFFE0) | (data >> 3);
+            fine_x = data & 0x07;
+        } else {
+            t = (t & 0x8C1F) | ((data & 0xF8) << 2) | ((data & 0x07) << 12);
+        }
+        w = !w;
+        break;
+    case 6:
+        if (!w) {
+            t = (t & 0x00FF) | ((data & 0x3F) << 8);
+        } else {
+            t = (t & 0xFF00) | data;
+            v = t;
+        }
+        w = !w;
+        break;
+    case 7:
+        write(v & 0x3FFF, data);
+        v = (v + ((ctrl & CTRL_INCREMENT) ? 32 : 1)) & 0x7FFF;
+        break;
+    }
+}
+
+void PPU::writeOam(const byte* data) {
+    for (size_t i = 0; i < oam.size(); i++)
+        oam[(oam_addr + i) & 0xFF] = data[i];
+}
+
+size_t PPU::nametableOffset(h_word address) const {
+    size_t table = (address >> 10) & 0x03;
+    switch (cart ? cart->mirroring() : Mirroring::Horizontal) {
+    case Mirroring::Horizontal: table >>= 1; break;
+    case Mirroring::Vertical: table &= 0x01; break;
+    case Mirroring::SingleLow: table = 0; break;
+    case Mirroring::SingleHigh: table = 1; break;
+    case Mirroring::FourScreen: break;
+    }
+    return table * 0x400 + (address & 0x03FF);
+}
+
+byte PPU::paletteIndex(h_word address) {
+    // sprite backdrop entries mirror the background ones
+    byte index = address & 0x1F;
+    return (index & 0x13) == 0x10 ? index & 0x0F : index;
+}
+
+byte PPU::read(h_word address) const {
+    address &= 0x3FFF;
+    if (address < 0x2000)
+        return cart ? cart->readChr(address) : 0x00;
+    if (address < 0x3F00)
+        return nametables[nametableOffset(address)];
+    return palette[paletteIndex(address)];
+}
+
+void PPU::write(h_word address, byte data) {
+    address &= 0x3FFF;
+    if (address < 0x2000) {
+        if (cart)
+            cart->writeChr(address, data);
+    } else if (address < 0x3F00) {
+        size_t offset = nametableOffset(address);
+        nametables[offset] = data;
+        if (memory)
+            memory->markDirty(slots[offset / MemoryMap::PAGE_SIZE]);
+    } else {
+        palette[paletteIndex(address)] = data & 0x3F;
+    }
+}
+
+uint64_t PPU::nextVblank() const {
+    if (!(ctrl & CTRL_NMI))
+        return NO_EVENT;
+    return nextFrame();
+}
+
+uint64_t PPU::nextFrame() const {
+    uint64_t lines = (VBLANK_LINE + LINES - line) % LINES;
+    if (lines == 0 && dot >= 1)
+        lines = LINES;
+    uint64_t due = clock - dot + lines * DOTS_PER_LINE + 1;
+    // past the pre-render line, which may be a dot short
+    if (line > VBLANK_LINE || lines == LINES)
+        due--;
+    return due;
+}
+
+uint64_t PPU::nextScanline() const {
+    uint64_t line_start = clock - dot;
+    if ((line < HEIGHT || line == PRE_RENDER_LINE) && dot < 260)
+        return line_start + 260;
+    return line_start + DOTS_PER_LINE - 1;
+}
+
+void PPU::saveState(PpuState& state) const {
+    state.clock = clock;
+    state.frames = frames;
+    state.line = line;
+    state.dot = dot;
+    state.v = v;
+    state.t = t;
+    state.sprite_zero = sprite_zero;
+    state.fine_x = fine_x;
+    state.w = w ? 1 : 0;
+    state.ctrl = ctrl;
+    state.mask = mask;
+    state.status = status;
+    state.oam_addr = oam_addr;
+    state.buffer = buffer;
+    state.odd = odd ? 1 : 0;
+    state.nmi = nmi ? 1 : 0;
+    std::memset(state.reserved, 0, sizeof(state.reserved));
+    std::memcpy(state.palette, palette.data(), palette.size());
+    std::memcpy(state.oam, oam.data(), oam.size());
+}
+
+void PPU::loadState(const PpuState& state) {
+    clock = state.clock;
+    frames = state.frames;
+    line = state.line;
+    dot = state.dot;
+    v = state.v;
+    t = state.t;
+    sprite_zero = state.sprite_zero;
+    fine_x = state.fine_x;
+    w = state.w != 0;
+    ctrl = state.ctrl;
+    mask = state.mask;
+    status = state.status;
+    oam_addr = state.oam_addr;
+    buffer = state.buffer;
+    odd = state.odd != 0;
+    nmi = state.nmi != 0;
+    std::memcpy(palette.data(), state.palette, palette.size());
+    std::memcpy(oam.data(), state.oam, oam.size());
+}
@@ -0,0 +1,226 @@
+#include "render.hpp"
+#include "ppu.hpp"
+
+#if NES_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+    const unsigned WIDTH = PPU::WIDTH;
+    const uint64_t BROADCAST = 0x0101010101010101ull;
+
+    // Scalar
+    void decodeTilesScalar(const byte* lo, const byte* hi, const byte* bits, size_t count, byte* out) {
+        for (size_t tile = 0; tile < count; tile++) {
+            for (int bit = 7; bit >= 0; bit--) {
+                byte pixel = ((lo[tile] >> bit) & 0x01) | (((hi[tile] >> bit) & 0x01) << 1);
+                *out++ = pixel ? (bits[tile] | pixel) : 0;
+            }
+        }
+    }
+
+    void mergeSpriteScalar(byte lo, byte hi, byte bits, byte* out) {
+        for (int bit = 7; bit >= 0; bit--, out++) {
+            byte pixel = ((lo >> bit) & 0x01) | (((hi >> bit) & 0x01) << 1);
+            if (pixel && !*out)
+                *out = bits | pixel;
+        }
+    }
+
+    unsigned compositeScalar(const byte* background, const byte* sprites, const byte* palette, byte grey, byte* out) {
+        unsigned hit = 0;
+        for (unsigned x = 0; x < WIDTH; x++) {
+            byte back = background[x];
+            byte front = sprites[x];
+            if (!hit && (front & RENDER_SPRITE_ZERO) && back && x != WIDTH - 1)
+                hit = x + 1;
+            byte index = (front && (!(front & RENDER_BEHIND) || !back)) ? front & 0x1F : back;
+            out[x] = palette[index] & grey;
+        }
+        return hit;
+    }
+
+    const RenderKernels SCALAR = { decodeTilesScalar, mergeSpriteScalar, compositeScalar };
+
+#if NES_X86_SIMD
+    // SSE2, baseline on x86-64: 16 pixels (two tiles) per register
+
+    // lane i tests bit 7 - (i % 8), the leftmost pixel first
+    inline __m128i pixelBits128() {
+        return _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+    }
+
+    // 2 bit pixels of two tiles, or-ed with their bits where opaque
+    inline __m128i decode128(uint64_t lo, uint64_t hi, uint64_t bits) {
+        const __m128i mask = pixelBits128();
+        __m128i planes0 = _mm_set_epi64x((lo >> 8) * BROADCAST, (lo & 0xFF) * BROADCAST);
+        __m128i planes1 = _mm_set_epi64x((hi >> 8) * BROADCAST, (hi & 0xFF) * BROADCAST);
+        __m128i p0 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(planes0, mask), mask), _mm_set1_epi8(1));
+        __m128i p1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(planes1, mask), mask), _mm_set1_epi8(2));
+        __m128i pixel = _mm_or_si128(p0, p1);
+        __m128i opaque = _mm_andnot_si128(_mm_cmpeq_epi8(pixel, _mm_setzero_si128()), _mm_set1_epi8(-1));
+        __m128i palette = _mm_set_epi64x((bits >> 8) * BROADCAST, (bits & 0xFF) * BROADCAST);
+        return _mm_or_si128(pixel, _mm_and_si128(palette, opaque));
+    }
+
+    void decodeTilesSse2(const byte* lo, const byte* hi, const byte* bits, size_t count, byte* out) {
+        size_t tile = 0;
+        for (; tile + 2 <= count; tile += 2, out += 16) {
+            __m128i pixels = decode128(lo[tile] | (lo[tile + 1] << 8), hi[tile] | (hi[tile + 1] << 8),
+                bits[tile] | (bits[tile + 1] << 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), pixels);
+        }
+        decodeTilesScalar(lo + tile, hi + tile, bits + tile, count - tile, out);
+    }
+
+    void mergeSpriteSse2(byte lo, byte hi, byte bits, byte* out) {
+        __m128i row = decode128(lo, hi, bits);
+        __m128i line = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(out));
+        __m128i zero = _mm_setzero_si128();
+        // opaque pixels of the row where the line has none yet
+        __m128i take = _mm_andnot_si128(_mm_cmpeq_epi8(row, zero), _mm_cmpeq_epi8(line, zero));
+        __m128i merged = _mm_or_si128(_mm_and_si128(take, row), _mm_andnot_si128(take, line));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), merged);
+    }
+
+    // palette indices of 16 pixels, and the sprite 0 hit lanes
+    inline __m128i priority128(__m128i back, __m128i front, int& hits) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i back_clear = _mm_cmpeq_epi8(back, zero);
+        __m128i front_opaque = _mm_andnot_si128(_mm_cmpeq_epi8(front, zero), _mm_set1_epi8(-1));
+        __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(front, _mm_set1_epi8(RENDER_BEHIND)), _mm_set1_epi8(RENDER_BEHIND));
+        // in front unless behind an opaque background
+        __m128i shown = _mm_andnot_si128(_mm_andnot_si128(back_clear, behind), front_opaque);
+        __m128i index = _mm_or_si128(_mm_and_si128(shown, _mm_and_si128(front, _mm_set1_epi8(0x1F))),
+            _mm_andnot_si128(shown, back));
+        // bit 7 is the sprite 0 flag, movemask reads it straight
+        hits = _mm_movemask_epi8(_mm_andnot_si128(back_clear, front));
+        return index;
+    }
+
+    unsigned compositeSse2(const byte* background, const byte* sprites, const byte* palette, byte grey, byte* out) {
+        unsigned hit = 0;
+        alignas(16) byte index[16];
+        for (unsigned x = 0; x < WIDTH; x += 16) {
+            __m128i back = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+            __m128i front = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x));
+            int hits;
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), priority128(back, front, hits));
+            if (x + 16 == WIDTH)
+                hits &= 0x7FFF;     // never on the last pixel
+            if (!hit && hits)
+                hit = x + __builtin_ctz(hits) + 1;
+            // SSE2 has no byte shuffle, the 32 entry lookup stays scalar
+            for (unsigned i = 0; i < 16; i++)
+                out[x + i] = palette[index[i]] & grey;
+        }
+        return hit;
+    }
+
+    const RenderKernels SSE2 = { decodeTilesSse2, mergeSpriteSse2, compositeSse2 };
+
+    // AVX2: 32 pixels (four tiles) per register, and the palette lookup is
+    // a pair of in-lane byte shuffles
+
+    __attribute__((target("avx2")))
+    void decodeTilesAvx2(const byte* lo, const byte* hi, const byte* bits, size_t count, byte* out) {
+        const __m256i mask = _mm256_broadcastsi128_si256(pixelBits128());
+        const __m256i zero = _mm256_setzero_si256();
+        size_t tile = 0;
+        for (; tile + 4 <= count; tile += 4, out += 32) {
+            __m256i planes0 = _mm256_set_epi64x(lo[tile + 3] * BROADCAST, lo[tile + 2] * BROADCAST,
+                lo[tile + 1] * BROADCAST, lo[tile] * BROADCAST);
+            __m256i planes1 = _mm256_set_epi64x(hi[tile + 3] * BROADCAST, hi[tile + 2] * BROADCAST,
+                hi[tile + 1] * BROADCAST, hi[tile] * BROADCAST);
+            __m256i palette = _mm256_set_epi64x(bits[tile + 3] * BROADCAST, bits[tile + 2] * BROADCAST,
+                bits[tile + 1] * BROADCAST, bits[tile] * BROADCAST);
+            __m256i p0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(planes0, mask), mask), _mm256_set1_epi8(1));
+            __m256i p1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(planes1, mask), mask), _mm256_set1_epi8(2));
+            __m256i pixel = _mm256_or_si256(p0, p1);
+            __m256i transparent = _mm256_cmpeq_epi8(pixel, zero);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_or_si256(pixel, _mm256_andnot_si256(transparent, palette)));
+        }
+        decodeTilesSse2(lo + tile, hi + tile, bits + tile, count - tile, out);
+    }
+
+    __attribute__((target("avx2")))
+    unsigned compositeAvx2(const byte* background, const byte* sprites, const byte* palette, byte grey, byte* out) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi8(-1);
+        const __m128i low_half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(palette));
+        const __m128i high_half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(palette + 16));
+        const __m256i entries0 = _mm256_broadcastsi128_si256(low_half);
+        const __m256i entries1 = _mm256_broadcastsi128_si256(high_half);
+        const __m256i mask = _mm256_set1_epi8(static_cast<char>(grey));
+        unsigned hit = 0;
+        for (unsigned x = 0; x < WIDTH; x += 32) {
+            __m256i back = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x));
+            __m256i front = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + x));
+            __m256i back_clear = _mm256_cmpeq_epi8(back, zero);
+            __m256i front_opaque = _mm256_andnot_si256(_mm256_cmpeq_epi8(front, zero), ones);
+            __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(front, _mm256_set1_epi8(RENDER_BEHIND)),
+                _mm256_set1_epi8(RENDER_BEHIND));
+            __m256i shown = _mm256_andnot_si256(_mm256_andnot_si256(back_clear, behind), front_opaque);
+            __m256i index = _mm256_blendv_epi8(back, _mm256_and_si256(front, _mm256_set1_epi8(0x1F)), shown);
+
+            unsigned hits = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_andnot_si256(back_clear, front)));
+            if (x + 32 == WIDTH)
+                hits &= 0x7FFFFFFF;
+            if (!hit && hits)
+                hit = x + __builtin_ctz(hits) + 1;
+
+            // indices 0-31: the low 4 bits pick the entry, bit 4 the half
+            __m256i entry = _mm256_and_si256(index, _mm256_set1_epi8(0x0F));
+            __m256i upper = _mm256_cmpeq_epi8(_mm256_and_si256(index, _mm256_set1_epi8(0x10)), _mm256_set1_epi8(0x10));
+            __m256i color = _mm256_blendv_epi8(_mm256_shuffle_epi8(entries0, entry), _mm256_shuffle_epi8(entries1, entry), upper);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_and_si256(color, mask));
+        }
+        return hit;
+    }
+
+    // a sprite row is only 8 pixels, the SSE2 merge is as good as it gets
+    const RenderKernels AVX2 = { decodeTilesAvx2, mergeSpriteSse2, compositeAvx2 };
+#endif
+}
+
+bool renderPathSupported(RenderPath path) {
+    switch (path) {
+    case RenderPath::Scalar:
+        return true;
+#if NES_X86_SIMD
+    case RenderPath::Sse2:
+        return __builtin_cpu_supports("sse2");
+    case RenderPath::Avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+RenderPath bestRenderPath() {
+    for (RenderPath path : { RenderPath::Avx2, RenderPath::Sse2 })
+        if (renderPathSupported(path))
+            return path;
+    return RenderPath::Scalar;
+}
+
+const RenderKernels& renderKernels(RenderPath path) {
+    if (!renderPathSupported(path))
+        return SCALAR;
+    switch (path) {
+#if NES_X86_SIMD
+    case RenderPath::Sse2: return SSE2;
+    case RenderPath::Avx2: return AVX2;
+#endif
+    default: return SCALAR;
+    }
+}
+
+const char* renderPathName(RenderPath path) {
+    switch (path) {
+    case RenderPath::Sse2: return "sse2";
+    case RenderPath::Avx2: return "avx2";
+    default: return "scalar";
+    }
+}
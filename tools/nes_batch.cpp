@@ -0,0 +1,144 @@
+// Headless batch runner: emulates many independent systems on every core and
+// reports emulated cycles per second, per instance and in aggregate.
+//
+//   nes_batch [-j threads] [-n instances] [-c cycles] [-s] [-p profile] [rom ...]
+//
+// Without ROM files a built-in synthetic program is used. -s sweeps the thread
+// count from 1 to -j and prints the speedup of each step. -p writes the CPU
+// profile of the first instance (of the first run with -s), as JSON if the
+// file name ends in .json and as CSV otherwise; it needs a build configured
+// with -DNES_PROFILE=ON.
+
+#include "batch_runner.hpp"
+#include "mapper.hpp"
+#include "bench_rom.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    // SEI / CLD / LDX #0 / LDY #16 / loop: LDA 0,X ADC #3 STA 0,X INX DEY BNE loop
+    // JSR sub / JMP $8004 / sub: PHA PLA RTS
+    std::shared_ptr<const CartridgeImage> syntheticRom() {
+        const std::vector<byte> program = {
+            0x78, 0xD8, 0xA2, 0x00, 0xA0, 0x10, 0xB5, 0x00, 0x69, 0x03, 0x95, 0x00, 0xE8, 0x88,
+            0xD0, 0xF6, 0x20, 0x16, 0x80, 0x4C, 0x04, 0x80, 0x48, 0x68, 0x60,
+        };
+        SyntheticRom rom;
+        rom.load(0x8000, program);
+        rom.setVectors(0x8000, 0x8000, 0x8000);
+        return CartridgeImage::fromMemory(rom.file(), "<synthetic>");
+    }
+
+    void usage() {
+        std::fprintf(stderr, "usage: nes_batch [-j threads] [-n instances] [-c cycles] [-s] [-p profile] [rom ...]\n");
+    }
+
+    int writeProfile(const CpuProfile& profile, const std::string& path) {
+        try {
+            bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+            if (json)
+                profile.writeJson(path);
+            else
+                profile.writeCsv(path);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "nes_batch: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    void printReport(const BatchReport& report) {
+        for (size_t i = 0; i < report.instances.size(); i++) {
+            const InstanceReport& instance = report.instances[i];
+            std::printf("instance %4zu  %-24s  %12llu cycles  %8.3f s  %8.2f Mcycles/s\n",
+                i, instance.rom.c_str(), (unsigned long long)instance.cycles,
+                instance.seconds, instance.cyclesPerSecond() / 1e6);
+        }
+        std::printf("aggregate  %zu instances  %zu threads  %llu cycles  %.3f s  %.2f Mcycles/s\n",
+            report.instances.size(), report.threads, (unsigned long long)report.totalCycles(),
+            report.wall_seconds, report.cyclesPerSecond() / 1e6);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    size_t per_rom = 0;
+    uint64_t cycles = 1789773 * 10; // ten seconds of NTSC time
+    bool sweep = false;
+    std::string profile_path;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            per_rom = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-c") && i + 1 < argc)
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-s"))
+            sweep = true;
+        else if (!std::strcmp(argv[i], "-p") && i + 1 < argc)
+            profile_path = argv[++i];
+        else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else
+            paths.push_back(argv[i]);
+    }
+    if (threads == 0)
+        threads = 1;
+    if (per_rom == 0)
+        per_rom = paths.empty() ? threads * 4 : 1;
+
+    std::vector<std::shared_ptr<const CartridgeImage>> roms;
+    try {
+        for (const auto& path : paths) {
+            roms.push_back(CartridgeImage::load(path));
+            if (!Mapper::supports(roms.back()->mapper))
+                throw std::runtime_error(path + ": mapper " + std::to_string(roms.back()->mapper) + " is not supported");
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_batch: %s\n", e.what());
+        return 1;
+    }
+    if (roms.empty())
+        roms.push_back(syntheticRom());
+
+    std::vector<BatchInstance> instances;
+    for (const auto& rom : roms)
+        for (size_t n = 0; n < per_rom; n++)
+            instances.push_back({ rom, cycles });
+
+    CpuProfile profile;
+    if (!profile_path.empty()) {
+        if (!NES_ENABLE_PROFILE)
+            std::fprintf(stderr, "nes_batch: built without NES_PROFILE, the profile will be empty\n");
+        instances[0].profile = &profile;
+    }
+
+    if (!sweep) {
+        BatchRunner runner(threads);
+        printReport(runner.run(instances));
+        return profile_path.empty() ? 0 : writeProfile(profile, profile_path);
+    }
+
+    double base = 0.0;
+    for (unsigned t = 1; t <= threads; t++) {
+        BatchRunner runner(t);
+        BatchReport report = runner.run(instances);
+        // the profile is of the single threaded run, the others would add to it
+        instances[0].profile = nullptr;
+        if (t == 1)
+            base = report.cyclesPerSecond();
+        std::printf("threads %3u  %10.2f Mcycles/s  speedup %5.2fx\n",
+            t, report.cyclesPerSecond() / 1e6, base > 0.0 ? report.cyclesPerSecond() / base : 0.0);
+    }
+    return profile_path.empty() ? 0 : writeProfile(profile, profile_path);
+}
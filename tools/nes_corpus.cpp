@@ -0,0 +1,179 @@
+// Test ROM corpus runner: runs every ROM of a corpus headless on all cores and
+// reports which pass, from the result the ROMs leave in cartridge RAM.
+//
+//   nes_corpus [-j threads] [-c cycles] [-C cache] [-n] [-b build] [--junit file] [--json file] [-q] rom|dir ...
+//
+// Directories are searched for .nes files, on `threads` workers (1 to 1024,
+// one per hardware thread by default). Each ROM gets `cycles` CPU cycles
+// (60 seconds of NTSC time by default) to report through $6000 like blargg's
+// tests. Results are cached in `cache` (nes_corpus.cache by default, -n for
+// none) under the ROM hash and the build id, which is the hash of this
+// executable unless -b gives one, so a run only runs what changed. The exit
+// status is 0 when every ROM passed, 1 otherwise.
+
+#include "corpus_runner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    namespace fs = std::filesystem;
+
+    // far more than any machine has cores, each worker is a thread
+    const unsigned MAX_THREADS = 1024;
+
+    void usage() {
+        std::fprintf(stderr, "usage: nes_corpus [-j threads] [-c cycles] [-C cache] [-n] [-b build] "
+            "[--junit file] [--json file] [-q] rom|dir ...\n");
+    }
+
+    // a whole number from 1 to MAX_THREADS, 0 if it is not one
+    unsigned parseThreads(const char* text) {
+        if (!std::isdigit(static_cast<unsigned char>(text[0])))
+            return 0;
+        char* end = nullptr;
+        unsigned long value = std::strtoul(text, &end, 10);
+        return *end == '\0' && value <= MAX_THREADS ? static_cast<unsigned>(value) : 0;
+    }
+
+    bool isRom(const fs::path& path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".nes";
+    }
+
+    // files as given, directories searched, each part sorted so reports are stable
+    std::vector<std::string> collect(const std::vector<std::string>& arguments) {
+        std::vector<std::string> paths;
+        for (const auto& argument : arguments) {
+            if (!fs::is_directory(argument)) {
+                paths.push_back(argument);
+                continue;
+            }
+            std::vector<std::string> found;
+            for (const auto& entry : fs::recursive_directory_iterator(argument))
+                if (entry.is_regular_file() && isRom(entry.path()))
+                    found.push_back(entry.path().generic_string());
+            std::sort(found.begin(), found.end());
+            paths.insert(paths.end(), found.begin(), found.end());
+        }
+        return paths;
+    }
+
+    // any rebuild of the emulator changes its executable
+    std::string selfBuildId() {
+        std::FILE* file = std::fopen("/proc/self/exe", "rb");
+        if (!file)
+            return __DATE__ " " __TIME__;
+        uint64_t hash = FNV_OFFSET;
+        byte buffer[65536];
+        size_t got;
+        while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            hash = fnv1a(buffer, got, hash);
+        std::fclose(file);
+        char id[24];
+        std::snprintf(id, sizeof(id), "%016" PRIx64, hash);
+        return id;
+    }
+
+    // first line of the ROM's text, for the console
+    std::string summary(const RomResult& result) {
+        std::string line = result.message.substr(0, result.message.find('\n'));
+        return line.size() > 60 ? line.substr(0, 57) + "..." : line;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    uint64_t cycles = 1789773ull * 60;
+    std::string cache_path = "nes_corpus.cache";
+    std::string build_id;
+    std::string junit_path, json_path;
+    bool quiet = false;
+    std::vector<std::string> arguments;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = parseThreads(argv[++i]);
+            if (threads == 0) {
+                usage();
+                return 2;
+            }
+        } else if (!std::strcmp(argv[i], "-c") && i + 1 < argc)
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-C") && i + 1 < argc)
+            cache_path = argv[++i];
+        else if (!std::strcmp(argv[i], "-n"))
+            cache_path.clear();
+        else if (!std::strcmp(argv[i], "-b") && i + 1 < argc)
+            build_id = argv[++i];
+        else if (!std::strcmp(argv[i], "--junit") && i + 1 < argc)
+            junit_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--json") && i + 1 < argc)
+            json_path = argv[++i];
+        else if (!std::strcmp(argv[i], "-q"))
+            quiet = true;
+        else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else
+            arguments.push_back(argv[i]);
+    }
+    threads = std::min(std::max(threads, 1u), MAX_THREADS);
+    if (arguments.empty() || cycles == 0) {
+        usage();
+        return 2;
+    }
+
+    std::vector<std::string> paths;
+    try {
+        paths = collect(arguments);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_corpus: %s\n", e.what());
+        return 2;
+    }
+    if (paths.empty()) {
+        std::fprintf(stderr, "nes_corpus: no ROM found\n");
+        return 1;
+    }
+
+    ResultCache cache(build_id.empty() ? selfBuildId() : build_id);
+    if (!cache_path.empty())
+        cache.load(cache_path);
+
+    CorpusRunner runner(threads);
+    CorpusReport report = runner.run(paths, cycles, cache_path.empty() ? nullptr : &cache);
+
+    if (!quiet) {
+        for (const RomResult& result : report.results)
+            std::printf("%-8s %8.3f s%s  %s  %s\n", romStatusName(result.status), result.seconds,
+                result.cached ? " (cached)" : "         ", result.path.c_str(), summary(result).c_str());
+    }
+    std::printf("%zu ROMs: %zu passed, %zu failed, %zu timed out, %zu errors, %zu cached; %.3f s on %zu threads\n",
+        report.results.size(), report.count(RomStatus::Passed), report.count(RomStatus::Failed),
+        report.count(RomStatus::Timeout), report.count(RomStatus::Error), report.cachedCount(),
+        report.wall_seconds, report.threads);
+
+    try {
+        if (!cache_path.empty())
+            cache.save(cache_path);
+        if (!junit_path.empty())
+            report.writeJUnit(junit_path);
+        if (!json_path.empty())
+            report.writeJson(json_path);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_corpus: %s\n", e.what());
+        return 1;
+    }
+    return report.passed() ? 0 : 1;
+}
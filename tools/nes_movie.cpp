@@ -0,0 +1,142 @@
+// Input movies: records the controller input of a session and replays it at
+// uncapped speed, checking the final state against the recorded one.
+//
+//   nes_movie record [-f frames] [-s seed] rom movie
+//   nes_movie replay [-r frame] [-e hash] rom movie
+//
+// There is no frontend to play with, so record mashes buttons: a random
+// combination on the first controller every 1 to 30 frames, from `seed`. The
+// movie keeps the hash of the state after its last frame.
+//
+// replay runs the movie without output or pacing and without drawing pixels
+// before frame -r (never by default), prints its speed and the final state
+// hash, and exits with 1 if the hash is not the expected one: -e, or the one
+// recorded in the movie.
+
+#include "bus.hpp"
+#include "console.hpp"
+#include "mapper.hpp"
+#include "movie.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    void usage() {
+        std::fprintf(stderr, "usage: nes_movie record [-f frames] [-s seed] rom movie\n"
+            "       nes_movie replay [-r frame] [-e hash] rom movie\n");
+    }
+
+    std::shared_ptr<const CartridgeImage> loadRom(const std::string& path) {
+        auto rom = CartridgeImage::load(path);
+        if (!Mapper::supports(rom->mapper))
+            throw std::runtime_error(path + ": mapper " + std::to_string(rom->mapper) + " is not supported");
+        return rom;
+    }
+
+    int record(const std::string& rom_path, const std::string& movie_path, uint64_t frames, uint32_t seed) {
+        auto rom = loadRom(rom_path);
+        Movie movie(*rom);
+
+        auto console = std::make_unique<Console>();
+        Bus& bus = console->getBus();
+        bus.insertCartridge(rom);
+        bus.reset();
+        bus.getPpu().setRenderSkip(true);
+        console->record(&movie);
+
+        uint64_t hold = 0;
+        for (uint64_t f = 0; f < frames; f++) {
+            if (hold == 0) {
+                seed = seed * 1103515245 + 12345;
+                bus.setController(0, static_cast<byte>(seed >> 16));
+                hold = 1 + (seed >> 8) % 30;
+            }
+            hold--;
+            console->runFrames(1);
+        }
+        movie.setStateHash(bus.stateHash());
+        movie.save(movie_path);
+
+        std::printf("%llu frames, %zu input changes, state %016llx\n", (unsigned long long)movie.frames(),
+            movie.events(), (unsigned long long)movie.stateHash());
+        return 0;
+    }
+
+    int replay(const std::string& rom_path, const std::string& movie_path, uint64_t render_from,
+        bool expect_given, uint64_t expected) {
+        auto rom = loadRom(rom_path);
+        Movie movie = Movie::load(movie_path);
+        if (!expect_given && movie.hasStateHash()) {
+            expect_given = true;
+            expected = movie.stateHash();
+        }
+
+        ReplayReport report = replayMovie(movie, rom, render_from);
+        std::printf("%llu frames  %llu cycles  %.3f s  %.1f frames/s  %.1fx real time\n",
+            (unsigned long long)report.frames, (unsigned long long)report.cycles, report.seconds,
+            report.seconds > 0.0 ? report.frames / report.seconds : 0.0, report.speed());
+        std::printf("state %016llx", (unsigned long long)report.state_hash);
+        if (!expect_given) {
+            std::printf("  (nothing to compare with)\n");
+            return 0;
+        }
+        bool same = report.state_hash == expected;
+        std::printf("  expected %016llx  %s\n", (unsigned long long)expected, same ? "OK" : "MISMATCH");
+        return same ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    bool recording = !std::strcmp(argv[1], "record");
+    if (!recording && std::strcmp(argv[1], "replay")) {
+        usage();
+        return 2;
+    }
+
+    uint64_t frames = 60 * 60;
+    uint32_t seed = 1;
+    uint64_t render_from = UINT64_MAX;
+    uint64_t expected = 0;
+    bool expect_given = false;
+    std::vector<std::string> paths;
+
+    for (int i = 2; i < argc; i++) {
+        if (recording && !std::strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (recording && !std::strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!recording && !std::strcmp(argv[i], "-r") && i + 1 < argc)
+            render_from = std::strtoull(argv[++i], nullptr, 10);
+        else if (!recording && !std::strcmp(argv[i], "-e") && i + 1 < argc) {
+            expected = std::strtoull(argv[++i], nullptr, 16);
+            expect_given = true;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else
+            paths.push_back(argv[i]);
+    }
+    if (paths.size() != 2) {
+        usage();
+        return 2;
+    }
+
+    try {
+        if (recording)
+            return record(paths[0], paths[1], frames, seed);
+        return replay(paths[0], paths[1], render_from, expect_given, expected);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_movie: %s\n", e.what());
+        return 1;
+    }
+}
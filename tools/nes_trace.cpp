@@ -0,0 +1,89 @@
+// CPU trace recorder: runs a ROM headless with a TraceWriter attached and
+// writes one record per instruction, for nes_tracediff.
+//
+//   nes_trace [-c cycles] [-b] [--nestest] rom trace
+//
+// The ROM runs `cycles` CPU cycles (one NTSC second by default) from reset,
+// through the interpreter or, with -b, the block cache. --nestest starts at
+// $C000 instead of the reset vector, nestest's automated mode, so the trace
+// lines up with nestest.log from its first line. Needs a build configured
+// with -DNES_TRACE=ON, the trace hook does not exist otherwise.
+
+#include "bus.hpp"
+#include "mapper.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    const h_word NESTEST_START = 0xC000;
+
+    void usage() {
+        std::fprintf(stderr, "usage: nes_trace [-c cycles] [-b] [--nestest] rom trace\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t cycles = 1789773;
+    bool block_cache = false;
+    bool nestest = false;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-c") && i + 1 < argc)
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "-b"))
+            block_cache = true;
+        else if (!std::strcmp(argv[i], "--nestest"))
+            nestest = true;
+        else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else
+            paths.push_back(argv[i]);
+    }
+    if (paths.size() != 2 || cycles == 0) {
+        usage();
+        return 2;
+    }
+    if (!NES_ENABLE_TRACE) {
+        std::fprintf(stderr, "nes_trace: built without NES_TRACE, there is nothing to record\n");
+        return 2;
+    }
+
+    try {
+        auto rom = CartridgeImage::load(paths[0]);
+        if (!Mapper::supports(rom->mapper))
+            throw std::runtime_error(paths[0] + ": mapper " + std::to_string(rom->mapper) + " is not supported");
+
+        Bus bus;
+        bus.insertCartridge(rom);
+        bus.reset();
+        CPU& cpu = bus.getCpu();
+        cpu.enableBlockCache(block_cache);
+        if (nestest) {
+            CpuState state;
+            cpu.saveState(state);
+            state.pc = NESTEST_START;
+            cpu.loadState(state);
+        }
+
+        TraceWriter writer(paths[1]);
+        cpu.setTracer(&writer);
+        uint64_t ran = bus.run(cycles);
+        cpu.setTracer(nullptr);
+        writer.flush();
+        std::printf("%llu instructions over %llu cycles written to %s\n",
+            (unsigned long long)writer.count(), (unsigned long long)ran, paths[1].c_str());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_trace: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Compares a binary CPU trace against a reference and reports the first
+// divergence.
+//
+//   nes_tracediff [--absolute-cycles] <trace> <reference>
+//
+// The reference is either another binary trace or a nestest.log style text log
+// ("C000  4C F5 C5  JMP $C5F5   A:00 X:00 Y:00 P:24 SP:FD ... CYC:7"). Cycles
+// are compared relative to the first instruction of each side unless
+// --absolute-cycles is given, since reset sequences differ between emulators.
+
+#include "op_table.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    bool isBinaryTrace(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t magic = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        return file && magic == TraceHeader::MAGIC;
+    }
+
+    // value of the hex field following `key`, searched from the end of the
+    // line so the disassembly column cannot fool it
+    bool field(const std::string& line, const char* key, unsigned long& value, int base = 16) {
+        size_t at = line.rfind(key);
+        if (at == std::string::npos)
+            return false;
+        const char* start = line.c_str() + at + std::strlen(key);
+        char* stop = nullptr;
+        value = std::strtoul(start, &stop, base);
+        return stop != start;
+    }
+
+    std::vector<TraceRecord> readNestestLog(const std::string& path) {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error("cannot open " + path);
+
+        std::vector<TraceRecord> records;
+        std::string line;
+        size_t number = 0;
+        while (std::getline(file, line)) {
+            number++;
+            if (line.size() < 8)
+                continue;
+            TraceRecord record = {};
+            unsigned long a, x, y, p, sp, cycle = 0;
+            if (!field(line, " A:", a) || !field(line, " X:", x) || !field(line, " Y:", y)
+                || !field(line, " P:", p) || !field(line, " SP:", sp))
+                throw std::runtime_error(path + ":" + std::to_string(number) + ": unrecognised line");
+            field(line, "CYC:", cycle, 10);
+            record.pc = static_cast<h_word>(std::strtoul(line.substr(0, 4).c_str(), nullptr, 16));
+            record.opcode = static_cast<byte>(std::strtoul(line.substr(6, 2).c_str(), nullptr, 16));
+            record.a = static_cast<byte>(a);
+            record.x = static_cast<byte>(x);
+            record.y = static_cast<byte>(y);
+            record.status = static_cast<byte>(p);
+            record.sp = static_cast<byte>(sp);
+            record.cycle = cycle;
+            records.push_back(record);
+        }
+        return records;
+    }
+
+    std::vector<TraceRecord> load(const std::string& path) {
+        return isBinaryTrace(path) ? readTrace(path) : readNestestLog(path);
+    }
+
+    void print(const char* label, const TraceRecord& record, uint64_t cycle) {
+        std::printf("  %-9s %04X  %02X %-3s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+            label, record.pc, record.opcode, opcodeName(record.opcode),
+            record.a, record.x, record.y, record.status, record.sp, (unsigned long long)cycle);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool absolute = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--absolute-cycles"))
+            absolute = true;
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.size() != 2) {
+        std::fprintf(stderr, "usage: nes_tracediff [--absolute-cycles] <trace> <reference>\n");
+        return 2;
+    }
+
+    std::vector<TraceRecord> trace, reference;
+    try {
+        trace = load(paths[0]);
+        reference = load(paths[1]);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "nes_tracediff: %s\n", e.what());
+        return 2;
+    }
+
+    uint64_t trace_base = (!absolute && !trace.empty()) ? trace[0].cycle : 0;
+    uint64_t reference_base = (!absolute && !reference.empty()) ? reference[0].cycle : 0;
+
+    size_t common = std::min(trace.size(), reference.size());
+    for (size_t i = 0; i < common; i++) {
+        const TraceRecord& got = trace[i];
+        const TraceRecord& want = reference[i];
+        uint64_t got_cycle = got.cycle - trace_base;
+        uint64_t want_cycle = want.cycle - reference_base;
+
+        const char* what = nullptr;
+        if (got.pc != want.pc) what = "PC";
+        else if (got.opcode != want.opcode) what = "opcode";
+        else if (got.a != want.a) what = "A";
+        else if (got.x != want.x) what = "X";
+        else if (got.y != want.y) what = "Y";
+        else if (got.status != want.status) what = "P";
+        else if (got.sp != want.sp) what = "SP";
+        else if (got_cycle != want_cycle) what = "cycle count";
+
+        if (what) {
+            std::printf("first divergence at instruction %zu: %s differs\n", i, what);
+            if (i > 0)
+                print("previous", trace[i - 1], trace[i - 1].cycle - trace_base);
+            print("trace", got, got_cycle);
+            print("reference", want, want_cycle);
+            return 1;
+        }
+    }
+
+    if (trace.size() != reference.size()) {
+        std::printf("identical over %zu instructions, then the %s ends (%zu vs %zu)\n", common,
+            trace.size() < reference.size() ? "trace" : "reference", trace.size(), reference.size());
+        return trace.size() < reference.size() ? 1 : 0;
+    }
+    std::printf("identical over %zu instructions\n", common);
+    return 0;
+}